@@ -16,6 +16,7 @@ extern "C"
 {
 #include "ym2151.h"
 }
+#include "ym2151_simd.h"
 #include "attotime.h"
 
 
@@ -127,6 +128,10 @@ struct YM2151
 	UINT32      irq_enable;             /* IRQ enable for timer B (bit 3) and timer A (bit 2); bit 7 - CSM mode (keyon to all slots, everytime timer A overflows) */
 	UINT32      status;                 /* chip status (BUSY, IRQ Flags) */
 	UINT8       connect[8];             /* channels connections */
+	UINT32      active_channels;        /* bit n set while channel n may produce output (see channel_quiet()) */
+
+	int         simd_level;             /* YM2151_SIMD_xxx kernel used by ym2151_update_block() */
+	YM2151SimdChannels simd;            /* its working state */
 
 #ifdef USE_MAME_TIMERS
 /* ASG 980324 -- added for tracking timers */
@@ -491,6 +496,9 @@ static const UINT8 lfo_noise_waveform[256] = {
 
 
 
+/* use the pointer-routed chan_calc() instead of the per-connection kernels */
+/* #define YM2151_GENERIC_CHAN_CALC */
+
 /* save output as raw 16-bit sample */
 /* #define SAVE_SAMPLE */
 /* #define SAVE_SEPARATE_CHANNELS */
@@ -736,6 +744,7 @@ static void init_chip_tables(YM2151 *chip)
 #define KEY_ON(op, key_set){                                    \
 		if (!(op)->key)                                         \
 		{                                                       \
+			PSG->active_channels |= 1 << (((op) - PSG->oper) >> 2); \
 			(op)->phase = 0;            /* clear phase */       \
 			(op)->state = EG_ATT;       /* KEY ON = attack */   \
 			(op)->volume += (~(op)->volume *                    \
@@ -1227,7 +1236,7 @@ void ym2151_write_reg(void *_chip, int r, int v)
 
 		case 0x08:  /* Key Code */
 			v &= 0x7f;
-			if (v != op->kc)
+			if ((UINT32)v != op->kc)
 			{
 				UINT32 kc, kc_channel;
 
@@ -1264,7 +1273,7 @@ void ym2151_write_reg(void *_chip, int r, int v)
 
 		case 0x10:  /* Key Fraction */
 			v >>= 2;
-			if (v !=  (op->kc_i & 63))
+			if ((UINT32)v !=  (op->kc_i & 63))
 			{
 				UINT32 kc_channel;
 
@@ -1387,6 +1396,33 @@ int ym2151_read_status( void *_chip )
 	return chip->status;
 }
 
+void ym2151_get_operator_digest(void *_chip, UINT8 *digest)
+{
+	YM2151 *chip = (YM2151 *)_chip;
+	int i;
+
+	for (i = 0; i < 32; i++)
+	{
+		const YM2151Operator *op = &chip->oper[i];
+		UINT32 h = 2166136261u;     /* FNV-1a over the state that evolves while rendering */
+		UINT32 v[8];
+		int j, k;
+
+		v[0] = op->phase;
+		v[1] = op->freq;
+		v[2] = (UINT32)op->volume;
+		v[3] = op->state | (op->key << 8);
+		v[4] = op->tl;
+		v[5] = (UINT32)op->fb_out_curr;
+		v[6] = (UINT32)op->fb_out_prev;
+		v[7] = (UINT32)op->mem_value;
+		for (j = 0; j < 8; j++)
+			for (k = 0; k < 32; k += 8)
+				h = (h ^ ((v[j] >> k) & 0xff)) * 16777619u;
+		digest[i] = (UINT8)(h ^ (h >> 8) ^ (h >> 16) ^ (h >> 24));
+	}
+}
+
 
 
 //#ifdef USE_MAME_TIMERS
@@ -1496,12 +1532,17 @@ static void ym2151_state_save_register( YM2151 *chip, device_t *device )
 #endif
 
 	device->save_item(NAME(chip->connect));
+	device->save_item(NAME(chip->active_channels));
 
 	device->machine().save().register_postload(save_prepost_delegate(FUNC(ym2151_postload), chip));
 }
 #else
 void ym2151_postload(YM2151 *chip)
 {
+	int j;
+
+	for (j=0; j<8; j++)
+		set_connect(chip, &chip->oper[j*4], j, chip->connect[j]);
 }
 
 static void ym2151_state_save_register( YM2151 *chip, device_t *device )
@@ -1510,6 +1551,171 @@ static void ym2151_state_save_register( YM2151 *chip, device_t *device )
 #endif
 
 
+/*
+*   state snapshots without MAME
+*
+*   ym2151_state_items() walks the same items as the MAME registration above,
+*   plus the timers, copying each one to or from a flat buffer in native byte
+*   order. The tables derived from the clock and the sample rate are not part
+*   of it, nor the pointers: ym2151_postload() restores those from connect[].
+*/
+
+#define YM2151_STATE_VERSION    1
+
+struct YM2151StateIO
+{
+	UINT8       *save;                  /* buffer written by ym2151_save_state() */
+	const UINT8 *load;                  /* buffer read by ym2151_load_state() */
+	UINT32      pos;                    /* bytes walked so far */
+};
+
+static void state_item(YM2151StateIO *io, void *item, UINT32 size)
+{
+	if (io->save)
+		memcpy(io->save + io->pos, item, size);
+	else if (io->load)
+		memcpy(item, io->load + io->pos, size);
+	io->pos += size;
+}
+
+#define STATE_ITEM(io, x)   state_item(io, &(x), sizeof(x))
+
+static void ym2151_state_items(YM2151 *chip, YM2151StateIO *io)
+{
+	int j;
+
+	for (j=0; j<32; j++)
+	{
+		YM2151Operator *op = &chip->oper[j];
+
+		STATE_ITEM(io, op->phase);
+		STATE_ITEM(io, op->freq);
+		STATE_ITEM(io, op->dt1);
+		STATE_ITEM(io, op->mul);
+		STATE_ITEM(io, op->dt1_i);
+		STATE_ITEM(io, op->dt2);
+		STATE_ITEM(io, op->mem_value);
+
+		STATE_ITEM(io, op->fb_shift);
+		STATE_ITEM(io, op->fb_out_curr);
+		STATE_ITEM(io, op->fb_out_prev);
+		STATE_ITEM(io, op->kc);
+		STATE_ITEM(io, op->kc_i);
+		STATE_ITEM(io, op->pms);
+		STATE_ITEM(io, op->ams);
+		STATE_ITEM(io, op->AMmask);
+
+		STATE_ITEM(io, op->state);
+		STATE_ITEM(io, op->eg_sh_ar);
+		STATE_ITEM(io, op->eg_sel_ar);
+		STATE_ITEM(io, op->tl);
+		STATE_ITEM(io, op->volume);
+		STATE_ITEM(io, op->eg_sh_d1r);
+		STATE_ITEM(io, op->eg_sel_d1r);
+		STATE_ITEM(io, op->d1l);
+		STATE_ITEM(io, op->eg_sh_d2r);
+		STATE_ITEM(io, op->eg_sel_d2r);
+		STATE_ITEM(io, op->eg_sh_rr);
+		STATE_ITEM(io, op->eg_sel_rr);
+
+		STATE_ITEM(io, op->key);
+		STATE_ITEM(io, op->ks);
+		STATE_ITEM(io, op->ar);
+		STATE_ITEM(io, op->d1r);
+		STATE_ITEM(io, op->d2r);
+		STATE_ITEM(io, op->rr);
+	}
+
+	STATE_ITEM(io, chip->pan);
+
+	STATE_ITEM(io, chip->eg_cnt);
+	STATE_ITEM(io, chip->eg_timer);
+
+	STATE_ITEM(io, chip->lfo_phase);
+	STATE_ITEM(io, chip->lfo_timer);
+	STATE_ITEM(io, chip->lfo_overflow);
+	STATE_ITEM(io, chip->lfo_counter);
+	STATE_ITEM(io, chip->lfo_counter_add);
+	STATE_ITEM(io, chip->lfo_wsel);
+	STATE_ITEM(io, chip->amd);
+	STATE_ITEM(io, chip->pmd);
+	STATE_ITEM(io, chip->lfa);
+	STATE_ITEM(io, chip->lfp);
+
+	STATE_ITEM(io, chip->test);
+	STATE_ITEM(io, chip->ct);
+
+	STATE_ITEM(io, chip->noise);
+	STATE_ITEM(io, chip->noise_rng);
+	STATE_ITEM(io, chip->noise_p);
+	STATE_ITEM(io, chip->noise_f);
+
+	STATE_ITEM(io, chip->csm_req);
+	STATE_ITEM(io, chip->irq_enable);
+	STATE_ITEM(io, chip->status);
+
+#ifndef USE_MAME_TIMERS
+	STATE_ITEM(io, chip->tim_A);
+	STATE_ITEM(io, chip->tim_B);
+	STATE_ITEM(io, chip->tim_A_val);
+	STATE_ITEM(io, chip->tim_B_val);
+#endif
+	STATE_ITEM(io, chip->timer_A_index);
+	STATE_ITEM(io, chip->timer_B_index);
+	STATE_ITEM(io, chip->timer_A_index_old);
+	STATE_ITEM(io, chip->timer_B_index_old);
+
+	STATE_ITEM(io, chip->connect);
+	STATE_ITEM(io, chip->active_channels);
+}
+
+/* the header: version, then the clock and rate the derived tables were built for */
+static void ym2151_state_header(YM2151StateIO *io, UINT32 *version, UINT32 *clock, UINT32 *rate)
+{
+	state_item(io, version, sizeof(*version));
+	state_item(io, clock, sizeof(*clock));
+	state_item(io, rate, sizeof(*rate));
+}
+
+UINT32 ym2151_save_state(void *_chip, UINT8 *buf, UINT32 size)
+{
+	YM2151 *chip = (YM2151 *)_chip;
+	YM2151StateIO io = { nullptr, nullptr, 0 };
+	UINT32 version = YM2151_STATE_VERSION, clock = chip->clock, rate = chip->sampfreq;
+
+	ym2151_state_header(&io, &version, &clock, &rate);
+	ym2151_state_items(chip, &io);
+	if (buf == nullptr || size < io.pos)
+		return io.pos;
+
+	io.save = buf;
+	io.pos = 0;
+	ym2151_state_header(&io, &version, &clock, &rate);
+	ym2151_state_items(chip, &io);
+	return io.pos;
+}
+
+int ym2151_load_state(void *_chip, const UINT8 *buf, UINT32 size)
+{
+	YM2151 *chip = (YM2151 *)_chip;
+	YM2151StateIO io = { nullptr, nullptr, 0 };
+	UINT32 version = 0, clock = 0, rate = 0;
+
+	/* the snapshot must be exactly what this chip would save */
+	if (size != ym2151_save_state(chip, nullptr, 0))
+		return -1;
+
+	io.load = buf;
+	ym2151_state_header(&io, &version, &clock, &rate);
+	if (version != YM2151_STATE_VERSION || clock != chip->clock || rate != chip->sampfreq)
+		return -1;
+
+	ym2151_state_items(chip, &io);
+	ym2151_postload(chip);
+	return 0;
+}
+
+
 /*
 *   Initialize YM2151 emulator(s).
 *
@@ -1528,7 +1734,10 @@ void * ym2151_init(device_t *device, int clock, int rate)
 
 	ym2151_state_save_register( PSG, device );
 
-	init_tables();
+	/* the global tables are shared by all chips: build them only once, */
+	/* even when several chips are initialized from different threads */
+	static const bool tables_initialized = (init_tables(), true);
+	(void)tables_initialized;
 
 	PSG->device = device;
 	PSG->clock = clock;
@@ -1536,6 +1745,8 @@ void * ym2151_init(device_t *device, int clock, int rate)
 	PSG->sampfreq = rate ? rate : 44100;    /* avoid division by 0 in init_chip_tables() */
 	PSG->irqhandler = nullptr;                 /* interrupt handler  */
 	PSG->porthandler = nullptr;                /* port write handler */
+	/* without a gather instruction the SSE2 kernel does not beat chan_calc_block(), so it is opt-in */
+	PSG->simd_level = (ym2151_simd_detect() == YM2151_SIMD_AVX2) ? YM2151_SIMD_AVX2 : YM2151_SIMD_NONE;
 	init_chip_tables( PSG );
 
 	PSG->lfo_timer_add = (1<<LFO_SH) * (clock/64.0) / PSG->sampfreq;
@@ -1560,8 +1771,8 @@ void * ym2151_init(device_t *device, int clock, int rate)
 		/*
 		cymfile = fopen("2151_.cym","wb");
 		if (cymfile)
-			device->machine().scheduler().timer_pulse ( attotime::from_hz(110), FUNC(cymfile_callback)); /*110 Hz pulse timer*/
-		/*else
+			device->machine().scheduler().timer_pulse ( attotime::from_hz(110), FUNC(cymfile_callback)); // 110 Hz pulse timer
+		else
 			device->logerror("Could not create file 2151_.cym\n");
 		*/
 	}
@@ -1578,9 +1789,12 @@ void ym2151_shutdown(void *_chip)
 	//auto_free (chip->device->machine(), chip);
 	free(chip);
 
-	if (cymfile)
+	/* the log file is shared by all the chips, only touch it when logging is enabled */
+	if (LOG_CYM_FILE && cymfile)
+	{
 		fclose (cymfile);
-	cymfile = nullptr;
+		cymfile = nullptr;
+	}
 
 #ifdef SAVE_SAMPLE
 	fclose(sample[8]);
@@ -1654,6 +1868,7 @@ void ym2151_reset_chip(void *_chip)
 
 	chip->csm_req   = 0;
 	chip->status    = 0;
+	chip->active_channels = 0;
 
 	ym2151_write_reg(chip, 0x1b, 0);    /* only because of CT1, CT2 output pins */
 	ym2151_write_reg(chip, 0x18, 0);    /* set LFO frequency */
@@ -1665,12 +1880,12 @@ void ym2151_reset_chip(void *_chip)
 
 
 
-static inline signed int op_calc(YM2151Operator * OP, unsigned int env, signed int pm)
+static inline signed int phase_calc(UINT32 phase, unsigned int env, signed int pm)
 {
 	UINT32 p;
 
 
-	p = (env<<3) + sin_tab[ ( ((signed int)((OP->phase & ~FREQ_MASK) + (pm<<15))) >> FREQ_SH ) & SIN_MASK ];
+	p = (env<<3) + sin_tab[ ( ((signed int)((phase & ~FREQ_MASK) + (pm<<15))) >> FREQ_SH ) & SIN_MASK ];
 
 	if (p >= TL_TAB_LEN)
 		return 0;
@@ -1678,13 +1893,13 @@ static inline signed int op_calc(YM2151Operator * OP, unsigned int env, signed i
 	return tl_tab[p];
 }
 
-static inline signed int op_calc1(YM2151Operator * OP, unsigned int env, signed int pm)
+static inline signed int phase_calc1(UINT32 phase, unsigned int env, signed int pm)
 {
 	UINT32 p;
 	INT32  i;
 
 
-	i = (OP->phase & ~FREQ_MASK) + pm;
+	i = (phase & ~FREQ_MASK) + pm;
 
 /*logerror("i=%08x (i>>16)&511=%8i phase=%i [pm=%08x] ",i, (i>>16)&511, OP->phase>>FREQ_SH, pm);*/
 
@@ -1698,6 +1913,16 @@ static inline signed int op_calc1(YM2151Operator * OP, unsigned int env, signed
 	return tl_tab[p];
 }
 
+static inline signed int op_calc(YM2151Operator * OP, unsigned int env, signed int pm)
+{
+	return phase_calc(OP->phase, env, pm);
+}
+
+static inline signed int op_calc1(YM2151Operator * OP, unsigned int env, signed int pm)
+{
+	return phase_calc1(OP->phase, env, pm);
+}
+
 
 
 #define volume_calc(OP) ((OP)->tl + ((UINT32)(OP)->volume) + (AM & (OP)->AMmask))
@@ -1813,6 +2038,109 @@ static inline void chan7_calc(YM2151 *PSG)
 	op->mem_value = PSG->mem;
 }
 
+/*  Per-connection variants of chan_calc()/chan7_calc(). The routing that
+*   set_connect() expresses through the connect/mem_connect pointers is
+*   resolved at compile time, so the operator outputs are summed in locals.
+*   The results are bit-identical to the generic functions above, which
+*   stay in use when YM2151_GENERIC_CHAN_CALC is defined.
+*/
+template<int CON, bool NOISE>
+static void chan_calc_con(YM2151 *PSG, unsigned int chan)
+{
+	YM2151Operator *op;
+	unsigned int env;
+	UINT32 AM = 0;
+	signed int m2 = 0, c1 = 0, c2 = 0, mem = 0, out = 0;
+
+	op = &PSG->oper[chan*4];    /* M1 */
+
+	/* restore delayed sample (MEM) value */
+	if (CON <= 2 || CON == 5)
+		m2 = op->mem_value;
+	else if (CON == 3)
+		c2 = op->mem_value;
+	else
+		mem = op->mem_value;    /* not used, only carried over */
+
+	if (op->ams)
+		AM = PSG->lfa << (op->ams-1);
+	env = volume_calc(op);
+	{
+		INT32 fb = op->fb_out_prev + op->fb_out_curr;
+		op->fb_out_prev = op->fb_out_curr;
+
+		switch (CON)
+		{
+		case 0: case 3: case 4: case 6: c1  = op->fb_out_prev; break;
+		case 1:                         mem = op->fb_out_prev; break;
+		case 2:                         c2  = op->fb_out_prev; break;
+		case 5:       mem = c1 = c2 = op->fb_out_prev; break;
+		case 7:                         out = op->fb_out_prev; break;
+		}
+
+		op->fb_out_curr = 0;
+		if (env < ENV_QUIET)
+		{
+			if (!op->fb_shift)
+				fb=0;
+			op->fb_out_curr = op_calc1(op, env, (fb<<op->fb_shift) );
+		}
+	}
+
+	env = volume_calc(op+1);    /* M2 */
+	if (env < ENV_QUIET)
+	{
+		if (CON >= 5)
+			out += op_calc(op+1, env, m2);
+		else
+			c2  += op_calc(op+1, env, m2);
+	}
+
+	env = volume_calc(op+2);    /* C1 */
+	if (env < ENV_QUIET)
+	{
+		if (CON >= 4)
+			out += op_calc(op+2, env, c1);
+		else
+			mem += op_calc(op+2, env, c1);
+	}
+
+	env = volume_calc(op+3);    /* C2 */
+	if (NOISE)
+	{
+		INT32 noiseout;
+
+		noiseout = 0;
+		if (env < 0x3ff)
+			noiseout = (env ^ 0x3ff) * 2;   /* range of the YM2151 noise output is -2044 to 2040 */
+		out += ((PSG->noise_rng&0x10000) ? noiseout: -noiseout); /* bit 16 -> output */
+	}
+	else
+	{
+		if (env < ENV_QUIET)
+			out += op_calc(op+3, env, c2);
+	}
+
+	PSG->chanout[chan] += out;
+
+	/* M1 */
+	op->mem_value = mem;
+}
+
+typedef void (*chan_calc_func)(YM2151 *PSG, unsigned int chan);
+
+static const chan_calc_func chan_calc_table[2][8] =
+{
+	{
+		chan_calc_con<0, false>, chan_calc_con<1, false>, chan_calc_con<2, false>, chan_calc_con<3, false>,
+		chan_calc_con<4, false>, chan_calc_con<5, false>, chan_calc_con<6, false>, chan_calc_con<7, false>
+	},
+	{
+		chan_calc_con<0, true>,  chan_calc_con<1, true>,  chan_calc_con<2, true>,  chan_calc_con<3, true>,
+		chan_calc_con<4, true>,  chan_calc_con<5, true>,  chan_calc_con<6, true>,  chan_calc_con<7, true>
+	}
+};
+
 
 
 
@@ -2022,6 +2350,69 @@ rate 11 1         |
 								 --
 */
 
+/* one envelope generator step of a single operator at counter value 'eg_cnt' */
+template<class OP>
+static inline void eg_update(OP *op, UINT32 eg_cnt)
+{
+	switch(op->state)
+	{
+	case EG_ATT:    /* attack phase */
+		if ( !(eg_cnt & ((1<<op->eg_sh_ar)-1) ) )
+		{
+			op->volume += (~op->volume *
+							(eg_inc[op->eg_sel_ar + ((eg_cnt>>op->eg_sh_ar)&7)])
+							) >>4;
+
+			if (op->volume <= MIN_ATT_INDEX)
+			{
+				op->volume = MIN_ATT_INDEX;
+				op->state = EG_DEC;
+			}
+
+		}
+	break;
+
+	case EG_DEC:    /* decay phase */
+		if ( !(eg_cnt & ((1<<op->eg_sh_d1r)-1) ) )
+		{
+			op->volume += eg_inc[op->eg_sel_d1r + ((eg_cnt>>op->eg_sh_d1r)&7)];
+
+			if ( op->volume >= (INT32)op->d1l )
+				op->state = EG_SUS;
+
+		}
+	break;
+
+	case EG_SUS:    /* sustain phase */
+		if ( !(eg_cnt & ((1<<op->eg_sh_d2r)-1) ) )
+		{
+			op->volume += eg_inc[op->eg_sel_d2r + ((eg_cnt>>op->eg_sh_d2r)&7)];
+
+			if ( op->volume >= MAX_ATT_INDEX )
+			{
+				op->volume = MAX_ATT_INDEX;
+				op->state = EG_OFF;
+			}
+
+		}
+	break;
+
+	case EG_REL:    /* release phase */
+		if ( !(eg_cnt & ((1<<op->eg_sh_rr)-1) ) )
+		{
+			op->volume += eg_inc[op->eg_sel_rr + ((eg_cnt>>op->eg_sh_rr)&7)];
+
+			if ( op->volume >= MAX_ATT_INDEX )
+			{
+				op->volume = MAX_ATT_INDEX;
+				op->state = EG_OFF;
+			}
+
+		}
+	break;
+	}
+}
+
 static inline void advance_eg(YM2151 *PSG)
 {
 	YM2151Operator *op;
@@ -2042,63 +2433,15 @@ static inline void advance_eg(YM2151 *PSG)
 		i = 32;
 		do
 		{
-			switch(op->state)
+			/* all operators of an inactive channel are in EG_OFF */
+			if (!(PSG->active_channels & (1 << ((32 - i) >> 2))))
 			{
-			case EG_ATT:    /* attack phase */
-				if ( !(PSG->eg_cnt & ((1<<op->eg_sh_ar)-1) ) )
-				{
-					op->volume += (~op->volume *
-									(eg_inc[op->eg_sel_ar + ((PSG->eg_cnt>>op->eg_sh_ar)&7)])
-									) >>4;
-
-					if (op->volume <= MIN_ATT_INDEX)
-					{
-						op->volume = MIN_ATT_INDEX;
-						op->state = EG_DEC;
-					}
-
-				}
-			break;
-
-			case EG_DEC:    /* decay phase */
-				if ( !(PSG->eg_cnt & ((1<<op->eg_sh_d1r)-1) ) )
-				{
-					op->volume += eg_inc[op->eg_sel_d1r + ((PSG->eg_cnt>>op->eg_sh_d1r)&7)];
-
-					if ( op->volume >= op->d1l )
-						op->state = EG_SUS;
-
-				}
-			break;
-
-			case EG_SUS:    /* sustain phase */
-				if ( !(PSG->eg_cnt & ((1<<op->eg_sh_d2r)-1) ) )
-				{
-					op->volume += eg_inc[op->eg_sel_d2r + ((PSG->eg_cnt>>op->eg_sh_d2r)&7)];
-
-					if ( op->volume >= MAX_ATT_INDEX )
-					{
-						op->volume = MAX_ATT_INDEX;
-						op->state = EG_OFF;
-					}
-
-				}
-			break;
-
-			case EG_REL:    /* release phase */
-				if ( !(PSG->eg_cnt & ((1<<op->eg_sh_rr)-1) ) )
-				{
-					op->volume += eg_inc[op->eg_sel_rr + ((PSG->eg_cnt>>op->eg_sh_rr)&7)];
-
-					if ( op->volume >= MAX_ATT_INDEX )
-					{
-						op->volume = MAX_ATT_INDEX;
-						op->state = EG_OFF;
-					}
-
-				}
-			break;
+				op += 4;
+				i -= 4;
+				continue;
 			}
+
+			eg_update(op, PSG->eg_cnt);
 			op++;
 			i--;
 		}while (i);
@@ -2106,28 +2449,12 @@ static inline void advance_eg(YM2151 *PSG)
 }
 
 
-static inline void advance(YM2151 *PSG)
+/* LFO AM and PM output (lfa, lfp) at the current LFO phase */
+static inline void lfo_output(YM2151 *PSG)
 {
-	YM2151Operator *op;
 	unsigned int i;
 	int a,p;
 
-	/* LFO */
-	if (PSG->test&2)
-		PSG->lfo_phase = 0;
-	else
-	{
-		PSG->lfo_timer += PSG->lfo_timer_add;
-		if (PSG->lfo_timer >= PSG->lfo_overflow)
-		{
-			PSG->lfo_timer   -= PSG->lfo_overflow;
-			PSG->lfo_counter += PSG->lfo_counter_add;
-			PSG->lfo_phase   += (PSG->lfo_counter>>4);
-			PSG->lfo_phase   &= 255;
-			PSG->lfo_counter &= 15;
-		}
-	}
-
 	i = PSG->lfo_phase;
 	/* calculate LFO AM and PM waveform value (all verified on real chip, except for noise algorithm which is impossible to analyse)*/
 	switch (PSG->lfo_wsel)
@@ -2190,6 +2517,30 @@ static inline void advance(YM2151 *PSG)
 	}
 	PSG->lfa = a * PSG->amd / 128;
 	PSG->lfp = p * PSG->pmd / 128;
+}
+
+/* LFO and noise generator, the part of advance() shared by all channels */
+static inline void advance_lfo(YM2151 *PSG)
+{
+	unsigned int i;
+
+	/* LFO */
+	if (PSG->test&2)
+		PSG->lfo_phase = 0;
+	else
+	{
+		PSG->lfo_timer += PSG->lfo_timer_add;
+		if (PSG->lfo_timer >= PSG->lfo_overflow)
+		{
+			PSG->lfo_timer   -= PSG->lfo_overflow;
+			PSG->lfo_counter += PSG->lfo_counter_add;
+			PSG->lfo_phase   += (PSG->lfo_counter>>4);
+			PSG->lfo_phase   &= 255;
+			PSG->lfo_counter &= 15;
+		}
+	}
+
+	lfo_output(PSG);
 
 
 	/*  The Noise Generator of the YM2151 is 17-bit shift register.
@@ -2207,13 +2558,29 @@ static inline void advance(YM2151 *PSG)
 		PSG->noise_rng = (j<<16) | (PSG->noise_rng>>1);
 		i--;
 	}
+}
+
+
+static inline void advance(YM2151 *PSG)
+{
+	YM2151Operator *op;
+	unsigned int i;
 
+	advance_lfo(PSG);
 
 	/* phase generator */
 	op = &PSG->oper[0]; /* CH 0 M1 */
 	i = 8;
 	do
 	{
+		/* the phase of an inactive channel is cleared by KEY_ON before it is heard again */
+		if (!(PSG->active_channels & (1 << (8 - i))))
+		{
+			op += 4;
+			i--;
+			continue;
+		}
+
 		if (op->pms)    /* only when phase modulation from LFO is enabled for this channel */
 		{
 			INT32 mod_ind = PSG->lfp;       /* -128..+127 (8bits signed) */
@@ -2385,23 +2752,30 @@ static inline signed int acc_calc(signed int value)
 #endif
 
 
-/*  Generate samples for one of the YM2151's
-*
-*   'num' is the number of virtual YM2151
-*   '**buffers' is table of pointers to the buffers: left and right
-*   'length' is the number of samples that should be generated
+/*  A channel is quiet when all of its operators are in EG_OFF (at MAX_ATT_INDEX,
+*   so none of them passes the ENV_QUIET test) and its feedback and MEM delay
+*   have drained. chan_calc() then outputs nothing and changes no state, so the
+*   channel can be skipped until KEY_ON marks it active again.
 */
-void ym2151_update_one(void *chip, SAMP **buffers, int length)
+static inline int channel_quiet(YM2151 *PSG, unsigned int chan)
 {
-	YM2151 *PSG = (YM2151 *)chip;
-	signed int *chanout = PSG->chanout;
-	int i;
-	signed int outl,outr;
-	SAMP *bufL, *bufR;
+	YM2151Operator *op = &PSG->oper[chan*4];
 
-	bufL = buffers[0];
-	bufR = buffers[1];
+	return  op[0].state == EG_OFF && op[1].state == EG_OFF &&
+			op[2].state == EG_OFF && op[3].state == EG_OFF &&
+			op->fb_out_prev == 0 && op->fb_out_curr == 0 && op->mem_value == 0;
+}
+
+#define CALC_CHANNEL(j, calc) \
+		if (PSG->active_channels & (1 << (j))) \
+		{ \
+			calc; \
+			if (channel_quiet(PSG, j)) \
+				PSG->active_channels &= ~(1 << (j)); \
+		}
 
+static inline void advance_timer_b(YM2151 *PSG, int length)
+{
 #ifdef USE_MAME_TIMERS
 		/* ASG 980324 - handled by real timers now */
 #else
@@ -2420,65 +2794,10 @@ void ym2151_update_one(void *chip, SAMP **buffers, int length)
 		}
 	}
 #endif
+}
 
-	for (i=0; i<length; i++)
-	{
-		advance_eg(PSG);
-
-		chanout[0] = 0;
-		chanout[1] = 0;
-		chanout[2] = 0;
-		chanout[3] = 0;
-		chanout[4] = 0;
-		chanout[5] = 0;
-		chanout[6] = 0;
-		chanout[7] = 0;
-
-		chan_calc(PSG, 0);
-		SAVE_SINGLE_CHANNEL(0)
-		chan_calc(PSG, 1);
-		SAVE_SINGLE_CHANNEL(1)
-		chan_calc(PSG, 2);
-		SAVE_SINGLE_CHANNEL(2)
-		chan_calc(PSG, 3);
-		SAVE_SINGLE_CHANNEL(3)
-		chan_calc(PSG, 4);
-		SAVE_SINGLE_CHANNEL(4)
-		chan_calc(PSG, 5);
-		SAVE_SINGLE_CHANNEL(5)
-		chan_calc(PSG, 6);
-		SAVE_SINGLE_CHANNEL(6)
-		chan7_calc(PSG);
-		SAVE_SINGLE_CHANNEL(7)
-
-		outl = chanout[0] & PSG->pan[0];
-		outr = chanout[0] & PSG->pan[1];
-		outl += (chanout[1] & PSG->pan[2]);
-		outr += (chanout[1] & PSG->pan[3]);
-		outl += (chanout[2] & PSG->pan[4]);
-		outr += (chanout[2] & PSG->pan[5]);
-		outl += (chanout[3] & PSG->pan[6]);
-		outr += (chanout[3] & PSG->pan[7]);
-		outl += (chanout[4] & PSG->pan[8]);
-		outr += (chanout[4] & PSG->pan[9]);
-		outl += (chanout[5] & PSG->pan[10]);
-		outr += (chanout[5] & PSG->pan[11]);
-		outl += (chanout[6] & PSG->pan[12]);
-		outr += (chanout[6] & PSG->pan[13]);
-		outl += (chanout[7] & PSG->pan[14]);
-		outr += (chanout[7] & PSG->pan[15]);
-
-		outl >>= FINAL_SH;
-		outr >>= FINAL_SH;
-		if (outl > MAXOUT) outl = MAXOUT;
-			else if (outl < MINOUT) outl = MINOUT;
-		if (outr > MAXOUT) outr = MAXOUT;
-			else if (outr < MINOUT) outr = MINOUT;
-		((SAMP*)bufL)[i] = (SAMP)outl;
-		((SAMP*)bufR)[i] = (SAMP)outr;
-
-		SAVE_ALL_CHANNELS
-
+static inline void advance_timer_a(YM2151 *PSG)
+{
 #ifdef USE_MAME_TIMERS
 		/* ASG 980324 - handled by real timers now */
 #else
@@ -2500,10 +2819,836 @@ void ym2151_update_one(void *chip, SAMP **buffers, int length)
 			}
 		}
 #endif
+}
+
+/*  Generate samples for one of the YM2151's
+*
+*   'num' is the number of virtual YM2151
+*   '**buffers' is table of pointers to the buffers: left and right
+*   'length' is the number of samples that should be generated
+*/
+void ym2151_update_one(void *chip, SAMP **buffers, int length)
+{
+	YM2151 *PSG = (YM2151 *)chip;
+	signed int *chanout = PSG->chanout;
+	int i;
+	signed int outl,outr;
+	SAMP *bufL, *bufR;
+
+	bufL = buffers[0];
+	bufR = buffers[1];
+
+#ifndef YM2151_GENERIC_CHAN_CALC
+	/* connections and the noise enable only change between blocks */
+	chan_calc_func calc[8];
+	for (i=0; i<7; i++)
+		calc[i] = chan_calc_table[0][PSG->connect[i]];
+	calc[7] = chan_calc_table[(PSG->noise & 0x80) ? 1 : 0][PSG->connect[7]];
+#endif
+
+	advance_timer_b(PSG, length);
+
+	for (i=0; i<length; i++)
+	{
+		advance_eg(PSG);
+
+		if (PSG->active_channels)
+		{
+			chanout[0] = 0;
+			chanout[1] = 0;
+			chanout[2] = 0;
+			chanout[3] = 0;
+			chanout[4] = 0;
+			chanout[5] = 0;
+			chanout[6] = 0;
+			chanout[7] = 0;
+
+#ifdef YM2151_GENERIC_CHAN_CALC
+			CALC_CHANNEL(0, chan_calc(PSG, 0))
+			SAVE_SINGLE_CHANNEL(0)
+			CALC_CHANNEL(1, chan_calc(PSG, 1))
+			SAVE_SINGLE_CHANNEL(1)
+			CALC_CHANNEL(2, chan_calc(PSG, 2))
+			SAVE_SINGLE_CHANNEL(2)
+			CALC_CHANNEL(3, chan_calc(PSG, 3))
+			SAVE_SINGLE_CHANNEL(3)
+			CALC_CHANNEL(4, chan_calc(PSG, 4))
+			SAVE_SINGLE_CHANNEL(4)
+			CALC_CHANNEL(5, chan_calc(PSG, 5))
+			SAVE_SINGLE_CHANNEL(5)
+			CALC_CHANNEL(6, chan_calc(PSG, 6))
+			SAVE_SINGLE_CHANNEL(6)
+			CALC_CHANNEL(7, chan7_calc(PSG))
+			SAVE_SINGLE_CHANNEL(7)
+#else
+			CALC_CHANNEL(0, calc[0](PSG, 0))
+			SAVE_SINGLE_CHANNEL(0)
+			CALC_CHANNEL(1, calc[1](PSG, 1))
+			SAVE_SINGLE_CHANNEL(1)
+			CALC_CHANNEL(2, calc[2](PSG, 2))
+			SAVE_SINGLE_CHANNEL(2)
+			CALC_CHANNEL(3, calc[3](PSG, 3))
+			SAVE_SINGLE_CHANNEL(3)
+			CALC_CHANNEL(4, calc[4](PSG, 4))
+			SAVE_SINGLE_CHANNEL(4)
+			CALC_CHANNEL(5, calc[5](PSG, 5))
+			SAVE_SINGLE_CHANNEL(5)
+			CALC_CHANNEL(6, calc[6](PSG, 6))
+			SAVE_SINGLE_CHANNEL(6)
+			CALC_CHANNEL(7, calc[7](PSG, 7))
+			SAVE_SINGLE_CHANNEL(7)
+#endif
+
+			outl = chanout[0] & PSG->pan[0];
+			outr = chanout[0] & PSG->pan[1];
+			outl += (chanout[1] & PSG->pan[2]);
+			outr += (chanout[1] & PSG->pan[3]);
+			outl += (chanout[2] & PSG->pan[4]);
+			outr += (chanout[2] & PSG->pan[5]);
+			outl += (chanout[3] & PSG->pan[6]);
+			outr += (chanout[3] & PSG->pan[7]);
+			outl += (chanout[4] & PSG->pan[8]);
+			outr += (chanout[4] & PSG->pan[9]);
+			outl += (chanout[5] & PSG->pan[10]);
+			outr += (chanout[5] & PSG->pan[11]);
+			outl += (chanout[6] & PSG->pan[12]);
+			outr += (chanout[6] & PSG->pan[13]);
+			outl += (chanout[7] & PSG->pan[14]);
+			outr += (chanout[7] & PSG->pan[15]);
+
+			outl >>= FINAL_SH;
+			outr >>= FINAL_SH;
+			if (outl > MAXOUT) outl = MAXOUT;
+				else if (outl < MINOUT) outl = MINOUT;
+			if (outr > MAXOUT) outr = MAXOUT;
+				else if (outr < MINOUT) outr = MINOUT;
+			((SAMP*)bufL)[i] = (SAMP)outl;
+			((SAMP*)bufR)[i] = (SAMP)outr;
+
+			SAVE_ALL_CHANNELS
+		}
+		else
+		{
+			/* whole chip silent: nothing to mix, only the LFO, noise and timers run */
+			((SAMP*)bufL)[i] = 0;
+			((SAMP*)bufR)[i] = 0;
+		}
+
+		advance_timer_a(PSG);
 		advance(PSG);
 	}
 }
 
+/*  Block renderer
+*
+*   ym2151_update_block() produces the same samples as ym2151_update_one(),
+*   computed in a different order. For a block of up to BLOCK_LEN samples
+*   the state shared by all channels (envelope clock, LFO, noise, timer A)
+*   is stepped first and its per-sample values are recorded. Each active
+*   channel is then rendered over the whole block with its four operators
+*   held in local arrays, and the channels are mixed last.
+*   ym2151_update_one() stays the reference implementation.
+*/
+
+#define BLOCK_LEN   256
+
+struct YM2151Block
+{
+	UINT32      eg_ticks[BLOCK_LEN];    /* envelope generator steps before sample n */
+	UINT32      eg_cnt[BLOCK_LEN];      /* eg_cnt after those steps */
+	UINT32      lfa[BLOCK_LEN];         /* LFO AM output used by sample n */
+	INT32       lfp[BLOCK_LEN];         /* LFO PM output used by the phase step after sample n */
+	UINT32      noise[BLOCK_LEN];       /* noise output bit used by sample n */
+	signed int  chanout[8][BLOCK_LEN];
+};
+
+template<int CON, bool NOISE>
+static void chan_calc_block(YM2151 *PSG, unsigned int chan, const YM2151Block *blk, signed int *chanout, int length)
+{
+	YM2151Operator *op = &PSG->oper[chan*4];
+	UINT32 phase[4], freq[4], dt2[4], mul[4], tl[4], AMmask[4], state[4];
+	INT32  dt1[4], volume[4], d1l[4];
+	UINT8  sh_ar[4], sel_ar[4], sh_d1r[4], sel_d1r[4], sh_d2r[4], sel_d2r[4], sh_rr[4], sel_rr[4];
+	const UINT32 ams = op->ams, pms = op->pms, kc_i = op->kc_i, fb_shift = op->fb_shift;
+	INT32  fb_out_prev = op->fb_out_prev, fb_out_curr = op->fb_out_curr, mem_value = op->mem_value;
+	int k, n;
+
+	for (k=0; k<4; k++)
+	{
+		phase[k]   = op[k].phase;
+		freq[k]    = op[k].freq;
+		dt1[k]     = op[k].dt1;
+		dt2[k]     = op[k].dt2;
+		mul[k]     = op[k].mul;
+		tl[k]      = op[k].tl;
+		AMmask[k]  = op[k].AMmask;
+		state[k]   = op[k].state;
+		volume[k]  = op[k].volume;
+		d1l[k]     = op[k].d1l;
+		sh_ar[k]   = op[k].eg_sh_ar;
+		sel_ar[k]  = op[k].eg_sel_ar;
+		sh_d1r[k]  = op[k].eg_sh_d1r;
+		sel_d1r[k] = op[k].eg_sel_d1r;
+		sh_d2r[k]  = op[k].eg_sh_d2r;
+		sel_d2r[k] = op[k].eg_sel_d2r;
+		sh_rr[k]   = op[k].eg_sh_rr;
+		sel_rr[k]  = op[k].eg_sel_rr;
+	}
+
+	for (n=0; n<length; n++)
+	{
+		UINT32 t, AM = 0, env[4];
+		signed int m2 = 0, c1 = 0, c2 = 0, mem = 0, out = 0;
+
+		/* envelope generator, as in advance_eg() */
+		for (t=0; t<blk->eg_ticks[n]; t++)
+		{
+			UINT32 eg_cnt = blk->eg_cnt[n] - blk->eg_ticks[n] + 1 + t;
+
+			for (k=0; k<4; k++)
+			{
+				switch(state[k])
+				{
+				case EG_ATT:
+					if ( !(eg_cnt & ((1<<sh_ar[k])-1) ) )
+					{
+						volume[k] += (~volume[k] * (eg_inc[sel_ar[k] + ((eg_cnt>>sh_ar[k])&7)])) >>4;
+						if (volume[k] <= MIN_ATT_INDEX)
+						{
+							volume[k] = MIN_ATT_INDEX;
+							state[k] = EG_DEC;
+						}
+					}
+				break;
+
+				case EG_DEC:
+					if ( !(eg_cnt & ((1<<sh_d1r[k])-1) ) )
+					{
+						volume[k] += eg_inc[sel_d1r[k] + ((eg_cnt>>sh_d1r[k])&7)];
+						if ( volume[k] >= d1l[k] )
+							state[k] = EG_SUS;
+					}
+				break;
+
+				case EG_SUS:
+					if ( !(eg_cnt & ((1<<sh_d2r[k])-1) ) )
+					{
+						volume[k] += eg_inc[sel_d2r[k] + ((eg_cnt>>sh_d2r[k])&7)];
+						if ( volume[k] >= MAX_ATT_INDEX )
+						{
+							volume[k] = MAX_ATT_INDEX;
+							state[k] = EG_OFF;
+						}
+					}
+				break;
+
+				case EG_REL:
+					if ( !(eg_cnt & ((1<<sh_rr[k])-1) ) )
+					{
+						volume[k] += eg_inc[sel_rr[k] + ((eg_cnt>>sh_rr[k])&7)];
+						if ( volume[k] >= MAX_ATT_INDEX )
+						{
+							volume[k] = MAX_ATT_INDEX;
+							state[k] = EG_OFF;
+						}
+					}
+				break;
+				}
+			}
+		}
+
+		/* operators, as in chan_calc_con() */
+		if (ams)
+			AM = blk->lfa[n] << (ams-1);
+		for (k=0; k<4; k++)
+			env[k] = tl[k] + ((UINT32)volume[k]) + (AM & AMmask[k]);
+
+		if (CON <= 2 || CON == 5)
+			m2 = mem_value;
+		else if (CON == 3)
+			c2 = mem_value;
+		else
+			mem = mem_value;
+
+		{
+			INT32 fb = fb_out_prev + fb_out_curr;
+			fb_out_prev = fb_out_curr;
+
+			switch (CON)
+			{
+			case 0: case 3: case 4: case 6: c1  = fb_out_prev; break;
+			case 1:                         mem = fb_out_prev; break;
+			case 2:                         c2  = fb_out_prev; break;
+			case 5:       mem = c1 = c2 = fb_out_prev; break;
+			case 7:                         out = fb_out_prev; break;
+			}
+
+			fb_out_curr = 0;
+			if (env[0] < ENV_QUIET)
+			{
+				if (!fb_shift)
+					fb=0;
+				fb_out_curr = phase_calc1(phase[0], env[0], (fb<<fb_shift) );
+			}
+		}
+
+		if (env[1] < ENV_QUIET)     /* M2 */
+		{
+			if (CON >= 5)
+				out += phase_calc(phase[1], env[1], m2);
+			else
+				c2  += phase_calc(phase[1], env[1], m2);
+		}
+
+		if (env[2] < ENV_QUIET)     /* C1 */
+		{
+			if (CON >= 4)
+				out += phase_calc(phase[2], env[2], c1);
+			else
+				mem += phase_calc(phase[2], env[2], c1);
+		}
+
+		if (NOISE)                  /* C2 */
+		{
+			INT32 noiseout;
+
+			noiseout = 0;
+			if (env[3] < 0x3ff)
+				noiseout = (env[3] ^ 0x3ff) * 2;
+			out += blk->noise[n] ? noiseout: -noiseout;
+		}
+		else
+		{
+			if (env[3] < ENV_QUIET)
+				out += phase_calc(phase[3], env[3], c2);
+		}
+
+		chanout[n] = out;
+		mem_value = mem;
+
+		/* went quiet: stop here, like CALC_CHANNEL() does */
+		if (state[0] == EG_OFF && state[1] == EG_OFF && state[2] == EG_OFF && state[3] == EG_OFF &&
+			fb_out_prev == 0 && fb_out_curr == 0 && mem_value == 0)
+		{
+			PSG->active_channels &= ~(1 << chan);
+			for (n++; n<length; n++)
+				chanout[n] = 0;
+			break;
+		}
+
+		/* phase generator, as in advance() */
+		if (pms)
+		{
+			INT32 mod_ind = blk->lfp[n];
+			if (pms < 6)
+				mod_ind >>= (6 - pms);
+			else
+				mod_ind <<= (pms - 5);
+
+			if (mod_ind)
+			{
+				UINT32 kc_channel = kc_i + mod_ind;
+				for (k=0; k<4; k++)
+					phase[k] += ( (PSG->freq[ kc_channel + dt2[k] ] + dt1[k]) * mul[k] ) >> 1;
+				continue;
+			}
+		}
+		for (k=0; k<4; k++)
+			phase[k] += freq[k];
+	}
+
+	for (k=0; k<4; k++)
+	{
+		op[k].phase  = phase[k];
+		op[k].state  = state[k];
+		op[k].volume = volume[k];
+	}
+	op->fb_out_prev = fb_out_prev;
+	op->fb_out_curr = fb_out_curr;
+	op->mem_value   = mem_value;
+}
+
+typedef void (*chan_calc_block_func)(YM2151 *PSG, unsigned int chan, const YM2151Block *blk, signed int *chanout, int length);
+
+static const chan_calc_block_func chan_calc_block_table[2][8] =
+{
+	{
+		chan_calc_block<0, false>, chan_calc_block<1, false>, chan_calc_block<2, false>, chan_calc_block<3, false>,
+		chan_calc_block<4, false>, chan_calc_block<5, false>, chan_calc_block<6, false>, chan_calc_block<7, false>
+	},
+	{
+		chan_calc_block<0, true>,  chan_calc_block<1, true>,  chan_calc_block<2, true>,  chan_calc_block<3, true>,
+		chan_calc_block<4, true>,  chan_calc_block<5, true>,  chan_calc_block<6, true>,  chan_calc_block<7, true>
+	}
+};
+
+/*  Vector path of ym2151_update_block(): the channels in 'lanes' are rendered
+*   together by a ym2151_simd.cpp kernel. Their envelopes are stepped here
+*   first, as the kernels only take the resulting attenuation per sample.
+*/
+static void chan_calc_simd(YM2151 *PSG, const YM2151Block *blk, UINT32 lanes, int length)
+{
+	YM2151SimdChannels *ch = &PSG->simd;
+	UINT32 still;
+	int c, k, n;
+
+	static_assert(BLOCK_LEN == YM2151_SIMD_BLOCK_LEN && TL_TAB_LEN == YM2151_SIMD_TL_TAB_LEN, "ym2151_simd.h is out of date");
+
+	memset(ch->eg_off, 0xff, length);
+
+	for (c=0; c<8; c++)
+	{
+		YM2151Operator *op = &PSG->oper[c*4];
+		const int con = PSG->connect[c];
+
+		if (!(lanes & (1 << c)))
+			continue;
+
+		ch->fb_shift[c]    = op->fb_shift;
+		ch->fb_out_prev[c] = op->fb_out_prev;
+		ch->fb_out_curr[c] = op->fb_out_curr;
+		ch->mem_value[c]   = op->mem_value;
+
+		/* the routes of set_connect() */
+		ch->mem_to_m2[c]  = (con <= 2 || con == 5) ? ~0 : 0;
+		ch->mem_to_c2[c]  = (con == 3) ? ~0 : 0;
+		ch->mem_to_mem[c] = (con == 4 || con >= 6) ? ~0 : 0;
+		ch->m1_to_c1[c]   = (con == 0 || (con >= 3 && con <= 6)) ? ~0 : 0;
+		ch->m1_to_mem[c]  = (con == 1 || con == 5) ? ~0 : 0;
+		ch->m1_to_c2[c]   = (con == 2 || con == 5) ? ~0 : 0;
+		ch->m1_to_out[c]  = (con == 7) ? ~0 : 0;
+		ch->m2_to_out[c]  = (con >= 5) ? ~0 : 0;
+		ch->c1_to_out[c]  = (con >= 4) ? ~0 : 0;
+
+		for (k=0; k<4; k++)
+		{
+			/* just the envelope fields, so that they stay in registers */
+			struct
+			{
+				UINT32 state, d1l;
+				INT32  volume;
+				UINT8  eg_sh_ar, eg_sel_ar, eg_sh_d1r, eg_sel_d1r, eg_sh_d2r, eg_sel_d2r, eg_sh_rr, eg_sel_rr;
+			} o;
+			const UINT32 tl = op[k].tl, AMmask = op[k].AMmask;
+
+			o.state      = op[k].state;
+			o.d1l        = op[k].d1l;
+			o.volume     = op[k].volume;
+			o.eg_sh_ar   = op[k].eg_sh_ar;
+			o.eg_sel_ar  = op[k].eg_sel_ar;
+			o.eg_sh_d1r  = op[k].eg_sh_d1r;
+			o.eg_sel_d1r = op[k].eg_sel_d1r;
+			o.eg_sh_d2r  = op[k].eg_sh_d2r;
+			o.eg_sel_d2r = op[k].eg_sel_d2r;
+			o.eg_sh_rr   = op[k].eg_sh_rr;
+			o.eg_sel_rr  = op[k].eg_sel_rr;
+
+			ch->phase[k][c] = op[k].phase;
+			ch->freq[k][c]  = op[k].freq;
+
+			for (n=0; n<length; n++)
+			{
+				UINT32 t, AM = 0;
+
+				if (o.state != EG_OFF)
+				{
+					for (t=0; t<blk->eg_ticks[n]; t++)
+						eg_update(&o, blk->eg_cnt[n] - blk->eg_ticks[n] + 1 + t);
+					if (o.state != EG_OFF)
+						ch->eg_off[n] &= ~(1 << c);
+				}
+
+				if (op->ams)
+					AM = blk->lfa[n] << (op->ams-1);
+				ch->env[n][k][c] = tl + ((UINT32)o.volume) + (AM & AMmask);
+			}
+
+			op[k].state  = o.state;
+			op[k].volume = o.volume;
+		}
+	}
+
+	if (PSG->simd_level == YM2151_SIMD_AVX2)
+		still = ym2151_simd_render_avx2(ch, lanes, (int32_t (*)[YM2151_SIMD_BLOCK_LEN])blk->chanout, length, sin_tab, (const int32_t *)tl_tab);
+	else
+		still = ym2151_simd_render_sse2(ch, lanes, (int32_t (*)[YM2151_SIMD_BLOCK_LEN])blk->chanout, length, sin_tab, (const int32_t *)tl_tab);
+
+	for (c=0; c<8; c++)
+	{
+		YM2151Operator *op = &PSG->oper[c*4];
+
+		if (!(lanes & (1 << c)))
+			continue;
+
+		for (k=0; k<4; k++)
+			op[k].phase = ch->phase[k][c];
+		op->fb_out_prev = ch->fb_out_prev[c];
+		op->fb_out_curr = ch->fb_out_curr[c];
+		op->mem_value   = ch->mem_value[c];
+	}
+	PSG->active_channels &= ~(lanes & ~still);
+}
+
+int ym2151_set_simd_level(void *chip, int level)
+{
+	YM2151 *PSG = (YM2151 *)chip;
+	int supported = ym2151_simd_detect();
+
+	PSG->simd_level = (level < supported) ? level : supported;
+	return PSG->simd_level;
+}
+
+void ym2151_update_block(void *chip, SAMP **buffers, int length)
+{
+	YM2151 *PSG = (YM2151 *)chip;
+	YM2151Block blk;
+	chan_calc_block_func calc[8];
+	SAMP *bufL, *bufR;
+	UINT32 active, simd_lanes;
+	int done, len, n, c;
+
+	/* CSM keys operators on from inside the sample loop: leave it to the reference path */
+	if ((PSG->irq_enable & 0x80) || PSG->csm_req)
+	{
+		ym2151_update_one(chip, buffers, length);
+		return;
+	}
+
+	bufL = buffers[0];
+	bufR = buffers[1];
+
+	for (c=0; c<7; c++)
+		calc[c] = chan_calc_block_table[0][PSG->connect[c]];
+	calc[7] = chan_calc_block_table[(PSG->noise & 0x80) ? 1 : 0][PSG->connect[7]];
+
+	advance_timer_b(PSG, length);
+
+	for (done=0; done<length; done+=len, bufL+=len, bufR+=len)
+	{
+		len = length - done;
+		if (len > BLOCK_LEN)
+			len = BLOCK_LEN;
+
+		/* shared state, stepped in the same order as ym2151_update_one() */
+		for (n=0; n<len; n++)
+		{
+			blk.eg_ticks[n] = 0;
+			PSG->eg_timer += PSG->eg_timer_add;
+			while (PSG->eg_timer >= PSG->eg_timer_overflow)
+			{
+				PSG->eg_timer -= PSG->eg_timer_overflow;
+				PSG->eg_cnt++;
+				blk.eg_ticks[n]++;
+			}
+			blk.eg_cnt[n] = PSG->eg_cnt;
+			blk.lfa[n] = PSG->lfa;
+			blk.noise[n] = PSG->noise_rng & 0x10000;
+
+			advance_timer_a(PSG);
+			advance_lfo(PSG);
+			blk.lfp[n] = PSG->lfp;
+		}
+
+		active = PSG->active_channels;
+		if (!active)
+		{
+			memset(bufL, 0, len * sizeof(SAMP));
+			memset(bufR, 0, len * sizeof(SAMP));
+			continue;
+		}
+
+		/* phase modulation and noise are left to the scalar kernels */
+		simd_lanes = 0;
+		if (PSG->simd_level != YM2151_SIMD_NONE)
+		{
+			simd_lanes = active;
+			for (c=0; c<8; c++)
+			{
+				if (PSG->oper[c*4].pms)
+					simd_lanes &= ~(1 << c);
+			}
+			if (PSG->noise & 0x80)
+				simd_lanes &= ~0x80;
+		}
+
+		for (c=0; c<8; c++)
+		{
+			if ((active & ~simd_lanes) & (1 << c))
+				calc[c](PSG, c, &blk, blk.chanout[c], len);
+		}
+		if (simd_lanes)
+			chan_calc_simd(PSG, &blk, simd_lanes, len);
+
+		for (n=0; n<len; n++)
+		{
+			signed int outl = 0, outr = 0;
+
+			for (c=0; c<8; c++)
+			{
+				if (active & (1 << c))
+				{
+					outl += (blk.chanout[c][n] & PSG->pan[c*2]);
+					outr += (blk.chanout[c][n] & PSG->pan[c*2+1]);
+				}
+			}
+
+			outl >>= FINAL_SH;
+			outr >>= FINAL_SH;
+			if (outl > MAXOUT) outl = MAXOUT;
+				else if (outl < MINOUT) outl = MINOUT;
+			if (outr > MAXOUT) outr = MAXOUT;
+				else if (outr < MINOUT) outr = MINOUT;
+			bufL[n] = (SAMP)outl;
+			bufR[n] = (SAMP)outr;
+		}
+	}
+}
+
+/*  Fast forward
+*
+*   ym2151_skip() moves the chip 'length' samples ahead without computing any
+*   output. The envelope counter, LFO, noise generator and timers end where
+*   ym2151_update_one() would leave them. Each operator is stepped only at
+*   the envelope updates of its current state: decay, sustain and release add
+*   a pattern of eg_inc[] that repeats every 8 updates, so whole patterns are
+*   added at once until the state's end level comes near. Phases advance by
+*   freq * length, without the LFO phase modulation. Operator outputs,
+*   feedback and the MEM delay are not computed; a channel whose operators
+*   all reach EG_OFF is cleared as if it had drained. The noise register
+*   jumps ahead in closed form too. CSM key on requests are left to the
+*   next update.
+*/
+
+#define SKIP_LFSR_POLY      0x20009     /* x^17 + x^3 + 1 */
+
+/* product of two polynomials over GF(2) of degree < 17, modulo SKIP_LFSR_POLY */
+static UINT32 lfsr_poly_mul(UINT32 a, UINT32 b)
+{
+	UINT32 r = 0;
+
+	while (b)
+	{
+		if (b & 1)
+			r ^= a;
+		b >>= 1;
+		a <<= 1;
+		if (a & 0x20000)
+			a ^= SKIP_LFSR_POLY;
+	}
+	return r;
+}
+
+/*  The noise register shifts in the XNOR of bits 0 and 3, so its complement
+*   is a plain LFSR: s[t+17] = s[t] ^ s[t+3], where bit k of the register is
+*   s[t+k]. With x^shifts = sum c[i] x^i modulo x^17 + x^3 + 1, the register
+*   after 'shifts' shifts is the XOR of the registers after each i < 17 with
+*   c[i] set. Square and multiply keeps this independent of the count. */
+static UINT32 lfsr_jump(UINT32 rng, UINT64 shifts)
+{
+	UINT32 c = 1, x = 2, r = 0, y;
+	int i;
+
+	while (shifts)
+	{
+		if (shifts & 1)
+			c = lfsr_poly_mul(c, x);
+		x = lfsr_poly_mul(x, x);
+		shifts >>= 1;
+	}
+	y = ~rng & 0x1ffff;
+	for (i = 0; i < 17; i++)
+	{
+		if ((c >> i) & 1)
+			r ^= y;
+		y = (((y ^ (y >> 3)) & 1) << 16) | (y >> 1);
+	}
+	return ~r & 0x1ffff;
+}
+
+/* run the envelope generator of 'op' over the counter values cnt+1 .. end */
+static void eg_skip(YM2151Operator *op, UINT64 cnt, UINT64 end)
+{
+	while (op->state != EG_OFF)
+	{
+		unsigned int sh, sel, sum, k;
+		INT32 limit;
+		UINT64 first, updates, cycles;
+
+		switch (op->state)
+		{
+		case EG_ATT:
+			sh = op->eg_sh_ar;  sel = op->eg_sel_ar;  limit = MIN_ATT_INDEX;  break;
+		case EG_DEC:
+			sh = op->eg_sh_d1r; sel = op->eg_sel_d1r; limit = op->d1l;        break;
+		case EG_SUS:
+			sh = op->eg_sh_d2r; sel = op->eg_sel_d2r; limit = MAX_ATT_INDEX;  break;
+		default:
+			sh = op->eg_sh_rr;  sel = op->eg_sel_rr;  limit = MAX_ATT_INDEX;  break;
+		}
+
+		first = ((cnt >> sh) + 1) << sh;    /* next counter value that updates this state */
+		if (first > end)
+			return;
+
+		sum = 0;
+		for (k = 0; k < RATE_STEPS; k++)
+			sum += eg_inc[sel + k];
+
+		if (op->state == EG_ATT)
+		{
+			if (!sum)
+				return;                     /* attack rate 0: the level never moves */
+		}
+		else if (op->volume < limit)
+		{
+			if (!sum)
+				return;
+
+			/* whole patterns that keep the level below the end of the state */
+			updates = ((end - first) >> sh) + 1;
+			cycles = (UINT64)(limit - 1 - op->volume) / sum;
+			if (cycles > updates / RATE_STEPS)
+				cycles = updates / RATE_STEPS;
+			op->volume += (INT32)(cycles * sum);
+			first += (cycles * RATE_STEPS) << sh;
+			if (first > end)
+				return;
+		}
+
+		eg_update(op, (UINT32)first);
+		cnt = first;
+	}
+}
+
+static void skip_timers(YM2151 *PSG, int length)
+{
+#ifdef USE_MAME_TIMERS
+		/* ASG 980324 - handled by real timers now */
+#else
+	INT64 val;
+
+	if (PSG->tim_A)
+	{
+		val = (INT64)PSG->tim_A_val - ((INT64)length << TIMER_SH);
+		if (val <= 0)
+		{
+			INT64 period = PSG->tim_A_tab[ PSG->timer_A_index ];
+			val += period * (-val / period + 1);
+			if (PSG->irq_enable & 0x04)
+			{
+				int oldstate = PSG->status & 3;
+				PSG->status |= 1;
+				if ((!oldstate) && (PSG->irqhandler)) (*PSG->irqhandler)(PSG->device, 1);
+			}
+			if (PSG->irq_enable & 0x80)
+				PSG->csm_req = 2;
+		}
+		PSG->tim_A_val = (INT32)val;
+	}
+	if (PSG->tim_B)
+	{
+		val = (INT64)PSG->tim_B_val - ((INT64)length << TIMER_SH);
+		if (val <= 0)
+		{
+			INT64 period = PSG->tim_B_tab[ PSG->timer_B_index ];
+			val += period * (-val / period + 1);
+			if (PSG->irq_enable & 0x08)
+			{
+				int oldstate = PSG->status & 3;
+				PSG->status |= 2;
+				if ((!oldstate) && (PSG->irqhandler)) (*PSG->irqhandler)(PSG->device, 1);
+			}
+		}
+		PSG->tim_B_val = (INT32)val;
+	}
+#endif
+}
+
+void ym2151_skip(void *chip, int length)
+{
+	YM2151 *PSG = (YM2151 *)chip;
+	YM2151Operator *op;
+	UINT64 t, ticks;
+	int c, n;
+
+	if (length <= 0)
+		return;
+
+	skip_timers(PSG, length);
+
+	/* envelope generator */
+	t = PSG->eg_timer + (UINT64)PSG->eg_timer_add * length;
+	ticks = t / PSG->eg_timer_overflow;
+	PSG->eg_timer = (UINT32)(t % PSG->eg_timer_overflow);
+
+	for (c = 0; c < 8; c++)
+	{
+		if (!(PSG->active_channels & (1 << c)))
+			continue;
+
+		op = &PSG->oper[c*4];
+		for (n = 0; n < 4; n++)
+		{
+			eg_skip(op + n, PSG->eg_cnt, (UINT64)PSG->eg_cnt + ticks);
+			op[n].phase += op[n].freq * (UINT32)length;
+		}
+
+		if (op[0].state == EG_OFF && op[1].state == EG_OFF &&
+			op[2].state == EG_OFF && op[3].state == EG_OFF)
+		{
+			op->fb_out_prev = 0;
+			op->fb_out_curr = 0;
+			op->mem_value = 0;
+			PSG->active_channels &= ~(1 << c);
+		}
+	}
+	PSG->eg_cnt += (UINT32)ticks;
+
+	/* LFO: at most one step per sample, the phase takes the carries of the counter */
+	if (PSG->test&2)
+		PSG->lfo_phase = 0;
+	else
+	{
+		UINT64 add = PSG->lfo_timer_add, overflow = PSG->lfo_overflow;
+
+		t = PSG->lfo_timer;
+		if (add >= overflow)
+		{
+			/* a step on every sample */
+			ticks = length;
+			t += (add - overflow) * length;
+		}
+		else
+		{
+			ticks = 0;
+			if (t + add >= overflow)
+			{
+				/* the timer is past a lowered overflow: one step per sample until it is below */
+				ticks = (t + add - overflow) / (overflow - add) + 1;
+				if (ticks > (UINT64)length)
+					ticks = length;
+				t -= (overflow - add) * ticks;
+			}
+			if (ticks < (UINT64)length)
+			{
+				t += add * (length - ticks);
+				ticks += t / overflow;
+				t %= overflow;
+			}
+		}
+		PSG->lfo_timer = (UINT32)t;
+		t = PSG->lfo_counter + ticks * PSG->lfo_counter_add;
+		PSG->lfo_phase = (UINT32)((PSG->lfo_phase + (t >> 4)) & 255);
+		PSG->lfo_counter = (UINT32)(t & 15);
+	}
+	lfo_output(PSG);
+
+	/* noise generator */
+	t = PSG->noise_p + (UINT64)PSG->noise_f * length;
+	PSG->noise_rng = lfsr_jump(PSG->noise_rng, t >> 16);
+	PSG->noise_p = (UINT32)(t & 0xffff);
+}
+
 void ym2151_set_irq_handler(void *chip, void(*handler)(device_t *device, int irq))
 {
 	YM2151 *PSG = (YM2151 *)chip;
@@ -48,7 +48,13 @@ typedef int64_t INT64;
 
 typedef uintptr_t offs_t;
 
+#if defined(_MSC_VER)
 #define INLINE __forceinline
+#elif defined(__GNUC__) || defined(__clang__)
+#define INLINE inline __attribute__((always_inline))
+#else
+#define INLINE inline
+#endif
 
 /* 16- and 8-bit samples (signed) are supported*/
 #define SAMPLE_BITS 16
@@ -90,12 +96,53 @@ void ym2151_reset_chip(void *chip);
 */
 void ym2151_update_one(void *chip, SAMP **buffers, int length);
 
+/*
+** Same output as ym2151_update_one(), rendered channel by channel over
+** blocks of samples. Faster for long buffers.
+*/
+void ym2151_update_block(void *chip, SAMP **buffers, int length);
+
+/*
+** Select the vector kernel used by ym2151_update_block(): 0 - scalar,
+** 1 - SSE2, 2 - AVX2. The chip starts with AVX2 where the CPU supports it
+** and with the scalar kernels otherwise; requests above what the CPU
+** supports are lowered to it. Returns the kernel now in use.
+*/
+int ym2151_set_simd_level(void *chip, int level);
+
+/*
+** Advance the chip by 'length' samples without generating output: the
+** envelopes, LFO, noise and timers are stepped ahead in closed form. For
+** seeking; phases ignore the LFO phase modulation over the skipped span.
+*/
+void ym2151_skip(void *chip, int length);
+
 /* write 'v' to register 'r' on YM2151 chip number 'n'*/
 void ym2151_write_reg(void *chip, int r, int v);
 
 /* read status register on YM2151 chip number 'n'*/
 int ym2151_read_status(void *chip);
 
+/*
+** Fill 'digest' with one byte per operator, in register order (operator
+** n is channel n/4, slot M1, M2, C1, C2 for n%4 = 0..3): a hash of its
+** phase, envelope and key state. For regression tools comparing renders.
+*/
+void ym2151_get_operator_digest(void *chip, UINT8 *digest);
+
+/*
+** Write a snapshot of the chip state to 'buf' for ym2151_load_state(), if
+** 'size' is large enough for it. Returns the snapshot size in bytes.
+*/
+UINT32 ym2151_save_state(void *chip, UINT8 *buf, UINT32 size);
+
+/*
+** Restore a ym2151_save_state() snapshot of a chip with the same clock and
+** sample rate. Returns 0, or -1 leaving the chip as it was if the snapshot
+** does not match.
+*/
+int ym2151_load_state(void *chip, const UINT8 *buf, UINT32 size);
+
 /* set interrupt handler on YM2151 chip number 'n'*/
 void ym2151_set_irq_handler(void *chip, void (*handler)(device_t *device, int irq));
 
@@ -0,0 +1,314 @@
+// license:GPL-2.0+
+/*****************************************************************************
+*
+*   Vectorized YM2151 operator kernels (SSE2 and AVX2)
+*
+*   Each kernel is a transcription of chan_calc_block() in ym2151.cpp with
+*   the 8 channels in the lanes of a vector. The per-channel connection is
+*   applied with lane masks, and the sin_tab/tl_tab lookups are gathers.
+*   All arithmetic is 32-bit integer, so the samples are bit-identical.
+*
+******************************************************************************/
+
+#include "ym2151_simd.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define YM2151_SIMD_X86 1
+#else
+#define YM2151_SIMD_X86 0
+#endif
+
+#if YM2151_SIMD_X86
+
+#include <emmintrin.h>
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/* GCC and Clang only allow AVX2 intrinsics in functions built for AVX2 */
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+#define FREQ_SH     16
+#define FREQ_MASK   ((1<<FREQ_SH)-1)
+#define SIN_MASK    (1024-1)
+
+int ym2151_simd_detect(void)
+{
+#if defined(_MSC_VER)
+	int r[4];
+	int max_leaf;
+
+	__cpuid(r, 0);
+	max_leaf = r[0];
+	__cpuid(r, 1);
+	if (!(r[3] & (1 << 26)))    /* SSE2 */
+		return YM2151_SIMD_NONE;
+
+	/* AVX2 also needs the OS to save the YMM registers (OSXSAVE, XCR0 bits 1-2) */
+	if (max_leaf >= 7 && (r[2] & (1 << 27)) && (r[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6)
+	{
+		__cpuidex(r, 7, 0);
+		if (r[1] & (1 << 5))
+			return YM2151_SIMD_AVX2;
+	}
+	return YM2151_SIMD_SSE2;
+#else
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return YM2151_SIMD_AVX2;
+	if (__builtin_cpu_supports("sse2"))
+		return YM2151_SIMD_SSE2;
+	return YM2151_SIMD_NONE;
+#endif
+}
+
+
+/*
+*   SSE2: two halves of 4 channels. SSE2 has no gather and no per-lane
+*   shift, so those go through memory.
+*/
+
+static inline __m128i load4(const int32_t *p)
+{
+	return _mm_loadu_si128((const __m128i *)p);
+}
+
+static inline __m128i gather4(const int32_t *tab, __m128i idx)
+{
+	int32_t i[4];
+
+	_mm_storeu_si128((__m128i *)i, idx);
+	return _mm_set_epi32(tab[i[3]], tab[i[2]], tab[i[1]], tab[i[0]]);
+}
+
+/* op_calc()/op_calc1() on 4 lanes, 'pm' already scaled; zero where env >= ENV_QUIET */
+static inline __m128i op_calc4(__m128i phase, __m128i env, __m128i pm, const uint32_t *sin_tab, const int32_t *tl_tab)
+{
+	__m128i i, p, valid;
+
+	i = _mm_add_epi32(_mm_and_si128(phase, _mm_set1_epi32(~FREQ_MASK)), pm);
+	i = _mm_and_si128(_mm_srli_epi32(i, FREQ_SH), _mm_set1_epi32(SIN_MASK));
+	p = _mm_add_epi32(_mm_slli_epi32(env, 3), gather4((const int32_t *)sin_tab, i));
+
+	valid = _mm_and_si128(_mm_cmplt_epi32(p, _mm_set1_epi32(YM2151_SIMD_TL_TAB_LEN)),
+							_mm_cmplt_epi32(env, _mm_set1_epi32(YM2151_SIMD_ENV_QUIET)));
+	return _mm_and_si128(gather4(tl_tab, _mm_and_si128(p, valid)), valid);
+}
+
+uint32_t ym2151_simd_render_sse2(YM2151SimdChannels *ch, uint32_t lanes, int32_t (*chanout)[YM2151_SIMD_BLOCK_LEN], int length,
+									const uint32_t *sin_tab, const int32_t *tl_tab)
+{
+	const __m128i lane_bits = _mm_set_epi32(8, 4, 2, 1);
+	const uint32_t rendered = lanes;
+	int n, h, c, k;
+
+	for (n=0; n<length; n++)
+	{
+		uint32_t quiet = 0;
+
+		for (h=0; h<8; h+=4)
+		{
+			__m128i m2, c1, c2, mem, out, fb, prev, curr, v, mv, to;
+			int32_t f[4];
+
+			mv  = load4(&ch->mem_value[h]);
+			m2  = _mm_and_si128(mv, load4(&ch->mem_to_m2[h]));
+			c2  = _mm_and_si128(mv, load4(&ch->mem_to_c2[h]));
+			mem = _mm_and_si128(mv, load4(&ch->mem_to_mem[h]));
+
+			/* M1 */
+			prev = load4(&ch->fb_out_prev[h]);
+			curr = load4(&ch->fb_out_curr[h]);
+			fb   = _mm_add_epi32(prev, curr);
+			prev = curr;
+
+			c1  = _mm_and_si128(prev, load4(&ch->m1_to_c1[h]));
+			mem = _mm_add_epi32(mem, _mm_and_si128(prev, load4(&ch->m1_to_mem[h])));
+			c2  = _mm_add_epi32(c2, _mm_and_si128(prev, load4(&ch->m1_to_c2[h])));
+			out = _mm_and_si128(prev, load4(&ch->m1_to_out[h]));
+
+			_mm_storeu_si128((__m128i *)f, fb);
+			for (c=0; c<4; c++)
+				f[c] = ch->fb_shift[h+c] ? f[c] << ch->fb_shift[h+c] : 0;
+			curr = op_calc4(load4(ch->phase[0] + h), load4(&ch->env[n][0][h]), load4(f), sin_tab, tl_tab);
+
+			/* M2 */
+			v  = op_calc4(load4(ch->phase[1] + h), load4(&ch->env[n][1][h]), _mm_slli_epi32(m2, 15), sin_tab, tl_tab);
+			to = load4(&ch->m2_to_out[h]);
+			out = _mm_add_epi32(out, _mm_and_si128(v, to));
+			c2  = _mm_add_epi32(c2, _mm_andnot_si128(to, v));
+
+			/* C1 */
+			v  = op_calc4(load4(ch->phase[2] + h), load4(&ch->env[n][2][h]), _mm_slli_epi32(c1, 15), sin_tab, tl_tab);
+			to = load4(&ch->c1_to_out[h]);
+			out = _mm_add_epi32(out, _mm_and_si128(v, to));
+			mem = _mm_add_epi32(mem, _mm_andnot_si128(to, v));
+
+			/* C2 */
+			v  = op_calc4(load4(ch->phase[3] + h), load4(&ch->env[n][3][h]), _mm_slli_epi32(c2, 15), sin_tab, tl_tab);
+			out = _mm_add_epi32(out, v);
+
+			_mm_storeu_si128((__m128i *)&ch->fb_out_prev[h], prev);
+			_mm_storeu_si128((__m128i *)&ch->fb_out_curr[h], curr);
+			_mm_storeu_si128((__m128i *)&ch->mem_value[h], mem);
+
+			_mm_storeu_si128((__m128i *)f, out);
+			for (c=0; c<4; c++)
+				if (rendered & (1 << (h+c)))
+					chanout[h+c][n] = f[c];
+
+			v = _mm_or_si128(_mm_or_si128(prev, curr), mem);
+			quiet |= _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, _mm_setzero_si128()))) << h;
+		}
+
+		/* a channel that went quiet keeps its phase, as in CALC_CHANNEL() */
+		lanes &= ~(quiet & ch->eg_off[n]);
+
+		for (h=0; h<8; h+=4)
+		{
+			__m128i active = _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(lanes >> h), lane_bits), lane_bits);
+			for (k=0; k<4; k++)
+			{
+				__m128i *phase = (__m128i *)(ch->phase[k] + h);
+				_mm_storeu_si128(phase, _mm_add_epi32(_mm_loadu_si128(phase), _mm_and_si128(load4(ch->freq[k] + h), active)));
+			}
+		}
+	}
+
+	return lanes;
+}
+
+
+/*
+*   AVX2: all 8 channels in one register.
+*/
+
+TARGET_AVX2
+static inline __m256i load8(const int32_t *p)
+{
+	return _mm256_loadu_si256((const __m256i *)p);
+}
+
+TARGET_AVX2
+static inline __m256i op_calc8(__m256i phase, __m256i env, __m256i pm, const uint32_t *sin_tab, const int32_t *tl_tab)
+{
+	__m256i i, p, valid;
+
+	i = _mm256_add_epi32(_mm256_and_si256(phase, _mm256_set1_epi32(~FREQ_MASK)), pm);
+	i = _mm256_and_si256(_mm256_srli_epi32(i, FREQ_SH), _mm256_set1_epi32(SIN_MASK));
+	p = _mm256_add_epi32(_mm256_slli_epi32(env, 3), _mm256_i32gather_epi32((const int *)sin_tab, i, 4));
+
+	valid = _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_set1_epi32(YM2151_SIMD_TL_TAB_LEN), p),
+								_mm256_cmpgt_epi32(_mm256_set1_epi32(YM2151_SIMD_ENV_QUIET), env));
+	return _mm256_and_si256(_mm256_i32gather_epi32((const int *)tl_tab, _mm256_and_si256(p, valid), 4), valid);
+}
+
+TARGET_AVX2
+uint32_t ym2151_simd_render_avx2(YM2151SimdChannels *ch, uint32_t lanes, int32_t (*chanout)[YM2151_SIMD_BLOCK_LEN], int length,
+									const uint32_t *sin_tab, const int32_t *tl_tab)
+{
+	const __m256i lane_bits = _mm256_set_epi32(128, 64, 32, 16, 8, 4, 2, 1);
+	const __m256i fb_shift = load8(ch->fb_shift);
+	const __m256i fb_on = _mm256_xor_si256(_mm256_cmpeq_epi32(fb_shift, _mm256_setzero_si256()), _mm256_set1_epi32(-1));
+	const __m256i mem_to_m2 = load8(ch->mem_to_m2), mem_to_c2 = load8(ch->mem_to_c2), mem_to_mem = load8(ch->mem_to_mem);
+	const __m256i m1_to_c1 = load8(ch->m1_to_c1), m1_to_mem = load8(ch->m1_to_mem), m1_to_c2 = load8(ch->m1_to_c2);
+	const __m256i m1_to_out = load8(ch->m1_to_out), m2_to_out = load8(ch->m2_to_out), c1_to_out = load8(ch->c1_to_out);
+	const uint32_t rendered = lanes;
+	__m256i phase[4], freq[4];
+	__m256i prev = load8(ch->fb_out_prev), curr = load8(ch->fb_out_curr), mv = load8(ch->mem_value);
+	int n, k, c;
+
+	for (k=0; k<4; k++)
+	{
+		phase[k] = load8(ch->phase[k]);
+		freq[k]  = load8(ch->freq[k]);
+	}
+
+	for (n=0; n<length; n++)
+	{
+		__m256i m2, c1, c2, mem, out, fb, v, active;
+		int32_t o[8];
+		uint32_t quiet;
+
+		m2  = _mm256_and_si256(mv, mem_to_m2);
+		c2  = _mm256_and_si256(mv, mem_to_c2);
+		mem = _mm256_and_si256(mv, mem_to_mem);
+
+		/* M1 */
+		fb   = _mm256_add_epi32(prev, curr);
+		prev = curr;
+
+		c1  = _mm256_and_si256(prev, m1_to_c1);
+		mem = _mm256_add_epi32(mem, _mm256_and_si256(prev, m1_to_mem));
+		c2  = _mm256_add_epi32(c2, _mm256_and_si256(prev, m1_to_c2));
+		out = _mm256_and_si256(prev, m1_to_out);
+
+		curr = op_calc8(phase[0], load8(ch->env[n][0]), _mm256_and_si256(_mm256_sllv_epi32(fb, fb_shift), fb_on), sin_tab, tl_tab);
+
+		/* M2 */
+		v   = op_calc8(phase[1], load8(ch->env[n][1]), _mm256_slli_epi32(m2, 15), sin_tab, tl_tab);
+		out = _mm256_add_epi32(out, _mm256_and_si256(v, m2_to_out));
+		c2  = _mm256_add_epi32(c2, _mm256_andnot_si256(m2_to_out, v));
+
+		/* C1 */
+		v   = op_calc8(phase[2], load8(ch->env[n][2]), _mm256_slli_epi32(c1, 15), sin_tab, tl_tab);
+		out = _mm256_add_epi32(out, _mm256_and_si256(v, c1_to_out));
+		mem = _mm256_add_epi32(mem, _mm256_andnot_si256(c1_to_out, v));
+
+		/* C2 */
+		v   = op_calc8(phase[3], load8(ch->env[n][3]), _mm256_slli_epi32(c2, 15), sin_tab, tl_tab);
+		out = _mm256_add_epi32(out, v);
+
+		mv = mem;
+
+		_mm256_storeu_si256((__m256i *)o, out);
+		for (c=0; c<8; c++)
+			if (rendered & (1 << c))
+				chanout[c][n] = o[c];
+
+		/* a channel that went quiet keeps its phase, as in CALC_CHANNEL() */
+		v = _mm256_or_si256(_mm256_or_si256(prev, curr), mem);
+		quiet = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v, _mm256_setzero_si256())));
+		lanes &= ~(quiet & ch->eg_off[n]);
+
+		active = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(lanes), lane_bits), lane_bits);
+		for (k=0; k<4; k++)
+			phase[k] = _mm256_add_epi32(phase[k], _mm256_and_si256(freq[k], active));
+	}
+
+	for (k=0; k<4; k++)
+		_mm256_storeu_si256((__m256i *)ch->phase[k], phase[k]);
+	_mm256_storeu_si256((__m256i *)ch->fb_out_prev, prev);
+	_mm256_storeu_si256((__m256i *)ch->fb_out_curr, curr);
+	_mm256_storeu_si256((__m256i *)ch->mem_value, mv);
+
+	return lanes;
+}
+
+#else
+
+/* no vector kernels on this architecture: ym2151_update_block() always takes the scalar path */
+
+int ym2151_simd_detect(void)
+{
+	return YM2151_SIMD_NONE;
+}
+
+uint32_t ym2151_simd_render_sse2(YM2151SimdChannels *, uint32_t lanes, int32_t (*)[YM2151_SIMD_BLOCK_LEN], int,
+									const uint32_t *, const int32_t *)
+{
+	return lanes;
+}
+
+uint32_t ym2151_simd_render_avx2(YM2151SimdChannels *, uint32_t lanes, int32_t (*)[YM2151_SIMD_BLOCK_LEN], int,
+									const uint32_t *, const int32_t *)
+{
+	return lanes;
+}
+
+#endif
@@ -0,0 +1,66 @@
+// license:GPL-2.0+
+/*
+** File: ym2151_simd.h - vectorized operator kernels for ym2151_update_block()
+**
+** The kernels evaluate the same operator of all 8 channels at once: lane c
+** of every vector holds channel c. The envelope generator is stepped by the
+** caller, which passes in the total attenuation of every operator for every
+** sample of the block. The output is bit-identical to chan_calc_block().
+*/
+
+#pragma once
+
+#ifndef __YM2151_SIMD_H__
+#define __YM2151_SIMD_H__
+
+#include <stdint.h>
+
+#define YM2151_SIMD_NONE        0
+#define YM2151_SIMD_SSE2        1
+#define YM2151_SIMD_AVX2        2
+
+/* must match ym2151.cpp */
+#define YM2151_SIMD_BLOCK_LEN   256
+#define YM2151_SIMD_TL_TAB_LEN  (13*2*256)
+#define YM2151_SIMD_ENV_QUIET   (YM2151_SIMD_TL_TAB_LEN>>3)
+
+/* state of the 8 channels for one block; operator index k is M1, M2, C1, C2 */
+struct YM2151SimdChannels
+{
+	int32_t phase[4][8];
+	int32_t freq[4][8];
+
+	int32_t fb_shift[8];            /* 0 when feedback is off */
+	int32_t fb_out_prev[8];
+	int32_t fb_out_curr[8];
+	int32_t mem_value[8];
+
+	/* connection routing, all bits set where the path exists (see set_connect()) */
+	int32_t mem_to_m2[8];
+	int32_t mem_to_c2[8];
+	int32_t mem_to_mem[8];
+	int32_t m1_to_c1[8];
+	int32_t m1_to_mem[8];
+	int32_t m1_to_c2[8];
+	int32_t m1_to_out[8];
+	int32_t m2_to_out[8];           /* otherwise to c2 */
+	int32_t c1_to_out[8];           /* otherwise to mem */
+
+	int32_t env[YM2151_SIMD_BLOCK_LEN][4][8];   /* tl + volume + AM of each operator at sample n */
+	uint8_t eg_off[YM2151_SIMD_BLOCK_LEN];      /* channels with all four operators in EG_OFF at sample n */
+};
+
+/* best kernel supported by the CPU and the OS */
+int ym2151_simd_detect(void);
+
+/*
+** Render 'length' samples of the channels set in 'lanes' into chanout[c][n].
+** A channel that goes quiet stops there, as in ym2151_update_one().
+** Returns the channels of 'lanes' that are still active.
+*/
+uint32_t ym2151_simd_render_sse2(YM2151SimdChannels *ch, uint32_t lanes, int32_t (*chanout)[YM2151_SIMD_BLOCK_LEN], int length,
+									const uint32_t *sin_tab, const int32_t *tl_tab);
+uint32_t ym2151_simd_render_avx2(YM2151SimdChannels *ch, uint32_t lanes, int32_t (*chanout)[YM2151_SIMD_BLOCK_LEN], int length,
+									const uint32_t *sin_tab, const int32_t *tl_tab);
+
+#endif /*__YM2151_SIMD_H__*/
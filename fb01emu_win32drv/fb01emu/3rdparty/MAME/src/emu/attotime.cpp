@@ -12,7 +12,7 @@
 #include <string.h>
 #include <stdint.h>
 #include <stdio.h>
-#include "eivcx86.h"
+#include "eminline.h"
 #include "attotime.h"
 
 
@@ -40,7 +40,7 @@
 #include <math.h>
 #undef min
 #undef max
-#include "eivcx86.h"
+#include "eminline.h"
 
 typedef uint8_t UINT8;
 typedef int8_t INT8;
@@ -0,0 +1,82 @@
+// license:BSD-3-Clause
+// copyright-holders:Aaron Giles
+//============================================================
+//
+//  eminline.h
+//
+//  Definitions for inline functions that can be overridden
+//  by OSD-specific code.
+//
+//============================================================
+
+#ifndef __EMINLINE__
+#define __EMINLINE__
+
+#include <stdint.h>
+
+// the MSVC inline assembly is only available for 32-bit x86
+#if defined(_MSC_VER) && defined(_M_IX86) && !defined(PTR64)
+#include "eivcx86.h"
+#endif
+
+
+/***************************************************************************
+    INLINE MATH FUNCTIONS
+***************************************************************************/
+
+/*-------------------------------------------------
+    mul_32x32 - perform a signed 32 bit x 32 bit
+    multiply and return the full 64 bit result
+-------------------------------------------------*/
+
+#ifndef mul_32x32
+static inline int64_t mul_32x32(int32_t a, int32_t b)
+{
+	return (int64_t)a * (int64_t)b;
+}
+#endif
+
+
+/*-------------------------------------------------
+    mulu_32x32 - perform an unsigned 32 bit x
+    32 bit multiply and return the full 64 bit
+    result
+-------------------------------------------------*/
+
+#ifndef mulu_32x32
+static inline uint64_t mulu_32x32(uint32_t a, uint32_t b)
+{
+	return (uint64_t)a * (uint64_t)b;
+}
+#endif
+
+
+/*-------------------------------------------------
+    divu_64x32 - perform an unsigned 64 bit x 32
+    bit divide and return the 32 bit quotient
+-------------------------------------------------*/
+
+#ifndef divu_64x32
+static inline uint32_t divu_64x32(uint64_t a, uint32_t b)
+{
+	return a / (uint64_t)b;
+}
+#endif
+
+
+/*-------------------------------------------------
+    divu_64x32_rem - perform an unsigned 64 bit x
+    32 bit divide and return the 32 bit quotient
+    and 32 bit remainder
+-------------------------------------------------*/
+
+#ifndef divu_64x32_rem
+static inline uint32_t divu_64x32_rem(uint64_t a, uint32_t b, uint32_t *remainder)
+{
+	uint32_t res = divu_64x32(a, b);
+	*remainder = a - ((uint64_t)b * res);
+	return res;
+}
+#endif
+
+#endif /* __EMINLINE__ */
@@ -31,7 +31,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 //#include <signal.h>
+#ifdef _WIN32
 #include <io.h>
+#endif
 
 #ifdef STDC_HEADERS
 # include <string.h>
@@ -77,41 +79,20 @@
 
 #include "vfb01.h"
 #include "pcm8.h"
+#include "vfb_device.h"
 #include "ym2151.h"
+#include "vfb_vgm.h"
 
-/* ------------------------------------------------------------------ */
-
-#define ENABLE_BUFFERED_PCM 1
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# include <emmintrin.h>
+# define PCM8_SSE2 1
+#else
+# define PCM8_SSE2 0
+#endif
 
 /* ------------------------------------------------------------------ */
-/* local valiables */
-
-static VFB_DATA *evfb=NULL;
 
-static int pcm8_opened           = FLAG_FALSE;
-static int pcm8_interrupt_active = FLAG_FALSE;
-
-static int master_volume         = 0;
-
-static int is_encoding_16bit     = FLAG_TRUE;
-static int is_encoding_stereo    = FLAG_TRUE; 
-static int dsp_speed             = PCM8_MASTER_PCM_RATE;
-
-static SAMP *ym2151_voice[2];
-static int   ym2151_pan[VFB_MAX_CHANNEL_NUMBER];
-
-static unsigned char riff[]={
-  'R','I','F','F',
-  0xff,0xff,0xff,0xff,
-  'W','A','V','E','f','m','t',' ',
-  16,0,0,0, 1,0, 2,0,
-  PCM8_MASTER_PCM_RATE%256,PCM8_MASTER_PCM_RATE/256,0,0,
-  (PCM8_MASTER_PCM_RATE*4)%256,((PCM8_MASTER_PCM_RATE*4)/256)%256,
-  ((PCM8_MASTER_PCM_RATE*4)/65536)%256,0,
-  4,0, 16,0,
-  'd','a','t','a',
-  0,0,0,0
-};
+#define ENABLE_BUFFERED_PCM 1
 
 /* ------------------------------------------------------------------ */
 
@@ -119,145 +100,297 @@ int pcm8_open( VFB_DATA *vfb, int sample_buffer_size ) {
   int i,j;
   void *buf;
 
-  if ( pcm8_opened == FLAG_TRUE ) return 0;
-  evfb = vfb;
+  if ( vfb->pcm8_opened == FLAG_TRUE ) return 0;
 
   buf = (SAMP *)malloc( sizeof(SAMP) * sample_buffer_size * 2 );
   if ( buf == NULL ) return 1;
 
 	 for ( i=0 ; i<2 ; i++ ) {
-		ym2151_voice[i] = (SAMP *)((uintptr_t)buf + sizeof(SAMP)*sample_buffer_size*i);
+		vfb->ym2151_voice[i] = (SAMP *)((uintptr_t)buf + sizeof(SAMP)*sample_buffer_size*i);
 	}
 
 	// TODO
-	for (j = 0; j<1; j++) {
-		ym2151_pan[j] = 64;
+	for (j = 0; j<VFB_MAX_CHANNEL_NUMBER; j++) {
+		vfb->ym2151_pan[j] = 64;
 	}
 
-  master_volume = evfb->master_volume;
-  if ( master_volume < 0 ) master_volume = 0;
+  vfb->pcm8_master_volume = vfb->master_volume;
+  if ( vfb->pcm8_master_volume < 0 ) vfb->pcm8_master_volume = 0;
+
+  vfb->is_encoding_16bit  = FLAG_TRUE;
+  vfb->is_encoding_stereo = FLAG_TRUE;
 
-  pcm8_opened   = FLAG_TRUE;
-  evfb->dsp_speed = dsp_speed;
+  vfb->pcm8_interrupt_active = FLAG_FALSE;
+  vfb->pcm8_opened = FLAG_TRUE;
+  vfb->dsp_speed   = PCM8_MASTER_PCM_RATE;
 
   return 0;
 }
 
-int pcm8_close( void ) {
-	int i;
+int pcm8_close( VFB_DATA *vfb ) {
 
-	pcm8_opened = FLAG_FALSE;
+	if ( vfb->pcm8_opened == FLAG_FALSE ) return 0;
+	vfb->pcm8_opened = FLAG_FALSE;
 
-	pcm8_stop();
+	pcm8_stop( vfb );
 
-	free(ym2151_voice[0]);
+	free(vfb->ym2151_voice[0]);
 
-	ym2151_voice[0] = NULL;
-	ym2151_voice[1] = NULL;
+	vfb->ym2151_voice[0] = NULL;
+	vfb->ym2151_voice[1] = NULL;
 
 	return 0;
 }
 
-int pcm8_pan( int ch, int val ) {
+int pcm8_pan( VFB_DATA *vfb, int ch, int val ) {
 
   if ( val < 0 ) val = 0;
   if ( val > 127 ) val = 127;
 
-  ym2151_pan[ch] = val;
+  vfb->ym2151_pan[ch] = val;
 
   return 0;
 }
 
 /* ------------------------------------------------------------------ */
 
-/* PCM8 main function: mixes all of PCM sound and OPM emulator */
+/* Master volume: v * pcm8_master_volume / PCM8_MAX_VOLUME, truncated */
+/* towards zero and clamped to 16 bits. The SSE2 mixer does the same   */
+/* division in fixed point: |n| / 127 == (|n| * PCM8_DIV_MAGIC) >> 37  */
+/* holds for every |n| < 2^30, far above 32768 * 32767.                */
 
-void pcm8( int8_t* sample_buffer, int sample_buffer_size ) {
-  int i, j;
-  int buffer_size=0;
+#if PCM8_MAX_VOLUME != 127
+# error "PCM8_DIV_MAGIC is ceil(2^37 / PCM8_MAX_VOLUME)"
+#endif
+#define PCM8_DIV_MAGIC 1082196485u
+#define PCM8_DIV_SHIFT 37
 
-  /* must I pronounce? */
+static int16_t pcm8_scale( int v, int vol ) {
+  long l;
 
-  if ( pcm8_opened == FLAG_FALSE || sample_buffer == NULL ) return;
+  l = (long)v * vol / PCM8_MAX_VOLUME;
+  if ( l<-32768 ) l=-32768;
+  if ( l> 32767 ) l= 32767;
 
-  /* Execute YM2151 emulator */
+  return (int16_t)l;
+}
 
-	ym2151_update_one( YMPSG, ym2151_voice, sample_buffer_size );
+#if PCM8_SSE2
 
-  /* now pronouncing ! */
+static __m128i pcm8_div4( __m128i n ) {
+  const __m128i magic = _mm_set1_epi32( PCM8_DIV_MAGIC );
+  __m128i sign, a, even, odd;
 
+  sign = _mm_srai_epi32( n, 31 );
+  a    = _mm_sub_epi32( _mm_xor_si128( n, sign ), sign );
 
-	// TODO: This was a mixing routine for multiple YM2151 instances
-	// Make it work correctly for one YM2151 with panning and master volume.
-	// Some things might not have to be here, but part of the YM2151 parameters itself.
-  for ( i=0 ; i<sample_buffer_size ; i++ ) {
-	int v, sv;
-	long l,r, sl,sr;
-	unsigned char l1, l2, r1, r2, v1,v2;
-
-	l = (long)(ym2151_voice[0][i]);// *(127 - ym2151_pan[j]) / 128);
-	  
-	r = (long)(ym2151_voice[1][i]);// * ym2151_pan[j]/128);
-
-	l = l * master_volume / PCM8_MAX_VOLUME;
-	r = r * master_volume / PCM8_MAX_VOLUME;
-
-	if ( l<-32768 ) l=-32768;
-	if ( l> 32767 ) l= 32767;
-	if ( r<-32768 ) r=-32768;
-	if ( r> 32767 ) r= 32767;
-
-	v  = (l+r)/2;  /*   signed short MONO */
-	sl = l+32768;  /* unsigned short L */
-	sr = r+32768;  /* unsigned short R */
-	sv = v+32768;  /* unsigned short MONO */
-	
-	if ( l<0 ) l=0x10000+l;
-	l1 = (unsigned char)(l/256);
-	l2 = (unsigned char)(l%256);
-
-	if ( r<0 ) r=0x10000+r;
-	r1 = (unsigned char)(r/256);
-	r2 = (unsigned char)(r%256);
-
-	if ( v<0 ) v=0x10000+v;
-	v1 = (unsigned char)(v/256);
-	v2 = (unsigned char)(v%256);
-
-	if ( is_encoding_16bit  == FLAG_TRUE &&
-	 is_encoding_stereo == FLAG_TRUE ) {
-	  sample_buffer[i*4+0] = l2;
-	  sample_buffer[i*4+1] = l1;
-	  sample_buffer[i*4+2] = r2;
-	  sample_buffer[i*4+3] = r1;
+  even = _mm_srli_epi64( _mm_mul_epu32( a, magic ), PCM8_DIV_SHIFT );
+  odd  = _mm_srli_epi64( _mm_mul_epu32( _mm_srli_epi64( a, 32 ), magic ), PCM8_DIV_SHIFT );
+  a    = _mm_or_si128( even, _mm_slli_epi64( odd, 32 ) );
+
+  return _mm_sub_epi32( _mm_xor_si128( a, sign ), sign );
+}
+
+/* 8 samples; packs_epi32 does the clamping */
+static __m128i pcm8_scale8( __m128i x, __m128i vol ) {
+  __m128i lo, hi;
+
+  lo = _mm_mullo_epi16( x, vol );
+  hi = _mm_mulhi_epi16( x, vol );
+
+  return _mm_packs_epi32( pcm8_div4( _mm_unpacklo_epi16( lo, hi ) ),
+			  pcm8_div4( _mm_unpackhi_epi16( lo, hi ) ) );
+}
+
+#endif /* PCM8_SSE2 */
+
+/* 16bit stereo: native int16_t, interleaved L/R */
+
+static void pcm8_mix_s16( VFB_DATA *vfb, int16_t *out, int n ) {
+  const int16_t *l = vfb->ym2151_voice[0];
+  const int16_t *r = vfb->ym2151_voice[1];
+  const int vol = vfb->pcm8_master_volume;
+  int i=0;
+
+#if PCM8_SSE2
+  if ( vol <= 32767 ) {
+	const __m128i v = _mm_set1_epi16( (short)vol );
+
+	for ( ; i+8<=n ; i+=8 ) {
+	  __m128i xl = _mm_loadu_si128( (const __m128i *)(l+i) );
+	  __m128i xr = _mm_loadu_si128( (const __m128i *)(r+i) );
+
+	  if ( vol != PCM8_MAX_VOLUME ) {
+		xl = pcm8_scale8( xl, v );
+		xr = pcm8_scale8( xr, v );
+	  }
+	  _mm_storeu_si128( (__m128i *)(out+i*2),   _mm_unpacklo_epi16( xl, xr ) );
+	  _mm_storeu_si128( (__m128i *)(out+i*2+8), _mm_unpackhi_epi16( xl, xr ) );
 	}
-	else if ( is_encoding_16bit  == FLAG_TRUE &&
-		  is_encoding_stereo == FLAG_FALSE ) {
-	  sample_buffer[i*2+0] = v2;
-	  sample_buffer[i*2+1] = v1;
+  }
+#endif
+
+  if ( vol == PCM8_MAX_VOLUME ) {
+	for ( ; i<n ; i++ ) {
+	  out[i*2+0] = l[i];
+	  out[i*2+1] = r[i];
 	}
-	else if ( is_encoding_16bit  == FLAG_FALSE &&
-		  is_encoding_stereo == FLAG_TRUE ) {
-	  sample_buffer[i*2+0] = sl/256;
-	  sample_buffer[i*2+1] = sr/256;
+  }
+  else {
+	for ( ; i<n ; i++ ) {
+	  out[i*2+0] = pcm8_scale( l[i], vol );
+	  out[i*2+1] = pcm8_scale( r[i], vol );
 	}
-	else {
-	  sample_buffer[i] = sv/256;
+  }
+}
+
+/* 32bit float stereo, interleaved L/R, full scale is +-1.0 */
+
+static void pcm8_mix_f32( VFB_DATA *vfb, float *out, int n ) {
+  const int16_t *l = vfb->ym2151_voice[0];
+  const int16_t *r = vfb->ym2151_voice[1];
+  const float gain = (float)vfb->pcm8_master_volume / (PCM8_MAX_VOLUME * 32768.0f);
+  int i=0;
+
+#if PCM8_SSE2
+  {
+	const __m128 g = _mm_set1_ps( gain );
+
+	for ( ; i+4<=n ; i+=4 ) {
+	  __m128i xl = _mm_loadl_epi64( (const __m128i *)(l+i) );
+	  __m128i xr = _mm_loadl_epi64( (const __m128i *)(r+i) );
+	  __m128 fl = _mm_mul_ps( _mm_cvtepi32_ps( _mm_srai_epi32( _mm_unpacklo_epi16( xl, xl ), 16 ) ), g );
+	  __m128 fr = _mm_mul_ps( _mm_cvtepi32_ps( _mm_srai_epi32( _mm_unpacklo_epi16( xr, xr ), 16 ) ), g );
+
+	  _mm_storeu_ps( out+i*2,   _mm_unpacklo_ps( fl, fr ) );
+	  _mm_storeu_ps( out+i*2+4, _mm_unpackhi_ps( fl, fr ) );
+	}
+  }
+#endif
+
+  for ( ; i<n ; i++ ) {
+	out[i*2+0] = l[i] * gain;
+	out[i*2+1] = r[i] * gain;
+  }
+}
+
+/* The legacy encodings: 16bit mono, and unsigned 8bit stereo / mono */
+
+static void pcm8_mix_legacy( VFB_DATA *vfb, int8_t *sample_buffer, int n ) {
+  const int16_t *l = vfb->ym2151_voice[0];
+  const int16_t *r = vfb->ym2151_voice[1];
+  const int vol = vfb->pcm8_master_volume;
+  int i;
+
+  if ( vfb->is_encoding_16bit == FLAG_TRUE ) {
+	int16_t *out = (int16_t *)sample_buffer;
+	for ( i=0 ; i<n ; i++ )
+	  out[i] = (pcm8_scale( l[i], vol ) + pcm8_scale( r[i], vol ))/2;
+  }
+  else if ( vfb->is_encoding_stereo == FLAG_TRUE ) {
+	for ( i=0 ; i<n ; i++ ) {
+	  sample_buffer[i*2+0] = (int8_t)((pcm8_scale( l[i], vol )+32768)/256);
+	  sample_buffer[i*2+1] = (int8_t)((pcm8_scale( r[i], vol )+32768)/256);
 	}
   }
+  else {
+	for ( i=0 ; i<n ; i++ )
+	  sample_buffer[i] = (int8_t)(((pcm8_scale( l[i], vol ) + pcm8_scale( r[i], vol ))/2+32768)/256);
+  }
+}
+
+/* ------------------------------------------------------------------ */
+
+/* Execute YM2151 emulator: renders n frames into ym2151_voice[] */
+
+int pcm8_run_opm( VFB_DATA *vfb, int n ) {
+
+  /* must I pronounce? */
+
+  if ( vfb->pcm8_opened == FLAG_FALSE ) return 1;
+
+	ym2151_flush_writes( vfb );
+	if ( vfb->ym2151_block_render == FLAG_TRUE )
+	  ym2151_update_block( vfb->ym2151, vfb->ym2151_voice, n );
+	else
+	  ym2151_update_one( vfb->ym2151, vfb->ym2151_voice, n );
+	if ( vfb->vgm_recorder != NULL )
+	  vfb_vgm_wait( vfb, n );
+
+  return 0;
+}
+
+/* Moves the YM2151 n frames ahead without rendering, for seeking */
+
+int pcm8_skip( VFB_DATA *vfb, int n ) {
+
+  if ( vfb->pcm8_opened == FLAG_FALSE ) return 1;
+
+	ym2151_flush_writes( vfb );
+	ym2151_skip( vfb->ym2151, n );
+	if ( vfb->vgm_recorder != NULL )
+	  vfb_vgm_wait( vfb, n );
+
+  return 0;
+}
+
+/* Mixes n frames of ym2151_voice[] to the output encoding */
+
+void pcm8_mix( VFB_DATA *vfb, void *sample_buffer, int n ) {
+
+	// TODO: This was a mixing routine for multiple YM2151 instances
+	// Make it work correctly for one YM2151 with panning and master volume.
+  if ( vfb->is_encoding_16bit  == FLAG_TRUE &&
+	   vfb->is_encoding_stereo == FLAG_TRUE )
+	pcm8_mix_s16( vfb, (int16_t *)sample_buffer, n );
+  else
+	pcm8_mix_legacy( vfb, (int8_t *)sample_buffer, n );
+
+  return;
+}
+
+void pcm8_mix_float( VFB_DATA *vfb, float *sample_buffer, int n ) {
+
+  pcm8_mix_f32( vfb, sample_buffer, n );
+
+  return;
+}
+
+/* PCM8 main function: mixes all of PCM sound and OPM emulator */
+
+void pcm8( VFB_DATA *vfb, void *sample_buffer, int sample_buffer_size ) {
+
+  if ( sample_buffer == NULL ) return;
+  if ( pcm8_run_opm( vfb, sample_buffer_size ) ) return;
+
+  /* now pronouncing ! */
+
+  pcm8_mix( vfb, sample_buffer, sample_buffer_size );
+
+  return;
+}
+
+/* Same as pcm8(), always to interleaved stereo float */
+
+void pcm8_float( VFB_DATA *vfb, float *sample_buffer, int sample_buffer_size ) {
+
+  if ( sample_buffer == NULL ) return;
+  if ( pcm8_run_opm( vfb, sample_buffer_size ) ) return;
+
+  pcm8_mix_float( vfb, sample_buffer, sample_buffer_size );
 
   return;
 }
 
 /* ------------------------------------------------------------------ */
 
-void pcm8_start( void ) {
-	pcm8_interrupt_active = FLAG_TRUE;
+void pcm8_start( VFB_DATA *vfb ) {
+	vfb->pcm8_interrupt_active = FLAG_TRUE;
 	return;
 }
 
-void pcm8_stop( void ) {
-	pcm8_interrupt_active=FLAG_FALSE;
+void pcm8_stop( VFB_DATA *vfb ) {
+	vfb->pcm8_interrupt_active=FLAG_FALSE;
 	return;
 }
 
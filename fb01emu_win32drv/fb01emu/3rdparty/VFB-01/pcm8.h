@@ -21,11 +21,21 @@
 /* functions */
 
 extern int  pcm8_open( VFB_DATA *, int );
-extern int  pcm8_close( void );
-extern void pcm8_start( void );
-extern void pcm8_stop( void );
-
-extern void pcm8(int8_t* sample_buffer, int sample_buffer_size);
-extern int pcm8_pan(int ch, int val);
+extern int  pcm8_close( VFB_DATA * );
+extern void pcm8_start( VFB_DATA * );
+extern void pcm8_stop( VFB_DATA * );
+
+/* renders sample_buffer_size frames; 16bit stereo is native int16_t L/R */
+extern void pcm8(VFB_DATA *vfb, void* sample_buffer, int sample_buffer_size);
+extern void pcm8_float(VFB_DATA *vfb, float* sample_buffer, int sample_buffer_size);
+
+/* the two stages of pcm8(), apart for profiling: run_opm renders n frames */
+/* into ym2151_voice[], nonzero if not opened; mix converts them for output */
+extern int  pcm8_run_opm(VFB_DATA *vfb, int n);
+extern void pcm8_mix(VFB_DATA *vfb, void* sample_buffer, int n);
+extern void pcm8_mix_float(VFB_DATA *vfb, float* sample_buffer, int n);
+/* advances the YM2151 n frames without output, nonzero if not opened */
+extern int  pcm8_skip(VFB_DATA *vfb, int n);
+extern int pcm8_pan(VFB_DATA *vfb, int ch, int val);
 
 #endif /* _PCM8_H_ */
@@ -27,6 +27,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 //#include <signal.h>
 
@@ -37,8 +38,6 @@
 //#include <unistd.h>
 #include <sys/stat.h>
 
-#include <Windows.h>
-
 #ifdef _POSIX_PRIORITY_SCHEDULING
 # include <sched.h>
 #endif
@@ -47,9 +46,12 @@
 #endif
 
 #include "vfb01.h"
+#include "vfb_compat.h"
 #include "smf.h"
 #include "pcm8.h"
 #include "vfb_device.h"
+#include "ym2151.h"
+#include "vfb_vgm.h"
 
 /* ------------------------------------------------------------------- */
 
@@ -58,30 +60,20 @@
 
 /* ------------------------------------------------------------------- */
 
-extern uint8_t SendMidiData(uint8_t* pData, uint32_t length);
-
 static int is_on_instrument(VFB_INSTRUMENT* instrument, int ch, int note);
-static int note_off( MidiEvent * );
-static int note_on( MidiEvent * );
-static int key_pressure( MidiEvent * );
-static int program_change( MidiEvent * );
-static int channel_pressure( MidiEvent * );
-static int pitch_wheel( MidiEvent * );
-static int control_change( MidiEvent * );
-static int system_exclusive( MidiEvent * );
+static int note_off( VFB_DATA *, const MidiMessage * );
+static int note_on( VFB_DATA *, const MidiMessage * );
+static int key_pressure( VFB_DATA *, const MidiMessage * );
+static int program_change( VFB_DATA *, const MidiMessage * );
+static int channel_pressure( VFB_DATA *, const MidiMessage * );
+static int pitch_wheel( VFB_DATA *, const MidiMessage * );
+static int control_change( VFB_DATA *, const MidiMessage * );
+static int system_exclusive( VFB_DATA *, const MidiMessage * );
 
 static void priority_init( void );
 
 /* ------------------------------------------------------------------- */
 
-static unsigned char sysex_buf[SYSEX_BUF_SIZE];
-static VFB_DATA *evfb=NULL;
-
-static int rpn_adr[VFB_MAX_CHANNEL_NUMBER];
-static int nrpn_adr[VFB_MAX_CHANNEL_NUMBER];
-
-/* ------------------------------------------------------------------- */
-
 uint8_t checksum(uint8_t* pData, size_t length)
 {
 	uint8_t c = 0;
@@ -93,7 +85,7 @@ uint8_t checksum(uint8_t* pData, size_t length)
 }
 
 // Packet type A has 8-bit data, split up into two 4-bit values (MIDI data can not use the MSB of each byte)
-void encode_packet_type_A(uint8_t* pDest, uint8_t* pSrc, size_t length)
+void encode_packet_type_A(uint8_t* pDest, const uint8_t* pSrc, size_t length)
 {
 	uint8_t c = 0;
 
@@ -124,7 +116,7 @@ void encode_packet_type_A(uint8_t* pDest, uint8_t* pSrc, size_t length)
 }
 
 // Packet type B has 7-bit data
-void encode_packet_type_B(uint8_t* pDest, uint8_t* pSrc, size_t length)
+void encode_packet_type_B(uint8_t* pDest, const uint8_t* pSrc, size_t length)
 {
 	uint8_t c = 0;
 
@@ -147,7 +139,7 @@ void encode_packet_type_B(uint8_t* pDest, uint8_t* pSrc, size_t length)
 }
 
 // Packet type A has 8-bit data, split up into two 4-bit values (MIDI data can not use the MSB of each byte)
-uint8_t decode_packet_type_A(uint8_t* pDest, uint8_t* pSrc, size_t length, size_t* pLength)
+uint8_t decode_packet_type_A(uint8_t* pDest, const uint8_t* pSrc, size_t length, size_t* pLength)
 {
 	uint8_t c = 0;
 	size_t i, len;
@@ -183,7 +175,7 @@ uint8_t decode_packet_type_A(uint8_t* pDest, uint8_t* pSrc, size_t length, size_
 }
 
 // Packet type B has 7-bit data
-uint8_t decode_packet_type_B(uint8_t* pDest, uint8_t* pSrc, size_t length, size_t* pLength)
+uint8_t decode_packet_type_B(uint8_t* pDest, const uint8_t* pSrc, size_t length, size_t* pLength)
 {
 	uint8_t c = 0;
 	size_t i, len;
@@ -220,36 +212,36 @@ int vfb01_init( VFB_DATA *vfb, int sample_buffer_size ) {
 
   int i;
 
-  if ( evfb == NULL && vfb != NULL ) evfb=vfb;
   if ( pcm8_open( vfb, sample_buffer_size ) ) return 1;
 
   if (setup_configuration(vfb))return 1;
+  vfb01_update_routing( vfb );
   if ( setup_voices( vfb ) ) return 1;
   if ( setup_ym2151( vfb ) ) return 1;
 
   //set_signals();
   priority_init();
 
-  pcm8_start();
+  pcm8_start( vfb );
 
   vfb->elapsed_time = 0;
   vfb->total_count = 0;
 
 
   for ( i=0 ; i<VFB_MAX_CHANNEL_NUMBER ; i++ ) {
-	rpn_adr[i]  = 0xffff;
-	nrpn_adr[i] = 0xffff;
+	vfb->rpn_adr[i]  = 0xffff;
+	vfb->nrpn_adr[i] = 0xffff;
   }
 
   return 0;
 }
 
-void convert_voice(VFB_VOICE_DATA* pSrc, int num )
+void convert_voice(VFB_DATA *vfb, VFB_VOICE_DATA* pSrc, int num )
 {
 	VOICE_DATA* v;
 	int i;
 
-	v = &evfb->voice[num];
+	v = &vfb->voice[num];
 
 	// Convert voice data
 	v->voice_number = num;
@@ -293,39 +285,53 @@ void convert_voice(VFB_VOICE_DATA* pSrc, int num )
 
 void vfb01_doMidiEvent( VFB_DATA *vfb, MidiEvent* e ) {
 
+  MidiMessage m;
+
+  m.type   = e->type;
+  m.ch     = e->ch;
+  m.a      = e->a;
+  m.b      = e->b;
+  m.ex_buf = e->ex_buf;
+  m.ex_len = SYSEX_BUF_SIZE;
+
+  vfb01_doMidiMessage( vfb, &m );
+}
+
+void vfb01_doMidiMessage( VFB_DATA *vfb, const MidiMessage* e ) {
+
   int i;
 
 	switch ( e->type ) {
 	case MIDI_NOTEOFF:
-	  note_off( e );
+	  note_off( vfb, e );
 	  break;
 
 	case MIDI_NOTEON:
-	  note_on( e );
+	  note_on( vfb, e );
 	  break;
 
 	case MIDI_PRESSURE:
-	  key_pressure( e );
+	  key_pressure( vfb, e );
 	  break;
 
 	case MIDI_CONTROL:
-	  control_change( e );
+	  control_change( vfb, e );
 	  break;
 
 	case MIDI_PROGRAM:
-	  program_change( e );
+	  program_change( vfb, e );
 	  break;
 
 	case MIDI_CHANPRES:
-	  channel_pressure( e );
+	  channel_pressure( vfb, e );
 	  break;
 
 	case MIDI_PITCHB:
-	  pitch_wheel( e );
+	  pitch_wheel( vfb, e );
 	  break;
 
 	case MIDI_SYSEX:
-	  system_exclusive( e );
+	  system_exclusive( vfb, e );
 	  break;
 
 	default:
@@ -334,7 +340,7 @@ void vfb01_doMidiEvent( VFB_DATA *vfb, MidiEvent* e ) {
 
 	// Update all instruments
 	for (i = 0; i < VFB_MAX_FM_SLOTS; i++)
-		ym2151_set_freq_volume(i);
+		ym2151_set_freq_volume(vfb, i);
 }
 
 #if 0
@@ -363,7 +369,9 @@ int vfb01_close( VFB_DATA *vfb ) {
 
   /* finalize all resources */
 
-	pcm8_close();
+	vfb_vgm_close( vfb );
+	close_ym2151( vfb );
+	pcm8_close( vfb );
 
 #ifdef _POSIX_PRIORITY_SCHEDULING
   sched_yield();
@@ -377,6 +385,103 @@ int vfb01_close( VFB_DATA *vfb ) {
 
 /* ------------------------------------------------------------------- */
 
+/* State snapshots: the configurations and voices, the active          */
+/* configuration, the instrument state, the register shadow and the    */
+/* pending writes, followed by a ym2151_save_state() snapshot. Native  */
+/* byte order. The routing tables are rebuilt from the configuration.  */
+
+#define VFB_STATE_VERSION 2
+
+typedef struct _VFB_STATE_IO {
+  uint8_t *save;          /* buffer written by vfb01_save_state() */
+  const uint8_t *load;    /* buffer read by vfb01_load_state() */
+  uint32_t pos;           /* bytes walked so far */
+} VFB_STATE_IO;
+
+static void state_item( VFB_STATE_IO *io, void *item, uint32_t size ) {
+
+  if ( io->save != NULL )
+	memcpy( io->save + io->pos, item, size );
+  else if ( io->load != NULL )
+	memcpy( item, io->load + io->pos, size );
+  io->pos += size;
+}
+
+#define STATE_ITEM( io, x ) state_item( io, &(x), sizeof(x) )
+
+static void state_items( VFB_DATA *vfb, VFB_STATE_IO *io ) {
+
+  STATE_ITEM( io, vfb->voice );
+  STATE_ITEM( io, vfb->configuration );
+  STATE_ITEM( io, vfb->voice_banks );
+  STATE_ITEM( io, vfb->active_config );
+  STATE_ITEM( io, vfb->rpn_adr );
+  STATE_ITEM( io, vfb->nrpn_adr );
+  STATE_ITEM( io, vfb->instrument_map );
+  STATE_ITEM( io, vfb->ym2151_register_map );
+  STATE_ITEM( io, vfb->ym2151_amd );
+  STATE_ITEM( io, vfb->ym2151_pmd );
+  STATE_ITEM( io, vfb->system_volume );
+  STATE_ITEM( io, vfb->pending_writes );
+  STATE_ITEM( io, vfb->pending_write_count );
+  STATE_ITEM( io, vfb->elided_writes );
+  STATE_ITEM( io, vfb->ym2151_pan );
+}
+
+/* Writes the snapshot to buf if size is large enough for it, returns its size */
+uint32_t vfb01_save_state( VFB_DATA *vfb, uint8_t *buf, uint32_t size ) {
+
+  VFB_STATE_IO io = { NULL, NULL, 0 };
+  uint32_t header[2];   /* version, size of the YM2151 snapshot */
+  uint32_t total;
+
+  header[0] = VFB_STATE_VERSION;
+  header[1] = ym2151_save_state( vfb->ym2151, NULL, 0 );
+  STATE_ITEM( &io, header );
+  state_items( vfb, &io );
+  total = io.pos + header[1];
+  if ( buf == NULL || size < total ) return total;
+
+  io.save = buf;
+  io.pos = 0;
+  STATE_ITEM( &io, header );
+  state_items( vfb, &io );
+  ym2151_save_state( vfb->ym2151, buf + io.pos, header[1] );
+
+  return total;
+}
+
+/* Restores a vfb01_save_state() snapshot. Returns nonzero, changing */
+/* nothing, if it was made by another version or for another chip.   */
+int vfb01_load_state( VFB_DATA *vfb, const uint8_t *buf, uint32_t size ) {
+
+  VFB_STATE_IO io = { NULL, NULL, 0 };
+  uint32_t header[2];
+  uint32_t items;
+
+  STATE_ITEM( &io, header );
+  state_items( vfb, &io );
+  items = io.pos;
+  if ( size < items ) return 1;
+
+  memcpy( header, buf, sizeof(header) );
+  if ( header[0] != VFB_STATE_VERSION || size - items != header[1] ) return 1;
+  if ( ym2151_load_state( vfb->ym2151, buf + items, header[1] ) ) return 1;
+
+  io.load = buf;
+  io.pos = 0;
+  STATE_ITEM( &io, header );
+  state_items( vfb, &io );
+
+  if ( vfb->pending_write_count < 0 || vfb->pending_write_count > VFB_MAX_PENDING_WRITES )
+	vfb->pending_write_count = 0;
+  vfb01_update_routing( vfb );
+
+  return 0;
+}
+
+/* ------------------------------------------------------------------- */
+
 static int is_on_instrument(VFB_INSTRUMENT* instrument, int ch, int note)
 {
 	if (instrument->midi_channel == ch)
@@ -388,48 +493,75 @@ static int is_on_instrument(VFB_INSTRUMENT* instrument, int ch, int note)
 	return 0;
 }
 
-static int note_off( MidiEvent *ev ) {
-	int i;
+/* Precompute which instruments receive each channel and key, so that */
+/* dispatching an event is a table lookup instead of a configuration scan */
+void vfb01_update_routing( VFB_DATA *vfb ) {
+
+  int i, ch, note;
+
+  for ( ch=0 ; ch<VFB_MAX_CHANNEL_NUMBER ; ch++ ) {
+	vfb->channel_route[ch] = 0;
+	for ( note=0 ; note<128 ; note++ )
+	  vfb->key_route[ch][note] = 0;
+
+	for ( i=0 ; i<VFB_MAX_FM_SLOTS ; i++ ) {
+	  if ( vfb->active_config.instruments[i].midi_channel != ch ) continue;
+
+	  vfb->channel_route[ch] |= 1<<i;
+	  for ( note=0 ; note<128 ; note++ ) {
+		if ( is_on_instrument( &vfb->active_config.instruments[i], ch, note ) )
+		  vfb->key_route[ch][note] |= 1<<i;
+	  }
+	}
+  }
+
+  return;
+}
+
+static int note_off( VFB_DATA *vfb, const MidiMessage *ev ) {
+	int i, route;
 #ifdef VFB_DEBUG
   fprintf(stdout, "NOTEOFF:  %02x %02x\n", ev->ch, ev->a);
 #endif
 
-  for (i = 0; i < VFB_MAX_FM_SLOTS; i++)
+  route = vfb->key_route[ev->ch & 0x0f][ev->a & 0x7f];
+  for (i = 0; route != 0; i++, route >>= 1)
   {
-	  if (is_on_instrument( &evfb->active_config.instruments[i], ev->ch, ev->a))
-		ym2151_note_off(i, ev->a);
+	  if (route & 1)
+		ym2151_note_off(vfb, i, ev->a);
   }
 
   return 0;
 }
 
-static int note_on( MidiEvent *ev ) {
-	int i;
+static int note_on( VFB_DATA *vfb, const MidiMessage *ev ) {
+	int i, route;
 #ifdef VFB_DEBUG
   fprintf(stdout, "NOTE_ON:  %02x %02x %02x\n", ev->ch, ev->a, ev->b);
 #endif
 
+  route = vfb->key_route[ev->ch & 0x0f][ev->a & 0x7f];
   if (ev->b > 0)
   {
-	  for (i = 0; i < VFB_MAX_FM_SLOTS; i++)
+	  for (i = 0; route != 0; i++, route >>= 1)
 	  {
-		  if (is_on_instrument(&evfb->active_config.instruments[i], ev->ch, ev->a))
-			  ym2151_note_on(ev->ch, ev->a, ev->b);
+		  if (route & 1)
+			  ym2151_note_on(vfb, i, ev->a, ev->b);
 	  }
   }
   else
   {
-	  for (i = 0; i < VFB_MAX_FM_SLOTS; i++)
+	  for (i = 0; route != 0; i++, route >>= 1)
 	  {
-		  if (is_on_instrument(&evfb->active_config.instruments[i], ev->ch, ev->a))
-			  ym2151_note_off(i, ev->a);
+		  if (route & 1)
+			  ym2151_note_off(vfb, i, ev->a);
 	  }
   }
 
   return 0;
 }
 
-static int key_pressure( MidiEvent *ev ) {
+static int key_pressure( VFB_DATA *vfb, const MidiMessage *ev ) {
 
 #ifdef VFB_DEBUG
   fprintf(stdout, "KEYPRES:  %02x %02x %02x\n", ev->ch, ev->a, ev->b);
@@ -437,23 +569,24 @@ static int key_pressure( MidiEvent *ev ) {
   return 0;
 }
 
-static int program_change( MidiEvent *ev ) {
+static int program_change( VFB_DATA *vfb, const MidiMessage *ev ) {
 
-	int i;
+	int i, route;
 #ifdef VFB_DEBUG
   fprintf(stdout, "PROGCHG:  %02x %02x\n", ev->ch, ev->a);
 #endif
 
-  for (i = 0; i < VFB_MAX_FM_SLOTS; i++)
+  route = vfb->channel_route[ev->ch & 0x0f];
+  for (i = 0; route != 0; i++, route >>= 1)
   {
-	  if (evfb->active_config.instruments[i].midi_channel == ev->ch)
-		  ym2151_set_voice(i, ev->a);
+	  if (route & 1)
+		  ym2151_set_voice(vfb, i, ev->a);
   }
 
   return 0;
 }
 
-static int channel_pressure( MidiEvent *ev ) {
+static int channel_pressure( VFB_DATA *vfb, const MidiMessage *ev ) {
 
 #ifdef VFB_DEBUG
   fprintf(stdout, "CHPRESS:  %02x %02x\n", ev->ch, ev->a);
@@ -461,14 +594,15 @@ static int channel_pressure( MidiEvent *ev ) {
   return 0;
 }
 
-static int pitch_wheel( MidiEvent *ev ) {
+static int pitch_wheel( VFB_DATA *vfb, const MidiMessage *ev ) {
 
-	int i;
+	int i, route;
 
-	for (i = 0; i < VFB_MAX_FM_SLOTS; i++)
+	route = vfb->channel_route[ev->ch & 0x0f];
+	for (i = 0; route != 0; i++, route >>= 1)
 	{
-		if (evfb->active_config.instruments[i].midi_channel == ev->ch)
-			ym2151_set_bend(i, (ev->b << 7) + ev->a);
+		if (route & 1)
+			ym2151_set_bend(vfb, i, (ev->b << 7) + ev->a);
 	}
 
 #ifdef VFB_DEBUG
@@ -479,9 +613,10 @@ static int pitch_wheel( MidiEvent *ev ) {
 
 /* ------------------------------------------------------------------- */
 
-static int control_change( MidiEvent *ev ) {
+static int control_change( VFB_DATA *vfb, const MidiMessage *ev ) {
 
   int i;
+  int route = vfb->channel_route[ev->ch & 0x0f];
 
   switch( ev->a ) {
   case SMF_CTRL_BANK_SELECT_M:
@@ -490,8 +625,8 @@ static int control_change( MidiEvent *ev ) {
   case SMF_CTRL_MODULATION_DEPTH:
 	  for (i = 0; i < VFB_MAX_FM_SLOTS; i++)
 	  {
-		  if (evfb->active_config.instruments[i].midi_channel == ev->ch)
-			  ym2151_set_modulation_depth(i, ev->b);
+		  if (route & (1 << i))
+			  ym2151_set_modulation_depth(vfb, i, ev->b);
 	  }
 	break;
 
@@ -504,18 +639,18 @@ static int control_change( MidiEvent *ev ) {
   case SMF_CTRL_PORTAMENT_TIME:
 	  for (i = 0; i < VFB_MAX_FM_SLOTS; i++)
 	  {
-		  if (evfb->active_config.instruments[i].midi_channel == ev->ch)
-			  ym2151_set_portament(i, ev->b);
+		  if (route & (1 << i))
+			  ym2151_set_portament(vfb, i, ev->b);
 	  }
 	break;
 
   case SMF_CTRL_DATA_ENTRY_M:
-	if ( rpn_adr[ev->ch] == 0x0000 ) {
+	if ( vfb->rpn_adr[ev->ch] == 0x0000 ) {
 	  /* pitch bend sensitivity */
 		for (i = 0; i < VFB_MAX_FM_SLOTS; i++)
 		{
-			if (evfb->active_config.instruments[i].midi_channel == ev->ch)
-				ym2151_set_bend_sensitivity(i, ev->b, -1);
+			if (route & (1 << i))
+				ym2151_set_bend_sensitivity(vfb, i, ev->b, -1);
 		}
 	}
 	break;
@@ -523,8 +658,8 @@ static int control_change( MidiEvent *ev ) {
   case SMF_CTRL_MAIN_VOLUME:
 	  for (i = 0; i < VFB_MAX_FM_SLOTS; i++)
 	  {
-		  if (evfb->active_config.instruments[i].midi_channel == ev->ch)
-			  ym2151_set_master_volume(i, ev->b);
+		  if (route & (1 << i))
+			  ym2151_set_master_volume(vfb, i, ev->b);
 	  }
 	break;
 
@@ -533,14 +668,14 @@ static int control_change( MidiEvent *ev ) {
 
   case SMF_CTRL_PANPOT:
 	  // TODO: Move into YM2151 emulation? Was in mixing of multiple YM2151 chips, but now removed
-	pcm8_pan( ev->ch, ev->b );
+	pcm8_pan( vfb, ev->ch, ev->b );
 	break;
 
   case SMF_CTRL_EXPRESSION:
 	  for (i = 0; i < VFB_MAX_FM_SLOTS; i++)
 	  {
-		  if (evfb->active_config.instruments[i].midi_channel == ev->ch)
-			  ym2151_set_expression(i, ev->b);
+		  if (route & (1 << i))
+			  ym2151_set_expression(vfb, i, ev->b);
 	  }
 	break;
 
@@ -549,12 +684,12 @@ static int control_change( MidiEvent *ev ) {
 	break;
 
   case SMF_CTRL_DATA_ENTRY_L:
-	if ( rpn_adr[ev->ch] == 0x0000 ) {
+	if ( vfb->rpn_adr[ev->ch] == 0x0000 ) {
 	  /* pitch bend sensitivity */
 		for (i = 0; i < VFB_MAX_FM_SLOTS; i++)
 		{
-			if (evfb->active_config.instruments[i].midi_channel == ev->ch)
-				ym2151_set_bend_sensitivity(i, -1, ev->b);
+			if (route & (1 << i))
+				ym2151_set_bend_sensitivity(vfb, i, -1, ev->b);
 		}
 	}
 	break;
@@ -563,24 +698,24 @@ static int control_change( MidiEvent *ev ) {
   case SMF_CTRL_HOLD1:
 	  for (i = 0; i < VFB_MAX_FM_SLOTS; i++)
 	  {
-		  if (evfb->active_config.instruments[i].midi_channel == ev->ch)
-			  ym2151_set_hold(i, ev->b > 64 ? FLAG_TRUE : FLAG_FALSE);
+		  if (route & (1 << i))
+			  ym2151_set_hold(vfb, i, ev->b > 64 ? FLAG_TRUE : FLAG_FALSE);
 	  }
 	break;
 
   case SMF_CTRL_PORTAMENT:
 	  for (i = 0; i < VFB_MAX_FM_SLOTS; i++)
 	  {
-		  if (evfb->active_config.instruments[i].midi_channel == ev->ch)
-			  ym2151_set_portament_on(i, ev->b > 64 ? FLAG_TRUE : FLAG_FALSE);
+		  if (route & (1 << i))
+			  ym2151_set_portament_on(vfb, i, ev->b > 64 ? FLAG_TRUE : FLAG_FALSE);
 	  }
 	break;
 
   case SMF_CTRL_SUSTENUTE:
 	  for (i = 0; i < VFB_MAX_FM_SLOTS; i++)
 	  {
-		  if (evfb->active_config.instruments[i].midi_channel == ev->ch)
-			  ym2151_set_hold(i, ev->b > 64 ? FLAG_TRUE : FLAG_FALSE);
+		  if (route & (1 << i))
+			  ym2151_set_hold(vfb, i, ev->b > 64 ? FLAG_TRUE : FLAG_FALSE);
 	  }
 	break;
 
@@ -613,53 +748,53 @@ static int control_change( MidiEvent *ev ) {
 	break;
 
   case SMF_CTRL_NRPM_L:
-	nrpn_adr[ev->ch] &= 0xff00;
-	nrpn_adr[ev->ch] |= ev->b;
-	rpn_adr[ev->ch] = 0xffff;
+	vfb->nrpn_adr[ev->ch] &= 0xff00;
+	vfb->nrpn_adr[ev->ch] |= ev->b;
+	vfb->rpn_adr[ev->ch] = 0xffff;
 	break;
 
   case SMF_CTRL_NRPN_M:
-	nrpn_adr[ev->ch] &= 0x00ff;
-	nrpn_adr[ev->ch] |= (ev->b<<8);
-	rpn_adr[ev->ch] = 0xffff;
+	vfb->nrpn_adr[ev->ch] &= 0x00ff;
+	vfb->nrpn_adr[ev->ch] |= (ev->b<<8);
+	vfb->rpn_adr[ev->ch] = 0xffff;
 	break;
 
   case SMF_CTRL_RPN_L:
-	rpn_adr[ev->ch] &= 0xff00;
-	rpn_adr[ev->ch] |= ev->b;
-	nrpn_adr[ev->ch] = 0xffff;
+	vfb->rpn_adr[ev->ch] &= 0xff00;
+	vfb->rpn_adr[ev->ch] |= ev->b;
+	vfb->nrpn_adr[ev->ch] = 0xffff;
 	break;
 
   case SMF_CTRL_RPN_M:
-	rpn_adr[ev->ch] &= 0x00ff;
-	rpn_adr[ev->ch] |= (ev->b<<8);
-	nrpn_adr[ev->ch] = 0xffff;
+	vfb->rpn_adr[ev->ch] &= 0x00ff;
+	vfb->rpn_adr[ev->ch] |= (ev->b<<8);
+	vfb->nrpn_adr[ev->ch] = 0xffff;
 	break;
 
 
   case SMF_CTRL_ALL_SOUND_OFF:
 	  for (i = 0; i < VFB_MAX_FM_SLOTS; i++)
 	  {
-		  if (evfb->active_config.instruments[i].midi_channel == ev->ch)
-			  ym2151_all_note_off(i);
+		  if (route & (1 << i))
+			  ym2151_all_note_off(vfb, i);
 	  }
-	reset_ym2151();
+	reset_ym2151(vfb);
 	break;
 
   case SMF_CTRL_RESET_ALL_CTRL:
-	reset_ym2151();
+	reset_ym2151(vfb);
 	for (i = 0; i < VFB_MAX_FM_SLOTS; i++)
 	{
-		if (evfb->active_config.instruments[i].midi_channel == ev->ch)
+		if (route & (1 << i))
 		{
-			ym2151_set_hold(i, FLAG_FALSE);
-			ym2151_set_expression(i, 127);
-			ym2151_set_bend(i, 8192);
+			ym2151_set_hold(vfb, i, FLAG_FALSE);
+			ym2151_set_expression(vfb, i, 127);
+			ym2151_set_bend(vfb, i, 8192);
 		}
 	}
 	for ( i=0 ; i<VFB_MAX_CHANNEL_NUMBER ; i++ ) {
-	  rpn_adr[i]  = 0xffff;
-	  nrpn_adr[i] = 0xffff;
+	  vfb->rpn_adr[i]  = 0xffff;
+	  vfb->nrpn_adr[i] = 0xffff;
 	}
 	break;
 
@@ -669,8 +804,8 @@ static int control_change( MidiEvent *ev ) {
   case SMF_CTRL_ALL_NOTE_OFF:
 	  for (i = 0; i < VFB_MAX_FM_SLOTS; i++)
 	  {
-		  if (evfb->active_config.instruments[i].midi_channel == ev->ch)
-			  ym2151_all_note_off(i);
+		  if (route & (1 << i))
+			  ym2151_all_note_off(vfb, i);
 	  }
 	break;
 
@@ -698,7 +833,7 @@ static int control_change( MidiEvent *ev ) {
 
 /* ------------------------------------------------------------------- */
 
-void unknown_sysex(MidiEvent* ev)
+void unknown_sysex(VFB_DATA *vfb, const MidiMessage *ev)
 {
 	char buf[1024];
 
@@ -715,11 +850,11 @@ void unknown_sysex(MidiEvent* ev)
 	OutputDebugString(buf);
 }
 
-void param_change_instrument(MidiEvent* ev)
+void param_change_instrument(VFB_DATA *vfb, const MidiMessage *ev)
 {
 	// A1: F0 43 75 <0000ssss> <00011iii> <00pppppp> <0ddddddd> F7
 	// A2: F0 43 75 <0000ssss> <00011iii> <01pppppp> <0000dddd> <0000dddd> F7
-	int s, i, p, d, j;
+	int s, i, p, d;
 
 	char buf[1024];
 
@@ -737,39 +872,48 @@ void param_change_instrument(MidiEvent* ev)
 	switch (p)
 	{
 	case 0x00:
-		evfb->active_config.instruments[i].note_count = d;
-		allocate_base_voices();
+		vfb->active_config.instruments[i].note_count = d;
+		allocate_base_voices(vfb);
 		break;
 	case 0x01:
-		evfb->active_config.instruments[i].midi_channel = d;
+		vfb->active_config.instruments[i].midi_channel = d;
 		break;
 	case 0x02:
-		evfb->active_config.instruments[i].key_high_limit = d;
+		vfb->active_config.instruments[i].key_high_limit = d;
 		break;
 	case 0x03:
-		evfb->active_config.instruments[i].key_low_limit = d;
+		vfb->active_config.instruments[i].key_low_limit = d;
 		break;
 	case 0x04:
-		evfb->active_config.instruments[i].voice_bank = d;
+		vfb->active_config.instruments[i].voice_bank = d;
 
 		// Update the YM2164 registers for this instrument
-		update_voice(i);
+		update_voice(vfb, i);
 		break;
 	case 0x05:
-		evfb->active_config.instruments[i].voice = d;
+		vfb->active_config.instruments[i].voice = d;
 
 		// Update the YM2164 registers for this instrument
-		update_voice(i);
+		update_voice(vfb, i);
 		break;
 	}
+
+	vfb01_update_routing(vfb);
 }
 
-void voice_bulk_data_dump(MidiEvent* ev)
+void voice_bulk_data_dump(VFB_DATA *vfb, const MidiMessage *ev)
 {
 	OutputDebugString("FB01: Voice bulk data dump\n");
 }
 
-void voice_data_dump(MidiEvent* ev)
+/* Data dumps are sent through the host callback, dropped when there is none */
+static void send_midi_data(VFB_DATA *vfb, const uint8_t *data, uint32_t length)
+{
+	if (vfb->midi_output != NULL)
+		vfb->midi_output(vfb->midi_output_context, data, length);
+}
+
+void voice_data_dump(VFB_DATA *vfb, const MidiMessage *ev)
 {
 	OutputDebugString("FB01: Voice data dump\n");
 
@@ -786,27 +930,27 @@ void voice_data_dump(MidiEvent* ev)
 	data[138] = 0xF0;
 
 	// Packets start at offset 7, use type A encoding (8-bit data)
-	encode_packet_type_A(&data[7], &evfb->voice_banks[bank].voice_data[voice], sizeof(evfb->voice_banks[bank].voice_data[voice]));
+	encode_packet_type_A(&data[7], (const uint8_t*)&vfb->voice_banks[bank].voice_data[voice], sizeof(vfb->voice_banks[bank].voice_data[voice]));
 
-	SendMidiData(data, _countof(data));
+	send_midi_data(vfb, data, _countof(data));
 }
 
-void store_in_voice_RAM(MidiEvent* ev)
+void store_in_voice_RAM(VFB_DATA *vfb, const MidiMessage *ev)
 {
 	OutputDebugString("FB01: Store into voice RAM\n");
 }
 
-void system_param_change(MidiEvent* ev)
+void system_param_change(VFB_DATA *vfb, const MidiMessage *ev)
 {
 	OutputDebugString("FB01: System parameter change\n");
 }
 
-void voice_RAM1_bulk_data_dump(MidiEvent* ev)
+void voice_RAM1_bulk_data_dump(VFB_DATA *vfb, const MidiMessage *ev)
 {
 	OutputDebugString("FB01: Voice RAM 1 bulk data dump\n");
 }
 
-void each_voice_bulk_data_dump(MidiEvent* ev)
+void each_voice_bulk_data_dump(VFB_DATA *vfb, const MidiMessage *ev)
 {
 	OutputDebugString("FB01: Each voice bank bulk data dump\n");
 
@@ -828,7 +972,7 @@ void each_voice_bulk_data_dump(MidiEvent* ev)
 	// Export header
 	// Packets start at offset 7, use type A encoding (8-bit data)
 	pData = data + 7;
-	encode_packet_type_A(pData, &evfb->voice_banks[bank], 32);
+	encode_packet_type_A(pData, (const uint8_t*)&vfb->voice_banks[bank], 32);
 
 	pData += (32 * 2) + 3;
 
@@ -836,15 +980,15 @@ void each_voice_bulk_data_dump(MidiEvent* ev)
 	for (i = 0; i < 48; i++)
 	{
 		// Packets start at offset 7, use type A encoding (8-bit data)
-		encode_packet_type_A(pData, &evfb->voice_banks[bank].voice_data[i], sizeof(evfb->voice_banks[bank].voice_data[i]));
+		encode_packet_type_A(pData, (const uint8_t*)&vfb->voice_banks[bank].voice_data[i], sizeof(vfb->voice_banks[bank].voice_data[i]));
 
-		pData += (sizeof(evfb->voice_banks[bank].voice_data[i]) * 2) + 3;
+		pData += (sizeof(vfb->voice_banks[bank].voice_data[i]) * 2) + 3;
 	}
 
-	SendMidiData(data, _countof(data));
+	send_midi_data(vfb, data, _countof(data));
 }
 
-void current_config_data_dump(MidiEvent* ev)
+void current_config_data_dump(VFB_DATA *vfb, const MidiMessage *ev)
 {
 	OutputDebugString("FB01: Current configuration data dump\n");
 
@@ -858,62 +1002,62 @@ void current_config_data_dump(MidiEvent* ev)
 	data[170] = 0xF7;
 
 	// Packets start at offset 7, use type B encoding (7-bit data)
-	encode_packet_type_B(&data[7], &evfb->active_config, sizeof(evfb->active_config));
+	encode_packet_type_B(&data[7], (const uint8_t*)&vfb->active_config, sizeof(vfb->active_config));
 
-	SendMidiData(data, _countof(data));
+	send_midi_data(vfb, data, _countof(data));
 }
 
-void config_data_dump(MidiEvent* ev)
+void config_data_dump(VFB_DATA *vfb, const MidiMessage *ev)
 {
 	OutputDebugString("FB01: Configuration data dump\n");
 }
 
-void each_config_data_dump(MidiEvent* ev)
+void each_config_data_dump(VFB_DATA *vfb, const MidiMessage *ev)
 {
 	OutputDebugString("FB01: 16 configuration data dump\n");
 }
 
-void unit_ID_number_dump(MidiEvent* ev)
+void unit_ID_number_dump(VFB_DATA *vfb, const MidiMessage *ev)
 {
 	OutputDebugString("FB01: Unit ID number dump\n");
 }
 
-void config_data_store(MidiEvent* ev)
+void config_data_store(VFB_DATA *vfb, const MidiMessage *ev)
 {
 	OutputDebugString("FB01: Configuration data store\n");
 }
 
-void voice_RAM1_bulk_data_store(MidiEvent* ev)
+void voice_RAM1_bulk_data_store(VFB_DATA *vfb, const MidiMessage *ev)
 {
 	OutputDebugString("FB01: 48 voice bulk data (voice RAM1)\n");
 }
 
-void voice_bulk_data_store(MidiEvent* ev)
+void voice_bulk_data_store(VFB_DATA *vfb, const MidiMessage *ev)
 {
 	OutputDebugString("FB01: 48 voices bulk data (to specific bank)\n");
 }
 
-void current_config_store(MidiEvent* ev)
+void current_config_store(VFB_DATA *vfb, const MidiMessage *ev)
 {
 	OutputDebugString("FB01: Current configuration\n");
 }
 
-void config_memory_store(MidiEvent* ev)
+void config_memory_store(VFB_DATA *vfb, const MidiMessage *ev)
 {
 	OutputDebugString("FB01: Configuration memory\n");
 }
 
-void config_16_memory_store(MidiEvent* ev)
+void config_16_memory_store(VFB_DATA *vfb, const MidiMessage *ev)
 {
 	OutputDebugString("FB01: 16 configuration memory\n");
 }
 
-void single_voice_bulk_data_store(MidiEvent* ev)
+void single_voice_bulk_data_store(VFB_DATA *vfb, const MidiMessage *ev)
 {
 	OutputDebugString("FB01: 1 voice bulk data\n");
 }
 
-void param_change_channel(MidiEvent* ev)
+void param_change_channel(VFB_DATA *vfb, const MidiMessage *ev)
 {
 	// D1: F0 43 <0001nnnn> 15 <00pppppp> <0ddddddd> F7
 	// D2: F0 43 <0001nnnn> 15 <01pppppp> <0000dddd> <0000dddd> F7
@@ -931,34 +1075,36 @@ void param_change_channel(MidiEvent* ev)
 
 	for (i = 0; i < VFB_MAX_FM_SLOTS; i++)
 	{
-		if (evfb->active_config.instruments[i].midi_channel == n)
+		if (vfb->active_config.instruments[i].midi_channel == n)
 		{
 			switch (p)
 			{
 			case 0x00:
-				evfb->active_config.instruments[i].note_count = d;
-				allocate_base_voices();
+				vfb->active_config.instruments[i].note_count = d;
+				allocate_base_voices(vfb);
 				break;
 			case 0x01:
-				evfb->active_config.instruments[i].midi_channel = d;
+				vfb->active_config.instruments[i].midi_channel = d;
 				break;
 			case 0x02:
-				evfb->active_config.instruments[i].key_high_limit = d;
+				vfb->active_config.instruments[i].key_high_limit = d;
 				break;
 			case 0x03:
-				evfb->active_config.instruments[i].key_low_limit = d;
+				vfb->active_config.instruments[i].key_low_limit = d;
 				break;
 			}
 		}
-	}	
+	}
+
+	vfb01_update_routing(vfb);
 }
 
-void event_list(MidiEvent* ev)
+void event_list(VFB_DATA *vfb, const MidiMessage *ev)
 {
 	OutputDebugString("FB01: Event list\n");
 }
 
-void node_message(MidiEvent* ev)
+void node_message(VFB_DATA *vfb, const MidiMessage *ev)
 {
 	// C7: F0 43 75 <0000ssss> 00 00 <0000000b> ... F7
 	char buf[1024];
@@ -967,7 +1113,8 @@ void node_message(MidiEvent* ev)
 	uint8_t format, destination;
 	format = ev->ex_buf[4];
 	destination = ev->ex_buf[5];
-	uint8_t *pSrc, *pData;
+	const uint8_t *pSrc;
+	uint8_t *pData;
 	uint8_t data[8192];
 	uint8_t checkOk = 1;
 
@@ -975,6 +1122,12 @@ void node_message(MidiEvent* ev)
 	{
 	case 0:
 		// Voice data bank
+		if (ev->ex_len < VFB_VOICE_BANK_SYSEX_SIZE)
+		{
+			sprintf(buf, "FB01: Voice bank data truncated, length: %u\n", (unsigned)ev->ex_len);
+			OutputDebugString(buf);
+			break;
+		}
 		pSrc = ev->ex_buf + 6;
 		pData = data;
 
@@ -1012,13 +1165,13 @@ void node_message(MidiEvent* ev)
 			OutputDebugString("Checksum error!\n");
 
 		// Store data in the proper voice bank
-		memcpy(&evfb->voice_banks[destination], data, sizeof(evfb->voice_banks[destination]));
+		memcpy(&vfb->voice_banks[destination], data, sizeof(vfb->voice_banks[destination]));
 
 		// Convert to 'native' VFB format
 		// TODO: Use real FB-01 voice data directly
 		for (i = 0; i < 48; i++)
 		{
-			convert_voice(&evfb->voice_banks[destination].voice_data[i], i);
+			convert_voice(vfb, &vfb->voice_banks[destination].voice_data[i], i);
 		}
 		break;
 	case 6:
@@ -1026,12 +1179,12 @@ void node_message(MidiEvent* ev)
 		OutputDebugString("FB01: Configuration-2\n");
 		break;
 	default:
-		unknown_sysex(ev);
+		unknown_sysex(vfb, ev);
 		break;
 	}
 }
 
-static int fb01_exclusive( MidiEvent* ev )
+static int fb01_exclusive( VFB_DATA *vfb, const MidiMessage *ev )
 {
 	/*
 	SysEx Messages (see Yamaha FB-01 Service Manual page 12):
@@ -1143,11 +1296,11 @@ static int fb01_exclusive( MidiEvent* ev )
 				{
 				case 0x00:
 					// A1: F0 43 75 <0000ssss> <00011iii> <00pppppp> <0ddddddd> F7
-					param_change_instrument(ev);
+					param_change_instrument(vfb, ev);
 					break;
 				case 0x40:
 					// A2: F0 43 75 <0000ssss> <00011iii> <01pppppp> <0000dddd> <0000dddd> F7
-					param_change_instrument(ev);
+					param_change_instrument(vfb, ev);
 					break;
 				}
 				break;
@@ -1156,57 +1309,57 @@ static int fb01_exclusive( MidiEvent* ev )
 				{
 				case 0x40:
 					// A3: F0 43 75 <0000ssss> <00101iii> 40 00 F7
-					voice_bulk_data_dump(ev);
+					voice_bulk_data_dump(vfb, ev);
 					break;
 				case 0x00:
 					// A4: F0 43 75 <0000ssss> <00101iii> 00 <00dddddd> F7
-					//store_in_voice_RAM(ev);
-					voice_data_dump(ev);
+					//store_in_voice_RAM(vfb, ev);
+					voice_data_dump(vfb, ev);
 					break;
 				default:
-					unknown_sysex(ev);
+					unknown_sysex(vfb, ev);
 					break;
 				}
 				break;
 			case 0x10:
 				// B1: F0 43 75 <0000ssss> 10 <0ppppppp> <0ddddddd> F7
-				system_param_change(ev);
+				system_param_change(vfb, ev);
 				break;
 			case 0x20:
 				switch (ev->ex_buf[4])
 				{
 				case 0x00:
 					// B3: F0 43 75 <0000ssss> 20 00 <00000xxx> F7
-					each_voice_bulk_data_dump(ev);
+					each_voice_bulk_data_dump(vfb, ev);
 					break;
 				case 0x01:
 					// B4: F0 43 75 <0000ssss> 20 01 00 F7 (NB: 00 and 01 reversed in Service Manual?)
-					current_config_data_dump(ev);
+					current_config_data_dump(vfb, ev);
 					break;
 				case 0x02:
 					// B5: F0 43 75 <0000ssss> 20 02 <000xxxxx> F7
-					config_data_dump(ev);
+					config_data_dump(vfb, ev);
 					break;
 				case 0x03:
 					// B6: F0 43 75 <0000ssss> 20 03 00 F7
-					each_config_data_dump(ev);
+					each_config_data_dump(vfb, ev);
 					break;
 				case 0x04:
 					// B7: F0 43 75 <0000ssss> 20 04 00 F7
-					unit_ID_number_dump(ev);
+					unit_ID_number_dump(vfb, ev);
 					break;
 				case 0x40:
 					// B8: F0 43 75 <0000ssss> 20 40 <000ddddd> F7
-					config_data_store(ev);
+					config_data_store(vfb, ev);
 					break;
 				default:
-					unknown_sysex(ev);
+					unknown_sysex(vfb, ev);
 					break;
 				}
 				break;
 			case 0xC0:
 				// C2: F0 43 75 <0000ssss> 0C 00 00 <00000xxx> 20 10 <0000dddd> <0000dddd> ... <0000dddd> <0000dddd> <0eeeeeee> 10 40 <0000dddd> <0000dddd> ... <0000dddd> <0000dddd> <0eeeeeee> F7
-				voice_bulk_data_store(ev);
+				voice_bulk_data_store(vfb, ev);
 				break;
 
 			case 0x00:
@@ -1214,41 +1367,41 @@ static int fb01_exclusive( MidiEvent* ev )
 				{
 				case 0x00:
 					// C7: F0 43 75 <0000ssss> 00 00 <0000000b> ... F7
-					node_message(ev);
+					node_message(vfb, ev);
 					break;
 				case 0x01:
 					// C3: F0 43 75 <0000ssss> 00 01 00 01 20 <0ddddddd> ... <0ddddddd> <0eeeeeee> F7
-					current_config_store(ev);
+					current_config_store(vfb, ev);
 					break;
 				case 0x02:
 					// C4: F0 43 75 <0000ssss> 00 02 <000xxxxx> 01 20 <0ddddddd> ... <0ddddddd> <0eeeeeee> F7
-					config_memory_store(ev);
+					config_memory_store(vfb, ev);
 					break;
 				case 0x03:
 					// C5: F0 43 75 <0000ssss> 00 03 00 14 00 <0ddddddd> ... <0ddddddd> <0eeeeeee> F7
-					config_16_memory_store(ev);
+					config_16_memory_store(vfb, ev);
 					break;
 				case 0x06:
 					// C8
-					node_message(ev);
+					node_message(vfb, ev);
 				default:
-					unknown_sysex(ev);
+					unknown_sysex(vfb, ev);
 					break;
 				}
 				break;
 			case 0x08:
 				// C6: F0 43 75 <0000ssss> <00001iii> 00 00 01 00 <0000dddd> <0000dddd> ... <0000dddd> <0000dddd> <0eeeeeee> F7
-				single_voice_bulk_data_store(ev);
+				single_voice_bulk_data_store(vfb, ev);
 				break;
 			default:
-				unknown_sysex(ev);
+				unknown_sysex(vfb, ev);
 				break;
 			}
 		}
 		else
 		{
 			// E1: F0 43 75 70 <0eeeeeee> ... <0eeeeeee> F7
-			event_list(ev);
+			event_list(vfb, ev);
 		}
 	}
 	else
@@ -1259,27 +1412,27 @@ static int fb01_exclusive( MidiEvent* ev )
 		{
 		case 0x20:
 			// B2: F0 43 <0010ssss> 0C F7
-			voice_RAM1_bulk_data_dump(ev);
+			voice_RAM1_bulk_data_dump(vfb, ev);
 			break;
 		case 0x00:
 			// C1: F0 43 <0000ssss> 0C 20 00 <0000dddd> <0000dddd> ... <0000dddd> <0000dddd> <0eeeeeee> 10 40 <0000dddd> <0000dddd> ... <0000dddd> <0000dddd> <0eeeeeee> F7
-			voice_RAM1_bulk_data_store(ev);
+			voice_RAM1_bulk_data_store(vfb, ev);
 			break;
 		case 0x01:
 			switch (ev->ex_buf[3] & 0x40)
 			{
 			case 0x00:
 				// D1: F0 43 <0001nnnn> 15 <00pppppp> <0ddddddd> F7
-				param_change_channel(ev);
+				param_change_channel(vfb, ev);
 				break;
 			case 0x40:
 				// D2: F0 43 <0001nnnn> 15 <01pppppp> <0000dddd> <0000dddd> F7
-				param_change_channel(ev);
+				param_change_channel(vfb, ev);
 				break;
 			}
 			break;
 		default:
-			unknown_sysex(ev);
+			unknown_sysex(vfb, ev);
 			break;
 		}
 	}
@@ -1287,25 +1440,43 @@ static int fb01_exclusive( MidiEvent* ev )
 	return 0;
 }
 
-static int system_exclusive( MidiEvent *ev ) {
+/* native voice setting: voice number, 11 parameters for each of the 4
+   operators, con, fl, slot mask and a checksum byte */
+#define VOICE_SETTING_LENGTH (1 + 4*11 + 3 + 1)
+
+static int system_exclusive( VFB_DATA *vfb, const MidiMessage *ev ) {
 
   int i,j;
+#ifdef VFB_DEBUG
   int d;
+#endif
+  MidiMessage padded;
+  uint8_t header[VFB_SYSEX_HEADER_SIZE];
+
+  /* The handlers read the header bytes unconditionally. A shorter message */
+  /* is copied into a zero-filled header, so they never read past it.     */
+  if ( ev->ex_len < VFB_SYSEX_HEADER_SIZE ) {
+	memset( header, 0, sizeof(header) );
+	memcpy( header, ev->ex_buf, ev->ex_len );
+	padded = *ev;
+	padded.ex_buf = header;
+	ev = &padded;
+  }
 
   if ( ev->ex_buf[0] == 0x43 ) { /* Yamaha FB-01 exclusive */
-	  return fb01_exclusive( ev );
+	  return fb01_exclusive( vfb, ev );
   }
   else if ( ev->ex_buf[0] == 0x7e ) { /* Universal non-realtime */
 	if ( ev->ex_buf[2] == 0x09 && ev->ex_buf[3] == 0x01 ) {
 	  /* GM-MODE on */
-	  reset_ym2151();
-	  ym2151_all_note_off(ev->ch);
-	  ym2151_set_hold( ev->ch,  FLAG_FALSE );
-	  ym2151_set_expression( ev->ch, 127 );
-	  ym2151_set_bend( ev->ch, 8192 );
+	  reset_ym2151(vfb);
+	  ym2151_all_note_off(vfb, ev->ch);
+	  ym2151_set_hold( vfb, ev->ch,  FLAG_FALSE );
+	  ym2151_set_expression( vfb, ev->ch, 127 );
+	  ym2151_set_bend( vfb, ev->ch, 8192 );
 	  for ( i=0 ; i<VFB_MAX_CHANNEL_NUMBER ; i++ ) {
-	rpn_adr[i]  = 0xffff;
-	nrpn_adr[i] = 0xffff;
+	vfb->rpn_adr[i]  = 0xffff;
+	vfb->nrpn_adr[i] = 0xffff;
 	  }
 #ifdef VFB_DEBUG
 	  fprintf(stderr,"SYSEX: GM-Mode on\n");
@@ -1315,7 +1486,7 @@ static int system_exclusive( MidiEvent *ev ) {
   else if ( ev->ex_buf[0] == 0x7f ) { /* Universal realtime */
 	if ( ev->ex_buf[2] == 0x04 && ev->ex_buf[3] == 0x01 ) {
 	  /* master volume */
-	  ym2151_set_system_volume( ev->ex_buf[5] );
+	  ym2151_set_system_volume( vfb, ev->ex_buf[5] );
 #ifdef VFB_DEBUG
 	  fprintf(stderr,"SYSEX: Master volume: %d\n",ev->ex_buf[5]);
 #endif
@@ -1323,19 +1494,19 @@ static int system_exclusive( MidiEvent *ev ) {
   }
   else if ( ev->ex_buf[0] == 0x7d ) { /* vfb01 native */
 	if ( ev->ex_buf[1] == 0x0a ) {    /* voice setting */
-	  int e[36];
+	  int e[VOICE_SETTING_LENGTH];
 	  int sum=0,c;
 	  i=0;
 	  j=2;
-	  while(i<35) {
+	  while(i<VOICE_SETTING_LENGTH && (uint32_t)j<ev->ex_len) {
 	c = ev->ex_buf[j++];
 	if ( c==0xf7 ) break;
 	e[i++] = c;
 	sum+=c;
 	  }
-	  if ( i == 36 && (sum&0x7f) == 0 &&
-	   e[0] < VFB_MAX_TONE_NUMBER && evfb != NULL) {
-	VOICE_DATA *v = &evfb->voice[e[0]];
+	  if ( i == VOICE_SETTING_LENGTH && (sum&0x7f) == 0 &&
+	   e[0] < VFB_MAX_TONE_NUMBER) {
+	VOICE_DATA *v = &vfb->voice[e[0]];
 	j=0;
 	v->voice_number = e[j++];
 	for ( i=0 ; i<4 ; i++ ) {
@@ -1365,7 +1536,7 @@ static int system_exclusive( MidiEvent *ev ) {
 #ifdef VFB_DEBUG
   i=0;
   fprintf(stdout, "SYSEX:    ");
-  while (i<SYSEX_BUF_SIZE) {
+  while ((uint32_t)i<ev->ex_len) {
 	d = ev->ex_buf[i++];
 	fprintf( stdout,"%02x ", d );fflush(stdout);
 	if ( d == 0xf7 ) {
@@ -1379,39 +1550,6 @@ static int system_exclusive( MidiEvent *ev ) {
 
 /* ------------------------------------------------------------------- */
 
-static void sigexit( int num ) {
-
-  closeVirtualMidiDevice();
-
-#ifdef _POSIX_PRIORITY_SCHEDULING
-  sched_yield();
-#endif
-#ifdef _POSIX_MEMLOCK
-  munlockall();
-#endif
-
-  fprintf(stderr,_("Signal caught : %d\n"), num);
-  exit(1);
-}
-
-static void sigquit( int num ) {
-  closeVirtualMidiDevice();
-
-#ifdef _POSIX_PRIORITY_SCHEDULING
-  sched_yield();
-#endif
-#ifdef _POSIX_MEMLOCK
-  munlockall();
-#endif
-
-  exit(0);
-}
-
-static void sigreset( int num ) {
-  reset_ym2151();
-  return;
-}
-
 static void priority_init( void ) {
 
 #ifdef _POSIX_PRIORITY_SCHEDULING
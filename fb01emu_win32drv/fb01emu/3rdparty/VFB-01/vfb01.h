@@ -41,6 +41,9 @@
 #define VFB_NUM_VOICE_BANKS           7
 #define VFB_NUM_VOICES               48
 
+#define VFB_MAX_PENDING_WRITES     1024 /* YM2151 writes held between two render segments */
+#define VFB_YM2151_CLOCK        4000000 /* Hz */
+
 #define FLAG_TRUE                     1
 #define FLAG_FALSE                    0
 
@@ -50,6 +53,8 @@
 #define VFB_PAN_C                     3
 
 #define SYSEX_BUF_SIZE             8192
+#define VFB_SYSEX_HEADER_SIZE         8 /* SysEx bytes after F0 that are always decoded */
+#define VFB_VOICE_BANK_SYSEX_SIZE  (6 + (64+3) + 48*(128+3)) /* node message with a voice bank */
 #define VFB_VERSION_TEXT_SIZE       256
 
 /* ------------------------------------------------------------------- */
@@ -61,6 +66,17 @@ typedef struct _MidiEvent {
   uint8_t ex_buf[SYSEX_BUF_SIZE];
 } MidiEvent;
 
+/* What vfb01_doMidiMessage() takes: a channel message is just its four */
+/* bytes, and a SysEx is referenced in the sender's buffer, not copied. */
+
+typedef struct _MidiMessage {
+  uint8_t type;
+  uint8_t ch;
+  uint8_t a,b;
+  const uint8_t *ex_buf;   /* SysEx body after the F0, NULL if none */
+  uint32_t ex_len;         /* bytes at ex_buf */
+} MidiMessage;
+
 typedef struct _VOICE_DATA {
   int voice_number;
   int fl;              /* feed back */
@@ -176,6 +192,44 @@ typedef struct _VFB_VOICE_BANK {
 
 #pragma pack(pop)
 
+// This describes the MIDI state machine for an instrument
+typedef struct _MIDI_MAP {
+	int base_voice;	// Lowest voice for this instrument
+
+	long portament;
+	int portament_on;
+
+	int bend;
+	int bend_sense_m;
+	int bend_sense_l;
+
+	int note[VFB_MAX_FM_SLOTS];
+
+	/* state of note_on:
+	2:  key pressed
+	1:  key on
+	0:  key released
+	-1: none pronouncing
+	*/
+
+	int note_on[VFB_MAX_FM_SLOTS];
+	int velocity[VFB_MAX_FM_SLOTS];
+	int hold;
+
+	int total_level[4];
+	int algorithm;
+	int slot_mask;
+
+	int step[VFB_MAX_FM_SLOTS];
+
+	int master_volume;
+	int expression;
+
+	int dirty_slots;	// Slots whose pitch/volume registers must be rewritten, one bit per slot
+} MIDI_MAP;
+
+#define VFB_ALL_SLOTS_DIRTY ((1 << VFB_MAX_FM_SLOTS) - 1)
+
 typedef struct _VFB_DATA {
   
 	unsigned char version_1[VFB_VERSION_TEXT_SIZE];
@@ -206,6 +260,54 @@ typedef struct _VFB_DATA {
 
 	int  dsp_speed;
 
+	/* MIDI state ( vfb01.c ) */
+
+	int rpn_adr[VFB_MAX_CHANNEL_NUMBER];
+	int nrpn_adr[VFB_MAX_CHANNEL_NUMBER];
+
+	/* MIDI routing: bitmasks of the instruments that receive a channel, */
+	/* or a channel and key. Rebuilt by vfb01_update_routing() whenever  */
+	/* the active configuration changes.                                 */
+
+	uint8_t channel_route[VFB_MAX_CHANNEL_NUMBER];
+	uint8_t key_route[VFB_MAX_CHANNEL_NUMBER][128];
+
+	/* YM2151 access state ( vfb_device.c ) */
+
+	void *ym2151;                                  /* YM2151 emulator instance */
+	MIDI_MAP instrument_map[VFB_MAX_FM_SLOTS];     /* indexed 1:1 with the instruments in the active configuration */
+	int ym2151_register_map[256];                  /* shadow registers, -1 when the chip value is unknown */
+	int ym2151_amd;                                /* 0x19 holds AMD and PMD, selected by bit 7: */
+	int ym2151_pmd;                                /* the last write of each, -1 when unknown */
+	int system_volume;
+
+	/* Register writes made while handling events, applied in order by */
+	/* ym2151_flush_writes() before the next render segment.           */
+
+	uint16_t pending_writes[VFB_MAX_PENDING_WRITES];   /* (adr << 8) | val */
+	int pending_write_count;
+	uint32_t elided_writes;                        /* redundant writes dropped by reg_write() */
+
+	/* PCM8 mixer state ( pcm8.c ) */
+
+	int pcm8_opened;
+	int pcm8_interrupt_active;
+	int pcm8_master_volume;
+	int is_encoding_16bit;
+	int is_encoding_stereo;
+	int ym2151_block_render;                       /* FLAG_TRUE: ym2151_update_block(), FLAG_FALSE: ym2151_update_one() */
+	int16_t *ym2151_voice[2];
+	int ym2151_pan[VFB_MAX_CHANNEL_NUMBER];
+
+	/* MIDI output of the emulated unit (data dumps), may be NULL */
+
+	void (*midi_output)( void *context, const uint8_t *data, uint32_t length );
+	void *midi_output_context;
+
+	/* VGM recorder of the chip writes ( vfb_vgm.c ), NULL when not recording */
+
+	void *vgm_recorder;
+
 } VFB_DATA;
 
 /* ------------------------------------------------------------------- */
@@ -214,14 +316,13 @@ extern int vfb01_init( VFB_DATA *, int );
 extern int vfb01_run( VFB_DATA * );
 extern int vfb01_close( VFB_DATA * );
 extern void vfb01_doMidiEvent(VFB_DATA *vfb, MidiEvent* e);
+extern void vfb01_doMidiMessage(VFB_DATA *vfb, const MidiMessage* e);
+extern void vfb01_update_routing(VFB_DATA *vfb);
+extern uint32_t vfb01_save_state(VFB_DATA *vfb, uint8_t *buf, uint32_t size);
+extern int vfb01_load_state(VFB_DATA *vfb, const uint8_t *buf, uint32_t size);
 
 extern int getMidiEvent( MidiEvent * );
 
 /* ------------------------------------------------------------------- */
 
-extern VOICE_DATA **voices;
-extern void* YMPSG;
-
-/* ------------------------------------------------------------------- */
-
 #endif /* _VFB01_H_ */
@@ -0,0 +1,36 @@
+/*
+  VFB-01 : Virtual FB-01 emulator
+
+  Portable stand-ins for the few Win32 services used by the emulation.
+
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef _VFB_COMPAT_H_
+#define _VFB_COMPAT_H_
+
+#ifdef _WIN32
+# include <windows.h>
+#else
+/* debug messages only go to the Windows debugger */
+# define OutputDebugString(s) ((void)(s))
+#endif
+
+#ifndef _countof
+# define _countof(a) (sizeof(a)/sizeof((a)[0]))
+#endif
+
+#endif /* _VFB_COMPAT_H_ */
@@ -27,65 +27,21 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "vfb01.h"
 #include "vfb_device.h"
 #include "ym2151.h"
 #include "pcm8.h"
+#include "vfb_vgm.h"
 
 /* ------------------------------------------------------------------- */
 
-// This describes the MIDI state machine for an instrument
-typedef struct _MIDI_MAP {
-	int base_voice;	// Lowest voice for this instrument
+static void freq_write( VFB_DATA *, int, int, int );
+static void volume_write( VFB_DATA *, int, int );
 
-	long portament;
-	int portament_on;
-
-	int bend;
-	int bend_sense_m;
-	int bend_sense_l;
-
-	int note[VFB_MAX_FM_SLOTS];
-
-	/* state of note_on:
-	2:  key pressed
-	1:  key on
-	0:  key released
-	-1: none pronouncing
-	*/
-
-	int note_on[VFB_MAX_FM_SLOTS];
-	int velocity[VFB_MAX_FM_SLOTS];
-	int hold;
-
-	int total_level[4];
-	int algorithm;
-	int slot_mask;
-
-	int step[VFB_MAX_FM_SLOTS];
-
-	int master_volume;
-	int expression;
-} MIDI_MAP;
-
-/* ------------------------------------------------------------------- */
-
-static VFB_DATA *evfb=NULL;
-MIDI_MAP instrument_map[VFB_MAX_FM_SLOTS];	// These are indexed 1:1 with the instruments in the active configuration
-int ym2151_register_map[256];
-
-static int system_volume = 127;
-
-void* YMPSG;
-
-/* ------------------------------------------------------------------- */
-
-static void freq_write( int, int );
-static void volume_write( int, int );
-
-static void reg_write( int, int );
-static int reg_read( int );
+static void reg_write( VFB_DATA *, int, int );
+static int reg_read( VFB_DATA *, int );
 
 static const int is_vol_set[8][4]={
   {0,0,0,1},
@@ -100,7 +56,7 @@ static const int is_vol_set[8][4]={
 
 /* ------------------------------------------------------------------- */
 
-extern int allocate_base_voices(void)
+int allocate_base_voices(VFB_DATA *vfb)
 {
 	int i;
 	int base_voice = 0;
@@ -108,27 +64,29 @@ extern int allocate_base_voices(void)
 	// TODO: sanity check if we aren't allocating too many voices
 	for (i = 0; i < VFB_MAX_FM_SLOTS; i++)
 	{
-		instrument_map[i].base_voice = base_voice;
-		base_voice += evfb->active_config.instruments[i].note_count;
+		vfb->instrument_map[i].base_voice = base_voice;
+		vfb->instrument_map[i].dirty_slots = VFB_ALL_SLOTS_DIRTY;
+		base_voice += vfb->active_config.instruments[i].note_count;
 	}
 
 	return 0;
 }
 
-extern int update_voice(int v)
+int update_voice(VFB_DATA *vfb, int v)
 {
 	int i, j;
 
-	j = instrument_map[v].base_voice + evfb->active_config.instruments[v].note_count;
+	j = vfb->instrument_map[v].base_voice + vfb->active_config.instruments[v].note_count;
 
-	for (i = instrument_map[v].base_voice; i < j; i++)
+	for (i = vfb->instrument_map[v].base_voice; i < j; i++)
 	{
 		// TODO: use proper bank and voice
-		ym2151_set_voice(i, evfb->active_config.instruments[v].voice);
+		ym2151_set_voice(vfb, i, vfb->active_config.instruments[v].voice);
 	}
+
+	return 0;
 }
 
-static int is_already_opm_allocated = FLAG_FALSE;
 static int ym2151_reg_init( VFB_DATA *vfb ) {
   int i,j;
 
@@ -139,367 +97,398 @@ static int ym2151_reg_init( VFB_DATA *vfb ) {
 	sample bits   = 16 bit
 	*/
 
-	if ( is_already_opm_allocated == FLAG_FALSE ) {
-		YMPSG = ym2151_init( NULL, 4000*1000,
+	if ( vfb->ym2151 == NULL ) {
+		vfb->ym2151 = ym2151_init( NULL, VFB_YM2151_CLOCK,
 			vfb->dsp_speed );
 
-		if ( YMPSG == NULL  ) return 1;
-		ym2151_reset_chip(YMPSG);
+		if ( vfb->ym2151 == NULL  ) return 1;
+		ym2151_reset_chip(vfb->ym2151);
+	}
 
-		is_already_opm_allocated = FLAG_TRUE;
+	/* Forget the shadow registers, so that none of the writes below is elided */
+	vfb->pending_write_count = 0;
+	for ( i=0 ; i<0x100 ; i++ ) {
+	  vfb->ym2151_register_map[i] = -1;
 	}
+	vfb->ym2151_amd = -1;
+	vfb->ym2151_pmd = -1;
 
 	for ( i=0 ; i<VFB_MAX_FM_SLOTS; i++ ) {
-	  reg_write( 0x08, 0*8 + i );    /* KON */
+	  reg_write( vfb, 0x08, 0*8 + i );    /* KON */
 	}
-	reg_write( 0x0f, 0 );            /* NE, NFREQ */
-	reg_write( 0x18, 0 );            /* LFRQ */
-	reg_write( 0x19, 0*128 + 0 );    /* AMD */
-	reg_write( 0x19, 1*128 + 0 );    /* AMD */
-	reg_write( 0x1b, 0*64  + 0 );    /* CT, W */
+	reg_write( vfb, 0x0f, 0 );            /* NE, NFREQ */
+	reg_write( vfb, 0x18, 0 );            /* LFRQ */
+	reg_write( vfb, 0x19, 0*128 + 0 );    /* AMD */
+	reg_write( vfb, 0x19, 1*128 + 0 );    /* AMD */
+	reg_write( vfb, 0x1b, 0*64  + 0 );    /* CT, W */
 	
 	for ( i=0 ; i<VFB_MAX_FM_SLOTS; i++ ) {
-	  reg_write( 0x20+i, 3*64 + 0*8 +0 ); /* LR, FL, CON */
-	  reg_write( 0x28+i, 0*16 + 0 );      /* OCT, NOTE */
-	  reg_write( 0x30+i, 0 );             /* KF */
-	  reg_write( 0x38+i, 0*16 + 0 );      /* PMS, AMS */
+	  reg_write( vfb, 0x20+i, 3*64 + 0*8 +0 ); /* LR, FL, CON */
+	  reg_write( vfb, 0x28+i, 0*16 + 0 );      /* OCT, NOTE */
+	  reg_write( vfb, 0x30+i, 0 );             /* KF */
+	  reg_write( vfb, 0x38+i, 0*16 + 0 );      /* PMS, AMS */
 	}
 	for ( i=0 ; i<0x20 ; i++ ) {
-	  reg_write( 0x40+i, 0*16 + 0 );      /* DT1, MUL */
-	  reg_write( 0x60+i, 0 );             /* TL */
-	  reg_write( 0x80+i, 0*64 + 0 );      /* KS, AR */
-	  reg_write( 0xa0+i, 0*128 + 0 );     /* AMS, D1R */
-	  reg_write( 0xc0+i, 0*64 + 0 );      /* DT2, D2R */
-	  reg_write( 0xe0+i, 0*16 + 0 );      /* D1L, RR */
+	  reg_write( vfb, 0x40+i, 0*16 + 0 );      /* DT1, MUL */
+	  reg_write( vfb, 0x60+i, 0 );             /* TL */
+	  reg_write( vfb, 0x80+i, 0*64 + 0 );      /* KS, AR */
+	  reg_write( vfb, 0xa0+i, 0*128 + 0 );     /* AMS, D1R */
+	  reg_write( vfb, 0xc0+i, 0*64 + 0 );      /* DT2, D2R */
+	  reg_write( vfb, 0xe0+i, 0*16 + 0 );      /* D1L, RR */
 	}
 	
-	reg_write( 0x1b, 2 );                 /* wave form: triangle */
-	reg_write( 0x18, 196 );               /* frequency */
+	reg_write( vfb, 0x1b, 2 );                 /* wave form: triangle */
+	reg_write( vfb, 0x18, 196 );               /* frequency */
 
 	for (i = 0; i < VFB_MAX_FM_SLOTS; i++)
 	{
-		instrument_map[i].base_voice = i;
+		vfb->instrument_map[i].base_voice = i;
 		for (j = 0; j < VFB_MAX_FM_SLOTS; j++) {
-			instrument_map[i].note[j] = 0;
-			instrument_map[i].note_on[j] = -1;
-			instrument_map[i].step[j] = 0;
-			instrument_map[i].velocity[j] = 0;
+			vfb->instrument_map[i].note[j] = 0;
+			vfb->instrument_map[i].note_on[j] = -1;
+			vfb->instrument_map[i].step[j] = 0;
+			vfb->instrument_map[i].velocity[j] = 0;
 		}
 
 		for (j = 0; j < 3; j++) {
-			instrument_map[i].total_level[j] = 0;
+			vfb->instrument_map[i].total_level[j] = 0;
 		}
-		instrument_map[i].total_level[3] = 127;
+		vfb->instrument_map[i].total_level[3] = 127;
 
-		instrument_map[i].portament = 0;
-		instrument_map[i].portament_on = 0;
-		instrument_map[i].slot_mask = 0;
-		instrument_map[i].algorithm = 0;
-		instrument_map[i].bend = 0;
-		instrument_map[i].bend_sense_m = 2;
-		instrument_map[i].bend_sense_l = 0;
-		instrument_map[i].hold = FLAG_FALSE;
+		vfb->instrument_map[i].portament = 0;
+		vfb->instrument_map[i].portament_on = 0;
+		vfb->instrument_map[i].slot_mask = 0;
+		vfb->instrument_map[i].algorithm = 0;
+		vfb->instrument_map[i].bend = 0;
+		vfb->instrument_map[i].bend_sense_m = 2;
+		vfb->instrument_map[i].bend_sense_l = 0;
+		vfb->instrument_map[i].hold = FLAG_FALSE;
 
-		instrument_map[i].master_volume = 127;
-		instrument_map[i].expression = 127;
+		vfb->instrument_map[i].master_volume = 127;
+		vfb->instrument_map[i].expression = 127;
 
-		ym2151_set_voice(i, VFB_INITIAL_VOICE_NUMBER);
+		vfb->instrument_map[i].dirty_slots = VFB_ALL_SLOTS_DIRTY;
+
+		ym2151_set_voice(vfb, i, VFB_INITIAL_VOICE_NUMBER);
 	}
   
-  system_volume = 127;
+  vfb->system_volume = 127;
 
   return 0;
 }
 
 int setup_ym2151( VFB_DATA *vfb ) {
 
-  evfb = vfb;
+  vfb->ym2151 = NULL;
   if ( ym2151_reg_init(vfb) ) return 1;
 
   return 0;
 }
 
-int reset_ym2151( void ) {
+int reset_ym2151( VFB_DATA *vfb ) {
 
-  if ( ym2151_reg_init(evfb) ) return 1;
+  if ( ym2151_reg_init(vfb) ) return 1;
 
   return 0;
 }
 
+void close_ym2151( VFB_DATA *vfb ) {
+
+  if ( vfb->ym2151 != NULL ) {
+	ym2151_shutdown( vfb->ym2151 );
+	vfb->ym2151 = NULL;
+  }
+
+  return;
+}
+
 /* ------------------------------------------------------------------- */
 
-void ym2151_all_note_off( int instrument ) {
+void ym2151_all_note_off( VFB_DATA *vfb, int instrument ) {
 
-  int i,j;
+  int i;
 
-  for ( i=0; i < evfb->active_config.instruments[instrument].note_count; i++ )
+  for ( i=0; i < vfb->active_config.instruments[instrument].note_count; i++ )
   {
-	instrument_map[instrument].note_on[i]=0;
+	vfb->instrument_map[instrument].note_on[i]=0;
 
-	reg_write( 0x08, 0+i + instrument_map[instrument].base_voice);          /* KON */
+	reg_write( vfb, 0x08, 0+i + vfb->instrument_map[instrument].base_voice);          /* KON */
   }
+  vfb->instrument_map[instrument].dirty_slots = VFB_ALL_SLOTS_DIRTY;
 
   return;
 }
 
-void ym2151_note_on( int instrument, int note, int vel ) {
+void ym2151_note_on( VFB_DATA *vfb, int instrument, int note, int vel ) {
 
   int slot;
   int longest_step=0, longest_slot=0;
 
-  for ( slot=0 ; slot < evfb->active_config.instruments[instrument].note_count; slot++ ) {
-	if (instrument_map[instrument].note_on[slot] <= 0 ) break;        /* not playing */
-	if (instrument_map[instrument].note[slot] == note ) break;        /* same note */
+  for ( slot=0 ; slot < vfb->active_config.instruments[instrument].note_count; slot++ ) {
+	if (vfb->instrument_map[instrument].note_on[slot] <= 0 ) break;        /* not playing */
+	if (vfb->instrument_map[instrument].note[slot] == note ) break;        /* same note */
 
-	if ( longest_step < instrument_map[instrument].step[slot] ) {      /* longest tone */
-	  longest_step = instrument_map[instrument].step[slot];
+	if ( longest_step < vfb->instrument_map[instrument].step[slot] ) {      /* longest tone */
+	  longest_step = vfb->instrument_map[instrument].step[slot];
 	  longest_slot = slot;
 	}
   }
-  if ( slot == evfb->active_config.instruments[instrument].note_count)
+  if ( slot == vfb->active_config.instruments[instrument].note_count)
 	slot = longest_slot;
 
-  instrument_map[instrument].step[slot]=0;
-  instrument_map[instrument].note[slot]=note;
-  instrument_map[instrument].note_on[slot]=2;
-  instrument_map[instrument].velocity[slot]=vel;
+  vfb->instrument_map[instrument].step[slot]=0;
+  vfb->instrument_map[instrument].note[slot]=note;
+  vfb->instrument_map[instrument].note_on[slot]=2;
+  vfb->instrument_map[instrument].velocity[slot]=vel;
+  vfb->instrument_map[instrument].dirty_slots |= 1<<slot;
 
-  reg_write( 0x01, 0x02 ); /* LFO SYNC */
-  reg_write( 0x01, 0x00 );
+  reg_write( vfb, 0x01, 0x02 ); /* LFO SYNC */
+  reg_write( vfb, 0x01, 0x00 );
 
   return;
 }
 
-void ym2151_note_off( int instrument, int note ) {
+void ym2151_note_off( VFB_DATA *vfb, int instrument, int note ) {
 
   int slot;
 
-  for ( slot=0 ; slot < evfb->active_config.instruments[instrument].note_count; slot++ ) {
-	if (instrument_map[instrument].note[slot] == note ) {
-		instrument_map[instrument].note_on[slot]=0;
+  for ( slot=0 ; slot < vfb->active_config.instruments[instrument].note_count; slot++ ) {
+	if (vfb->instrument_map[instrument].note[slot] == note ) {
+		vfb->instrument_map[instrument].note_on[slot]=0;
+		vfb->instrument_map[instrument].dirty_slots |= 1<<slot;
 	}
   }
 
   return;
 }
 
-void ym2151_set_system_volume( int val ) {
+void ym2151_set_system_volume( VFB_DATA *vfb, int val ) {
+
+  int i;
 
   if ( val > 127 ) val = 127;
   if ( val <   0 ) val = 0;
 
-  system_volume = val;
+  vfb->system_volume = val;
+  for ( i=0 ; i<VFB_MAX_FM_SLOTS ; i++ )
+	vfb->instrument_map[i].dirty_slots = VFB_ALL_SLOTS_DIRTY;
 
   return;
 }
 
-void ym2151_set_master_volume( int instrument, int val ) {
+void ym2151_set_master_volume( VFB_DATA *vfb, int instrument, int val ) {
 
   if ( val < 0 ) val = 0;
   if ( val > 127 ) val = 127;
-  instrument_map[instrument].master_volume = val;
+  vfb->instrument_map[instrument].master_volume = val;
+  vfb->instrument_map[instrument].dirty_slots = VFB_ALL_SLOTS_DIRTY;
 
   return;
 }
 
-void ym2151_set_expression( int instrument, int val ) {
+void ym2151_set_expression( VFB_DATA *vfb, int instrument, int val ) {
 
   if ( val < 0 ) val = 0;
   if ( val > 127 ) val = 127;
-  instrument_map[instrument].expression = val;
+  vfb->instrument_map[instrument].expression = val;
+  vfb->instrument_map[instrument].dirty_slots = VFB_ALL_SLOTS_DIRTY;
 
   return;
 }
 
-void ym2151_set_bend_sensitivity( int instrument, int msb, int lsb ) {
+void ym2151_set_bend_sensitivity( VFB_DATA *vfb, int instrument, int msb, int lsb ) {
 
   if ( msb >= 0 ) {
 	if (msb>127) msb=127;
-	instrument_map[instrument].bend_sense_m = msb;
+	vfb->instrument_map[instrument].bend_sense_m = msb;
   }
   if ( lsb >= 0 ) {
 	if (lsb>127) lsb=127;
-	instrument_map[instrument].bend_sense_l = lsb;
+	vfb->instrument_map[instrument].bend_sense_l = lsb;
   }
+  vfb->instrument_map[instrument].dirty_slots = VFB_ALL_SLOTS_DIRTY;
 
   return;
 }
 
-void ym2151_set_bend( int instrument, int val ) {
+void ym2151_set_bend( VFB_DATA *vfb, int instrument, int val ) {
 
   val -= 8192;
   if ( val < -8192 ) val = -8192;
   if ( val > 8191 ) val = 8191;
   
-  instrument_map[instrument].bend = val;
+  vfb->instrument_map[instrument].bend = val;
+  vfb->instrument_map[instrument].dirty_slots = VFB_ALL_SLOTS_DIRTY;
   return;
 }
 
-void ym2151_set_portament( int instrument, int val ) {
+void ym2151_set_portament( VFB_DATA *vfb, int instrument, int val ) {
 
-	instrument_map[instrument].portament=val;
+	vfb->instrument_map[instrument].portament=val;
+	vfb->instrument_map[instrument].dirty_slots = VFB_ALL_SLOTS_DIRTY;
   return;
 }
 
-void ym2151_set_portament_on( int instrument, int val ) {
+void ym2151_set_portament_on( VFB_DATA *vfb, int instrument, int val ) {
 
-	instrument_map[instrument].portament_on=val;
+	vfb->instrument_map[instrument].portament_on=val;
   return;
 }
 
-void ym2151_set_hold( int instrument, int sw ) {
+void ym2151_set_hold( VFB_DATA *vfb, int instrument, int sw ) {
 
-	instrument_map[instrument].hold = sw;
+	vfb->instrument_map[instrument].hold = sw;
   return;
 }
 
-void ym2151_set_modulation_depth( int instrument, int val ) {
+void ym2151_set_modulation_depth( VFB_DATA *vfb, int instrument, int val ) {
 
   int i;
 
   if ( val > 127 ) val = 127;
   if ( val < 0 )   val = 0;
 
-  reg_write( 0x1b, 66&0x03 );
-  reg_write( 0x18, 212 );
-  reg_write( 0x19, val|0x80 ); /* PMD */
-  reg_write( 0x19, 9 ); /* AMD */
-  for ( i=0 ; i<evfb->active_config.instruments[instrument].note_count; i++ ) {
-	reg_write( 0x38+i + instrument_map[instrument].base_voice, 112 );
+  reg_write( vfb, 0x1b, 66&0x03 );
+  reg_write( vfb, 0x18, 212 );
+  reg_write( vfb, 0x19, val|0x80 ); /* PMD */
+  reg_write( vfb, 0x19, 9 ); /* AMD */
+  for ( i=0 ; i<vfb->active_config.instruments[instrument].note_count; i++ ) {
+	reg_write( vfb, 0x38+i + vfb->instrument_map[instrument].base_voice, 112 );
   }
 
   return;
 }
 
-void ym2151_set_voice( int instrument, int tone ) {
+void ym2151_set_voice( VFB_DATA *vfb, int instrument, int tone ) {
 
   int i,j,r;
   int slot;
   VOICE_DATA *v;
 
   if ( tone > VFB_MAX_TONE_NUMBER ) tone=0;
-  v = &evfb->voice[tone];
+  v = &vfb->voice[tone];
 
-  for ( slot=0 ; slot < evfb->active_config.instruments[instrument].note_count; slot++ ) {
+  for ( slot=0 ; slot < vfb->active_config.instruments[instrument].note_count; slot++ ) {
 
-	j = reg_read(  0x20+slot + instrument_map[instrument].base_voice );     /* LR, FL, CON */
-	reg_write( 0x20+slot + instrument_map[instrument].base_voice, (j&0xc0) + v->v0 );
-	instrument_map[instrument].algorithm = v->con;
-	instrument_map[instrument].slot_mask = v->slot_mask;
+	j = reg_read( vfb, 0x20+slot + vfb->instrument_map[instrument].base_voice );     /* LR, FL, CON */
+	reg_write( vfb, 0x20+slot + vfb->instrument_map[instrument].base_voice, (j&0xc0) + v->v0 );
+	vfb->instrument_map[instrument].algorithm = v->con;
+	vfb->instrument_map[instrument].slot_mask = v->slot_mask;
 	
 	for ( i=0 ; i<4 ; i++ ) {
-	  r = slot + i*8 + instrument_map[instrument].base_voice;
+	  r = slot + i*8 + vfb->instrument_map[instrument].base_voice;
 	  
-	  reg_write( 0x40+r, v->v1[i] );    /* DT1, MUL */
-	  reg_write( 0x80+r, v->v3[i] );    /* KS, AR */
-	  reg_write( 0xa0+r, v->v4[i] );    /* AME, D1R */
-	  reg_write( 0xc0+r, v->v5[i] );    /* DT2, D2R */
-	  reg_write( 0xe0+r, v->v6[i] );    /* SL, RR */
+	  reg_write( vfb, 0x40+r, v->v1[i] );    /* DT1, MUL */
+	  reg_write( vfb, 0x80+r, v->v3[i] );    /* KS, AR */
+	  reg_write( vfb, 0xa0+r, v->v4[i] );    /* AME, D1R */
+	  reg_write( vfb, 0xc0+r, v->v5[i] );    /* DT2, D2R */
+	  reg_write( vfb, 0xe0+r, v->v6[i] );    /* SL, RR */
 	  
-	  instrument_map[instrument].total_level[i] = 127 - v->v2[i];
-	  if ( is_vol_set[instrument_map[instrument].algorithm][i] == 0 )
-		reg_write( 0x60+r, v->v2[i]&0x7f );   /* TL */
+	  vfb->instrument_map[instrument].total_level[i] = 127 - v->v2[i];
+	  if ( is_vol_set[vfb->instrument_map[instrument].algorithm][i] == 0 )
+		reg_write( vfb, 0x60+r, v->v2[i]&0x7f );   /* TL */
 	  else
-		reg_write( 0x60+r, 127 );             /* TL */
+		reg_write( vfb, 0x60+r, 127 );             /* TL */
 	}
   }
+  vfb->instrument_map[instrument].dirty_slots = VFB_ALL_SLOTS_DIRTY;
 
   return;
 }
 
 /* ------------------------------------------------------------------- */
 
+/* The NOTE code of each semitone of an octave */
 static const int ym2151_note[] ={
   0,1,2,4,5,6,8,9,10,12,13,14
 };
 
-void ym2151_set_freq_volume( int instrument ) {
+/* Pitches are counted in 1/64 semitones, the resolution of KF */
+#define PITCH_SEMITONE  64
+#define PITCH_OCTAVE    (12*PITCH_SEMITONE)
+
+/*
+  Rewrites the pitch and volume registers of the slots that changed since
+  the last call. A portamento moves the pitch on every step, so it keeps
+  all slots of the instrument dirty. The step count of clean slots still
+  advances, as it decides which slot a new note takes over.
+ */
+
+void ym2151_set_freq_volume( VFB_DATA *vfb, int instrument ) {
 
   int slot;
+  int bend_pitch;
+  MIDI_MAP *map = &vfb->instrument_map[instrument];
 
-  for ( slot=0 ; slot < evfb->active_config.instruments[instrument].note_count ; slot++ ) {
-	freq_write(instrument, slot );
-	volume_write(instrument, slot );
+  if ( map->portament != 0 ) map->dirty_slots = VFB_ALL_SLOTS_DIRTY;
+
+  /* the same for all slots */
+  bend_pitch = map->bend_sense_m * 64 * map->bend / 8192;
+
+  for ( slot=0 ; slot < vfb->active_config.instruments[instrument].note_count ; slot++ ) {
+	if ( (map->dirty_slots & (1<<slot)) == 0 ) {
+	  map->step[slot]++;
+	  continue;
+	}
+	freq_write( vfb, instrument, slot, bend_pitch );
+	volume_write( vfb, instrument, slot );
   }
+  map->dirty_slots = 0;
 
   return;
 }
 
-static void freq_write( int instrument, int slot ) {
+static void freq_write( VFB_DATA *vfb, int instrument, int slot, int bend_pitch ) {
 
-  int oct, scale, kf;
-  int ofs_o, ofs_s, ofs_f;
-  long long f;
-  int c,d;
+  long long pitch, octave;
+  int oct, scale, kf, within;
+  int d;
   int key;
   int f1,f2,f3;
 
-  ofs_o = 0; /* octave offset */
-  ofs_s = 0; /* scale offset */
-  ofs_f = 0; /* detune offset */
+  vfb->instrument_map[instrument].step[slot]++;
 
-  instrument_map[instrument].step[slot]++;
+  /* The note, bend and portamento add up in 1/64 semitones, which */
+  /* then splits into OCT, NOTE and KF. Below the lowest and above */
+  /* the highest octave, only the octave is clamped. */
 
-  /* detune jobs */
+  d = vfb->instrument_map[instrument].note[slot]-15;
+  if ( d<0 ) d=0;
+  pitch = (long long)d*PITCH_SEMITONE + bend_pitch;
 
-  c = instrument_map[instrument].bend_sense_m * 64 * instrument_map[instrument].bend / 8192;
-  ofs_f += c%64;                      /* detune */
-  ofs_s += (c/64)%12;                 /* scale */
-  ofs_o += c/(64*12);                 /* octave */
-	
   /* portament jobs */
-	
-  if (instrument_map[instrument].portament != 0 ) {
-	f = instrument_map[instrument].portament*instrument_map[instrument].step[slot] / 256;
-	
-	ofs_f += f%64;          /* detune */
-	if ( ofs_f>63 ) {ofs_f-=64;c=1;}
-	else if (ofs_f<0 ) { ofs_f+=64;c=-1;}
-	else c=0;
 
-	ofs_s += c+(f/64)%12;   /* scale */
-	if ( ofs_s>11 ) {ofs_s-=12;c=1;}
-	else if (ofs_s<0 ) {ofs_s+=12;c=-1;}
-	else c=0;
+  if (vfb->instrument_map[instrument].portament != 0 )
+	pitch += vfb->instrument_map[instrument].portament*vfb->instrument_map[instrument].step[slot] / 256;
 
-	ofs_o += c+f/(64*12);   /* octave */
-  }
-	
   /* generate f-number */
 
-  kf = ofs_f;
-  c=0;
-  while ( kf > 63 ) { kf -= 64; c++; }
-  while ( kf <  0 ) { kf += 64; c--; }
-
-  d = instrument_map[instrument].note[slot]-15;
-  if ( d<0 ) d=0;
-  scale = c + (d%12) + ofs_s;
-  c=0;
-  while ( scale > 11 ) { scale-=12; c++; }
-  while ( scale <  0 ) { scale+=12; c--; }
+  if ( pitch >= 0 ) octave = pitch / PITCH_OCTAVE;
+  else octave = -1 - (-1 - pitch) / PITCH_OCTAVE;
+  within = (int)(pitch - octave*PITCH_OCTAVE);
 
-  scale = ym2151_note[scale];
+  kf = within % PITCH_SEMITONE;
+  scale = ym2151_note[within / PITCH_SEMITONE];
 
-  oct = c + (d/12) + ofs_o;
-  if ( oct>7 ) oct = 7;
-  else if ( oct<0 ) oct = 0;
+  if ( octave>7 ) oct = 7;
+  else if ( octave<0 ) oct = 0;
+  else oct = (int)octave;
 
 
   /* key on/off */
 
-  if (instrument_map[instrument].note_on[slot]==2 ) {
+  if (vfb->instrument_map[instrument].note_on[slot]==2 ) {
 	//if (instrument_map[instrument].hold==FLAG_TRUE ) {
-	  reg_write( 0x08, slot + instrument_map[instrument].base_voice);
+	  reg_write( vfb, 0x08, slot + vfb->instrument_map[instrument].base_voice);
 	//}
-	instrument_map[instrument].note_on[slot] = 1;
+	vfb->instrument_map[instrument].note_on[slot] = 1;
   }
-  if (instrument_map[instrument].note_on[slot] > 0 ||
-	   (instrument_map[instrument].note_on[slot]==0 ) ) { // && instrument_map[instrument].hold==FLAG_TRUE ) ) {
-	key= instrument_map[instrument].slot_mask<<3;
+  if (vfb->instrument_map[instrument].note_on[slot] > 0 ||
+	   (vfb->instrument_map[instrument].note_on[slot]==0 ) ) { // && instrument_map[instrument].hold==FLAG_TRUE ) ) {
+	key= vfb->instrument_map[instrument].slot_mask<<3;
   }
   else {
-	  instrument_map[instrument].note_on[slot]=-1;
+	  vfb->instrument_map[instrument].note_on[slot]=-1;
 	key=0;
   }
 
@@ -510,11 +499,11 @@ static void freq_write( int instrument, int slot ) {
   f2 = kf*4;
   f3 = key + slot;
 
-  reg_write( 0x28 + slot + instrument_map[instrument].base_voice, f1 );  /* OCT, NOTE */
-  reg_write( 0x30 + slot + instrument_map[instrument].base_voice, f2 );  /* KF */
-  reg_write( 0x08,        f3 + instrument_map[instrument].base_voice);  /* KEY ON */
+  reg_write( vfb, 0x28 + slot + vfb->instrument_map[instrument].base_voice, f1 );  /* OCT, NOTE */
+  reg_write( vfb, 0x30 + slot + vfb->instrument_map[instrument].base_voice, f2 );  /* KF */
+  reg_write( vfb, 0x08,        f3 + vfb->instrument_map[instrument].base_voice);  /* KEY ON */
 
-  /*reg_write( ch, 0x38 + slot + instrument_map[instrument].base_voice, 0x50 );   /* PMS:5, AMS:0 */
+  /*reg_write( ch, 0x38 + slot + vfb->instrument_map[instrument].base_voice, 0x50 );   PMS:5, AMS:0 */
 
   return;
 }
@@ -538,27 +527,27 @@ static int vol_table[128] = {
 	4,  3,  3,  3,  3,  2,  2,  2,  2,  2,  1,  1,  1,  1,  0,  0
 };
 
-static void volume_write( int instrument, int slot ) {
+static void volume_write( VFB_DATA *vfb, int instrument, int slot ) {
   int i,r,v;
   int vol;
   int velocity = 0;
 
   /* set volume */
 
-  if (instrument_map[instrument].velocity[slot] > 0 )
-	velocity = instrument_map[instrument].velocity[slot] / 2 + 63;
+  if (vfb->instrument_map[instrument].velocity[slot] > 0 )
+	velocity = vfb->instrument_map[instrument].velocity[slot] / 2 + 63;
   for ( i=0 ; i<4 ; i++ ) {
-	r = slot + i*8 + instrument_map[instrument].base_voice;
-	if ( is_vol_set[instrument_map[instrument].algorithm][i]==0 ) continue;
+	r = slot + i*8 + vfb->instrument_map[instrument].base_voice;
+	if ( is_vol_set[vfb->instrument_map[instrument].algorithm][i]==0 ) continue;
 	
-	vol = (int)((long)instrument_map[instrument].master_volume * instrument_map[instrument].expression * velocity * instrument_map[instrument].total_level[i]/127/127/127);
-	vol *= system_volume / 127;
+	vol = (int)((long)vfb->instrument_map[instrument].master_volume * vfb->instrument_map[instrument].expression * velocity * vfb->instrument_map[instrument].total_level[i]/127/127/127);
+	vol *= vfb->system_volume / 127;
 
 	if ( vol > 127 ) vol = 127;
 	if ( vol < 0 )   vol = 0;
 	v = vol_table[vol];
 	
-	reg_write( 0x60+r, v );                      /* TL */
+	reg_write( vfb, 0x60+r, v );                      /* TL */
   }
 
   return;
@@ -568,24 +557,68 @@ static void volume_write( int instrument, int slot ) {
 
 /* register actions */
 
-static void reg_write( int adr, int val ) {
+/*
+  Writes are checked against the shadow registers and queued rather than
+  sent to the emulator at once. A write that repeats the value already in
+  a register leaves the chip unchanged and is dropped. The exceptions are
+  0x01 (LFO reset) and 0x14 (timer flag reset), which act on every write.
+  For 0x08 (KON) the shadow holds the last channel and key bits written,
+  so a repeat of it is a no-op as well.
+
+  No samples are rendered between queueing and flushing, so the output is
+  the same as writing straight through.
+ */
+
+static void reg_write( VFB_DATA *vfb, int adr, int val ) {
 
   if ( adr > 0x0ff ) return;
   if ( adr < 0 ) return;
 
-  ym2151_register_map[adr] = val;
+  val &= 0xff;
+  if ( vfb->ym2151_register_map[adr] == val && adr != 0x01 && adr != 0x14 ) {
+	vfb->elided_writes++;
+	return;
+  }
+  vfb->ym2151_register_map[adr] = val;
+  if ( adr == 0x19 ) {
+	if ( val & 0x80 ) vfb->ym2151_pmd = val;
+	else vfb->ym2151_amd = val;
+  }
+
+  if ( vfb->pending_write_count == VFB_MAX_PENDING_WRITES ) {
+	ym2151_flush_writes( vfb );
+  }
+  vfb->pending_writes[vfb->pending_write_count++] = (uint16_t)((adr << 8) | val);
+
+  return;
+}
+
+void ym2151_flush_writes( VFB_DATA *vfb ) {
+
+  int i;
 
-  ym2151_write_reg( YMPSG, adr, val );
+  for ( i=0 ; i<vfb->pending_write_count ; i++ ) {
+	ym2151_write_reg( vfb->ym2151,
+			  vfb->pending_writes[i] >> 8, vfb->pending_writes[i] & 0xff );
+	if ( vfb->vgm_recorder != NULL )
+	  vfb_vgm_write( vfb, vfb->pending_writes[i] >> 8, vfb->pending_writes[i] & 0xff );
+  }
+  vfb->pending_write_count = 0;
 
   return;
 }
 
-static int reg_read( int adr ) {
+uint32_t ym2151_get_elided_writes( VFB_DATA *vfb ) {
+
+  return vfb->elided_writes;
+}
+
+static int reg_read( VFB_DATA *vfb, int adr ) {
 
   if ( adr > 0xff ) return 0;
   if ( adr < 0 ) return 0;
 
-  return ym2151_register_map[adr];
+  return vfb->ym2151_register_map[adr];
 }
 
 int setup_configuration(VFB_DATA *vfb) {
@@ -620,7 +653,7 @@ int setup_configuration(VFB_DATA *vfb) {
 	vfb->active_config.LFO_waveform = 0;
 
 	memset(vfb->active_config.name, 0, sizeof(vfb->active_config.name));
-	memcpy(vfb->active_config.name, "single", sizeof("single" - 1));
+	memcpy(vfb->active_config.name, "single", sizeof("single") - 1);
 	
 	return 0;
 }
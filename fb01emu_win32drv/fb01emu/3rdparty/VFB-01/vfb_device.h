@@ -10,38 +10,43 @@
 
 extern int ym2151_open( VFB_DATA * );
 
-extern void ym2151_all_note_off( int );
-extern void ym2151_note_on( int, int, int );
-extern void ym2151_note_off( int, int );
-extern void ym2151_set_pan( int, int );
-extern void ym2151_set_master_volume( int, int );
-extern void ym2151_set_expression( int, int );
-extern void ym2151_set_detune( int, int );
-extern void ym2151_set_portament( int, int );
-extern void ym2151_set_portament_on( int, int );
-extern void ym2151_set_noise_freq( int, int );
-extern void ym2151_set_voice( int, int );
-extern void ym2151_set_reg( int, int, int );
-
-extern void ym2151_set_plfo( int, int, int, int, int );
-extern void ym2151_set_alfo( int, int, int, int, int );
-extern void ym2151_set_lfo_delay( int, int );
-
-extern void ym2151_set_hlfo( int, int, int, int, int, int );
-extern void ym2151_set_hlfo_onoff( int, int );
-
-extern void ym2151_set_system_volume(int val);
-extern void ym2151_set_freq_volume(int ch);
-extern void ym2151_set_bend(int ch, int val);
-extern void ym2151_set_modulation_depth(int ch, int val);
-extern void ym2151_set_bend_sensitivity(int ch, int msb, int lsb);
-extern void ym2151_set_hold(int ch, int sw);
+extern void ym2151_all_note_off( VFB_DATA *, int );
+extern void ym2151_note_on( VFB_DATA *, int, int, int );
+extern void ym2151_note_off( VFB_DATA *, int, int );
+extern void ym2151_set_pan( VFB_DATA *, int, int );
+extern void ym2151_set_master_volume( VFB_DATA *, int, int );
+extern void ym2151_set_expression( VFB_DATA *, int, int );
+extern void ym2151_set_detune( VFB_DATA *, int, int );
+extern void ym2151_set_portament( VFB_DATA *, int, int );
+extern void ym2151_set_portament_on( VFB_DATA *, int, int );
+extern void ym2151_set_noise_freq( VFB_DATA *, int, int );
+extern void ym2151_set_voice( VFB_DATA *, int, int );
+extern void ym2151_set_reg( VFB_DATA *, int, int, int );
+
+extern void ym2151_set_plfo( VFB_DATA *, int, int, int, int, int );
+extern void ym2151_set_alfo( VFB_DATA *, int, int, int, int, int );
+extern void ym2151_set_lfo_delay( VFB_DATA *, int, int );
+
+extern void ym2151_set_hlfo( VFB_DATA *, int, int, int, int, int, int );
+extern void ym2151_set_hlfo_onoff( VFB_DATA *, int, int );
+
+extern void ym2151_set_system_volume(VFB_DATA *vfb, int val);
+extern void ym2151_set_freq_volume(VFB_DATA *vfb, int ch);
+extern void ym2151_set_bend(VFB_DATA *vfb, int ch, int val);
+extern void ym2151_set_modulation_depth(VFB_DATA *vfb, int ch, int val);
+extern void ym2151_set_bend_sensitivity(VFB_DATA *vfb, int ch, int msb, int lsb);
+extern void ym2151_set_hold(VFB_DATA *vfb, int ch, int sw);
+
+extern void ym2151_flush_writes(VFB_DATA *vfb);
+extern uint32_t ym2151_get_elided_writes(VFB_DATA *vfb);
 
 extern int setup_ym2151(VFB_DATA *vfb);
-extern int reset_ym2151(void);
+extern int reset_ym2151(VFB_DATA *vfb);
+extern void close_ym2151(VFB_DATA *vfb);
 
 extern int setup_voices(VFB_DATA *vfb);
 extern int setup_configuration(VFB_DATA *vfb);
-extern int allocate_base_voices(void);
+extern int allocate_base_voices(VFB_DATA *vfb);
+extern int update_voice(VFB_DATA *vfb, int v);
 
 #endif /* _MDX2151_H_ */
@@ -26,6 +26,7 @@
 #include "config.h"
 #endif /* HAVE_CONFIG_H */
 
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -78,10 +79,6 @@ VOICE_DATA sample = {
 
 /* ------------------------------------------------------------------- */
 
-static int iserror = FLAG_FALSE;
-
-/* ------------------------------------------------------------------- */
-
 static int skipLine( FILE *fp ) {
   int c;
 
@@ -95,7 +92,7 @@ static int skipLine( FILE *fp ) {
 	if ( c=='\r' ) break;
   }
 
-  return;
+  return 0;
 }
 
 static int getUInt( FILE *fp ) {
@@ -125,19 +122,19 @@ static int getUInt( FILE *fp ) {
   ungetc( c, fp );
   buf[i] = '\0';
 
-  c = atoi(buf);
+  c = atoi((char *)buf);
   return c;
 }
 
-static int getUIntm( FILE *fp, int max ) {
+static int getUIntm( FILE *fp, int max, int *iserror ) {
   int ret;
 
-  if ( iserror == FLAG_TRUE ) return 0;
+  if ( *iserror == FLAG_TRUE ) return 0;
 
   ret = getUInt(fp);
   if ( ret > max ) ret = max;
   if ( ret < 0 ) {
-	iserror = FLAG_TRUE;
+	*iserror = FLAG_TRUE;
 	ret = 0;
   }
 
@@ -242,6 +239,7 @@ int setup_voices( VFB_DATA *vfb ) {
   int num;
   VOICE_DATA *v;
   int i;
+  int iserror;
 
   for ( num=0 ; num<VFB_MAX_TONE_NUMBER ; num++ ) {
 	initVoice( vfb, num );
@@ -261,22 +259,22 @@ int setup_voices( VFB_DATA *vfb ) {
 	v->voice_number = num;
 
 	for ( i=0 ; i<4 ; i++ ) {
-	  v->ar[i]  = getUIntm( fp, 31 );
-	  v->d1r[i] = getUIntm( fp, 31 );
-	  v->d2r[i] = getUIntm( fp, 31 );
-	  v->rr[i]  = getUIntm( fp, 15 );
-	  v->sl[i]  = getUIntm( fp, 15 );
-	  v->tl[i]  = getUIntm( fp, 127);
-	  v->ks[i]  = getUIntm( fp, 1  );
-	  v->mul[i] = getUIntm( fp, 15 );
-	  v->dt1[i] = getUIntm( fp, 7 );
-	  v->dt2[i] = getUIntm( fp, 3 );
-	  v->ame[i] = getUIntm( fp, 1 );
+	  v->ar[i]  = getUIntm( fp, 31, &iserror );
+	  v->d1r[i] = getUIntm( fp, 31, &iserror );
+	  v->d2r[i] = getUIntm( fp, 31, &iserror );
+	  v->rr[i]  = getUIntm( fp, 15, &iserror );
+	  v->sl[i]  = getUIntm( fp, 15, &iserror );
+	  v->tl[i]  = getUIntm( fp, 127, &iserror );
+	  v->ks[i]  = getUIntm( fp, 1, &iserror );
+	  v->mul[i] = getUIntm( fp, 15, &iserror );
+	  v->dt1[i] = getUIntm( fp, 7, &iserror );
+	  v->dt2[i] = getUIntm( fp, 3, &iserror );
+	  v->ame[i] = getUIntm( fp, 1, &iserror );
 	  if ( iserror == FLAG_TRUE ) goto parse_failed;
 	}
-	v->con = getUIntm( fp, 7 );
-	v->fl  = getUIntm( fp, 7 );
-	v->slot_mask = getUIntm( fp, 15 );
+	v->con = getUIntm( fp, 7, &iserror );
+	v->fl  = getUIntm( fp, 7, &iserror );
+	v->slot_mask = getUIntm( fp, 15, &iserror );
 	if ( iserror == FLAG_TRUE ) goto parse_failed;
 
 	v->v0      = (v->fl&0x07<<3) | (v->con&0x07);
@@ -0,0 +1,183 @@
+/*
+  VFB-01 : Virtual FB-01 emulator
+
+  VGM recorder: the YM2151 register writes and the frames rendered
+  between them, as a VGM 1.51 command stream.
+
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vfb01.h"
+#include "vfb_device.h"
+#include "vfb_vgm.h"
+
+/* ------------------------------------------------------------------- */
+
+typedef struct _VFB_VGM {
+  FILE *fp;
+  uint32_t total_samples;
+  uint32_t pending_wait;    /* frames rendered since the last command */
+  int error;
+} VFB_VGM;
+
+/* ------------------------------------------------------------------- */
+
+static void put_bytes( VFB_VGM *vgm, const uint8_t *data, size_t length ) {
+
+  if ( fwrite( data, 1, length, vgm->fp ) != length ) vgm->error = FLAG_TRUE;
+}
+
+static void put_le32( uint8_t *p, uint32_t v ) {
+
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+/* Waits are only written when the next command comes, as few as possible */
+static void put_wait( VFB_VGM *vgm ) {
+
+  uint8_t cmd[3];
+  uint32_t n;
+
+  while ( vgm->pending_wait > 0 ) {
+	n = vgm->pending_wait;
+	if ( n <= 16 ) {
+	  cmd[0] = (uint8_t)(VFB_VGM_CMD_WAIT_SHORT + n - 1);
+	  put_bytes( vgm, cmd, 1 );
+	}
+	else if ( n == 735 ) {
+	  cmd[0] = VFB_VGM_CMD_WAIT_735;
+	  put_bytes( vgm, cmd, 1 );
+	}
+	else if ( n == 882 ) {
+	  cmd[0] = VFB_VGM_CMD_WAIT_882;
+	  put_bytes( vgm, cmd, 1 );
+	}
+	else {
+	  if ( n > 0xffff ) n = 0xffff;
+	  cmd[0] = VFB_VGM_CMD_WAIT;
+	  cmd[1] = (uint8_t)n;
+	  cmd[2] = (uint8_t)(n >> 8);
+	  put_bytes( vgm, cmd, 3 );
+	}
+	vgm->pending_wait -= n;
+  }
+}
+
+static void put_write( VFB_VGM *vgm, int adr, int val ) {
+
+  uint8_t cmd[3];
+
+  put_wait( vgm );
+  cmd[0] = VFB_VGM_CMD_YM2151;
+  cmd[1] = (uint8_t)adr;
+  cmd[2] = (uint8_t)val;
+  put_bytes( vgm, cmd, 3 );
+}
+
+/* ------------------------------------------------------------------- */
+
+int vfb_vgm_open( VFB_DATA *vfb, const char *file_name ) {
+
+  VFB_VGM *vgm;
+  uint8_t header[VFB_VGM_HEADER_SIZE];
+  int adr;
+
+  vfb_vgm_close( vfb );
+  if ( vfb->dsp_speed != VFB_VGM_SAMPLE_RATE ) return 1;
+
+  vgm = (VFB_VGM *)calloc( 1, sizeof(VFB_VGM) );
+  if ( vgm == NULL ) return 1;
+  vgm->fp = fopen( file_name, "wb" );
+  if ( vgm->fp == NULL ) {
+	free( vgm );
+	return 1;
+  }
+
+  /* the header is completed by vfb_vgm_close() */
+  memset( header, 0, sizeof(header) );
+  put_bytes( vgm, header, sizeof(header) );
+
+  /* The chip state, from the shadow registers. KON, the timers and */
+  /* the test register only act when written, so they are left out. */
+  /* 0x19 is both AMD and PMD, which have a shadow each.             */
+  ym2151_flush_writes( vfb );
+  for ( adr=0x0f ; adr<0x100 ; adr++ ) {
+	if ( adr >= 0x10 && adr <= 0x14 ) continue;
+	if ( adr == 0x19 ) {
+	  if ( vfb->ym2151_amd >= 0 ) put_write( vgm, adr, vfb->ym2151_amd );
+	  if ( vfb->ym2151_pmd >= 0 ) put_write( vgm, adr, vfb->ym2151_pmd );
+	  continue;
+	}
+	if ( vfb->ym2151_register_map[adr] < 0 ) continue;
+	put_write( vgm, adr, vfb->ym2151_register_map[adr] );
+  }
+
+  vfb->vgm_recorder = vgm;
+
+  return 0;
+}
+
+int vfb_vgm_close( VFB_DATA *vfb ) {
+
+  VFB_VGM *vgm = (VFB_VGM *)vfb->vgm_recorder;
+  uint8_t header[VFB_VGM_HEADER_SIZE];
+  uint8_t end = VFB_VGM_CMD_END;
+  long size;
+  int error;
+
+  if ( vgm == NULL ) return 0;
+  vfb->vgm_recorder = NULL;
+
+  put_wait( vgm );
+  put_bytes( vgm, &end, 1 );
+
+  size = ftell( vgm->fp );
+  memset( header, 0, sizeof(header) );
+  memcpy( header, "Vgm ", 4 );
+  put_le32( header + VFB_VGM_OFS_EOF, (uint32_t)(size - VFB_VGM_OFS_EOF) );
+  put_le32( header + VFB_VGM_OFS_VERSION, VFB_VGM_VERSION );
+  put_le32( header + VFB_VGM_OFS_TOTAL_SAMPLES, vgm->total_samples );
+  put_le32( header + VFB_VGM_OFS_YM2151_CLOCK, VFB_YM2151_CLOCK );
+  put_le32( header + VFB_VGM_OFS_DATA, VFB_VGM_HEADER_SIZE - VFB_VGM_OFS_DATA );
+  if ( size < 0 || fseek( vgm->fp, 0, SEEK_SET ) != 0 ) vgm->error = FLAG_TRUE;
+  else put_bytes( vgm, header, sizeof(header) );
+
+  if ( fclose( vgm->fp ) != 0 ) vgm->error = FLAG_TRUE;
+  error = vgm->error;
+  free( vgm );
+
+  return error;
+}
+
+void vfb_vgm_write( VFB_DATA *vfb, int adr, int val ) {
+
+  put_write( (VFB_VGM *)vfb->vgm_recorder, adr, val );
+}
+
+void vfb_vgm_wait( VFB_DATA *vfb, int frames ) {
+
+  VFB_VGM *vgm = (VFB_VGM *)vfb->vgm_recorder;
+
+  vgm->total_samples += frames;
+  vgm->pending_wait += frames;
+}
@@ -0,0 +1,60 @@
+/*
+  VFB-01 : Virtual FB-01 emulator
+
+  VGM recorder: the YM2151 register writes and the frames rendered
+  between them, as a VGM 1.51 command stream.
+
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef _VFB_VGM_H_
+#define _VFB_VGM_H_
+
+#include <stdint.h>
+
+/* ------------------------------------------------------------------- */
+
+#define VFB_VGM_HEADER_SIZE         0x80
+#define VFB_VGM_VERSION             0x151
+#define VFB_VGM_SAMPLE_RATE         44100   /* the time base of the wait commands */
+
+#define VFB_VGM_CMD_YM2151          0x54    /* 0x54 aa dd: write dd to register aa */
+#define VFB_VGM_CMD_WAIT            0x61    /* 0x61 nn nn: wait n samples, little-endian */
+#define VFB_VGM_CMD_WAIT_735        0x62
+#define VFB_VGM_CMD_WAIT_882        0x63
+#define VFB_VGM_CMD_END             0x66
+#define VFB_VGM_CMD_WAIT_SHORT      0x70    /* 0x7n: wait n+1 samples */
+
+#define VFB_VGM_OFS_EOF             0x04    /* header fields, uint32_t little-endian */
+#define VFB_VGM_OFS_VERSION         0x08
+#define VFB_VGM_OFS_TOTAL_SAMPLES   0x18
+#define VFB_VGM_OFS_YM2151_CLOCK    0x30
+#define VFB_VGM_OFS_DATA            0x34    /* relative to this field */
+
+/* ------------------------------------------------------------------- */
+
+/* Starts recording to file_name, first writing the register state the */
+/* chip is in. Notes already sounding are not in it. Nonzero on error. */
+extern int  vfb_vgm_open( VFB_DATA *vfb, const char *file_name );
+
+/* Completes the file and stops recording, nonzero if writing failed */
+extern int  vfb_vgm_close( VFB_DATA *vfb );
+
+/* The hooks: a register write reaching the chip, frames rendered */
+extern void vfb_vgm_write( VFB_DATA *vfb, int adr, int val );
+extern void vfb_vgm_wait( VFB_DATA *vfb, int frames );
+
+#endif /* _VFB_VGM_H_ */
@@ -18,23 +18,26 @@
 #ifndef MT32EMU_MIDI_EVENT_QUEUE_H
 #define MT32EMU_MIDI_EVENT_QUEUE_H
 
+#include <atomic>
+
 #include "globals.h"
 #include "Types.h"
+#include "Synth.h"
 
 namespace MT32Emu {
 
 /**
  * Used to safely store timestamped MIDI events in a local queue.
+ * The SysEx data is owned by the queue, see MidiEventQueue::allocateSysex().
  */
 struct MidiEvent {
 	Bit32u shortMessageData;
 	const Bit8u *sysexData;
 	Bit32u sysexLength;
-	Bit32u timestamp;
+	Bit64u timestamp;
 
-	~MidiEvent();
-	void setShortMessage(Bit32u shortMessageData, Bit32u timestamp);
-	void setSysex(const Bit8u *sysexData, Bit32u sysexLength, Bit32u timestamp);
+	void setShortMessage(Bit32u shortMessageData, Bit64u timestamp);
+	void setSysex(const Bit8u *sysexData, Bit32u sysexLength, Bit64u timestamp);
 };
 
 /**
@@ -43,24 +46,49 @@ struct MidiEvent {
  * - get rid of prerenderer while retaining graceful partial abortion
  * - add fair emulation of the MIDI interface delays
  * - extend the synth interface with the default implementation of a typical rendering loop.
+ * SysEx data is copied into a preallocated byte ring, so that enqueueing never allocates memory.
  * THREAD SAFETY:
- * It is safe to use either in a single thread environment or when there are only two threads - one performs only reading
- * and one performs only writing. More complicated usage requires external synchronisation.
+ * Any number of threads may push events concurrently without locking, while a single thread reads them
+ * (peekMidiEvent() and dropMidiEvent()). reset() must not run concurrently with any other method.
  */
 class MidiEventQueue {
 private:
-	MidiEvent * const ringBuffer;
+	struct Slot {
+		// Equals the queue position this slot is free for, or that position + 1 once the event in it is published
+		std::atomic<Bit32u> sequence;
+		MidiEvent event;
+	};
+
+	Slot * const ringBuffer;
 	const Bit32u ringBufferMask;
-	volatile Bit32u startPosition;
-	volatile Bit32u endPosition;
+	// Free-running position of the next event to read, only used by the reader
+	Bit32u startPosition;
+	// Free-running position of the next event to write in the low word, end of the SysEx data in the high word.
+	// Writers reserve an event slot and its SysEx block with a single CAS, so the blocks lie in queue order.
+	std::atomic<Bit64u> endPositions;
+
+	// The SysEx data of the queued events. Only the reader moves sysexStartPosition;
+	// it is equal to the SysEx end position when no SysEx is queued.
+	Bit8u * const sysexStorage;
+	const Bit32u sysexStorageSize;
+	std::atomic<Bit32u> sysexStartPosition;
+
+	Bit32u placeSysex(Bit32u sysexPosition, Bit32u sysexLength) const;
+	bool allocateSysex(Bit32u &sysexPosition, Bit32u sysexLength) const;
 
 public:
-	MidiEventQueue(Bit32u ringBufferSize = DEFAULT_MIDI_EVENT_QUEUE_SIZE); // Must be a power of 2
+	MidiEventQueue(Bit32u ringBufferSize = DEFAULT_MIDI_EVENT_QUEUE_SIZE, Bit32u sysexStorageSize = DEFAULT_SYSEX_STORAGE_SIZE); // ringBufferSize must be a power of 2
 	~MidiEventQueue();
 	void reset();
-	bool pushShortMessage(Bit32u shortMessageData, Bit32u timestamp);
-	bool pushSysex(const Bit8u *sysexData, Bit32u sysexLength, Bit32u timestamp);
+	bool pushShortMessage(Bit32u shortMessageData, Bit64u timestamp);
+	bool pushSysex(const Bit8u *sysexData, Bit32u sysexLength, Bit64u timestamp);
+	// Enqueues the leading events of the array that fit, all at once. Returns the number of events enqueued.
+	Bit32u pushEvents(const Synth::Event *events, Bit32u count);
 	const MidiEvent *peekMidiEvent();
+	// Returns the event offset places after the next one to read, NULL if that one isn't published. Reader only.
+	const MidiEvent *peekMidiEvent(Bit32u offset) const;
+	// Whether the queue, once emptied, takes eventCount events with sysexLength bytes of SysEx data between them
+	bool canHold(Bit32u eventCount, Bit32u sysexLength) const;
 	void dropMidiEvent();
 	bool isFull() const;
 	bool inline isEmpty() const;
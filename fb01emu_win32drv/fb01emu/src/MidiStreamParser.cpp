@@ -29,6 +29,11 @@ DefaultMidiStreamParser::DefaultMidiStreamParser(Synth &useSynth, Bit32u initial
 	MidiStreamParser(initialStreamBufferCapacity), synth(useSynth), timestampSet(false) {}
 
 void DefaultMidiStreamParser::setTimestamp(const Bit32u useTimestamp) {
+	timestampSet = true;
+	timestamp = synth.extendTimestamp(useTimestamp);
+}
+
+void DefaultMidiStreamParser::setTimestamp64(const Bit64u useTimestamp) {
 	timestampSet = true;
 	timestamp = useTimestamp;
 }
@@ -40,7 +45,7 @@ void DefaultMidiStreamParser::resetTimestamp() {
 void DefaultMidiStreamParser::handleShortMessage(const Bit32u message) {
 	do {
 		if (timestampSet) {
-			if (synth.playMsg(message, timestamp)) return;
+			if (synth.playMsg64(message, timestamp)) return;
 		}
 		else {
 			if (synth.playMsg(message)) return;
@@ -51,7 +56,7 @@ void DefaultMidiStreamParser::handleShortMessage(const Bit32u message) {
 void DefaultMidiStreamParser::handleSysex(const Bit8u *stream, const Bit32u length) {
 	do {
 		if (timestampSet) {
-			if (synth.playSysex(stream, length, timestamp)) return;
+			if (synth.playSysex64(stream, length, timestamp)) return;
 		}
 		else {
 			if (synth.playSysex(stream, length)) return;
@@ -105,6 +105,7 @@ class MT32EMU_EXPORT DefaultMidiStreamParser : public MidiStreamParser {
 public:
 	explicit DefaultMidiStreamParser(Synth &synth, Bit32u initialStreamBufferCapacity = SYSEX_BUFFER_SIZE);
 	void setTimestamp(const Bit32u useTimestamp);
+	void setTimestamp64(const Bit64u useTimestamp);
 	void resetTimestamp();
 
 protected:
@@ -116,7 +117,7 @@ protected:
 private:
 	Synth &synth;
 	bool timestampSet;
-	Bit32u timestamp;
+	Bit64u timestamp;
 };
 
 } // namespace MT32Emu
@@ -15,18 +15,21 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <chrono>
 #include <cstdio>
+#include <cstdlib>
 
 #include "internals.h"
 
 #include "Synth.h"
 #include "MidiEventQueue.h"
 
-#include "Windows.h"
-
 extern "C"
 {
 #include "pcm8.h"
+#include "vfb_device.h"
+#include "vfb_vgm.h"
+#include "ym2151.h"
 }
 
 namespace MT32Emu {
@@ -62,9 +65,14 @@ Synth::Synth(ReportHandler *useReportHandler) {
 	}
 
 	setMIDIDelayMode(MIDIDelayMode_DELAY_SHORT_MESSAGES_ONLY);
+	blockRendering = true;
+	vfb = NULL;
 	midiQueue = NULL;
 	lastReceivedMIDIEventTimestamp = 0;
 	renderedSampleCount = 0;
+	renderProfiling = false;
+	memset(&renderProfile, 0, sizeof(renderProfile));
+	renderProfileMark = 0;
 }
 
 Synth::~Synth() {
@@ -83,11 +91,17 @@ void ReportHandler::printDebug(const char *fmt, va_list list) {
 	printf("\n");
 }
 
+// Forwards the data dumps sent by the emulated unit to the ReportHandler
+static void onVfbMIDIOutput(void *context, const uint8_t *data, uint32_t length) {
+	static_cast<ReportHandler *>(context)->onMIDIOutput(data, length);
+}
+
 void Synth::printDebug(const char *fmt, ...) {
 	va_list ap;
 	va_start(ap, fmt);
 #if MT32EMU_DEBUG_SAMPLESTAMPS > 0
-	reportHandler->printDebug("[%u]", (va_list)&renderedSampleCount);
+	Bit64u sampleStamp = renderedSampleCount;
+	reportHandler->printDebug("[%llu]", (va_list)&sampleStamp);
 #endif
 	reportHandler->printDebug(fmt, ap);
 	va_end(ap);
@@ -101,27 +115,50 @@ MIDIDelayMode Synth::getMIDIDelayMode() const {
 	return midiDelayMode;
 }
 
+void Synth::setBlockRenderingEnabled(bool enabled) {
+	blockRendering = enabled;
+	if (opened) {
+		vfb->ym2151_block_render = enabled ? FLAG_TRUE : FLAG_FALSE;
+	}
+}
+
+bool Synth::isBlockRenderingEnabled() const {
+	return blockRendering;
+}
+
+Bit32u Synth::setChipSIMDLevel(Bit32u level) {
+	if (!opened) {
+		return 0;
+	}
+	return Bit32u(ym2151_set_simd_level(vfb->ym2151, int(level)));
+}
+
 bool Synth::open() {
 	if (opened) {
 		return false;
 	}
 
-	// TODO
-	vfb = (VFB_DATA *)malloc(sizeof(VFB_DATA));
+	// All emulation state lives in the VFB_DATA, so any number of synths can run side by side
+	vfb = (VFB_DATA *)calloc(1, sizeof(VFB_DATA));
 	if (vfb == NULL) {
 		return false;
 	}
 
-	verbose = FLAG_FALSE;
-	voice_parameter_file = VOICE_PARAMETER_NAME;
-
 	vfb->is_normal_exit = FLAG_TRUE;
-	vfb->verbose = verbose;
+	vfb->verbose = FLAG_FALSE;
 
-	vfb->voice_parameter_file = voice_parameter_file;
-	vfb->master_volume = master_volume;
+	vfb->voice_parameter_file = (char *)VOICE_PARAMETER_NAME;
+	vfb->master_volume = 127;
+	vfb->ym2151_block_render = blockRendering ? FLAG_TRUE : FLAG_FALSE;
+	vfb->midi_output = onVfbMIDIOutput;
+	vfb->midi_output_context = reportHandler;
 
-	vfb01_init(vfb, MAX_SAMPLES_PER_RUN);
+	if (vfb01_init(vfb, MAX_SAMPLES_PER_RUN)) {
+		vfb01_close(vfb);
+		free(vfb);
+		vfb = NULL;
+		return false;
+	}
 
 	midiQueue = new MidiEventQueue();
 
@@ -170,7 +207,7 @@ void Synth::flushMIDIQueue() {
 			}
 			midiQueue->dropMidiEvent();
 		}
-		lastReceivedMIDIEventTimestamp = renderedSampleCount;
+		lastReceivedMIDIEventTimestamp = renderedSampleCount.load();
 	}
 }
 
@@ -210,22 +247,39 @@ Bit32u Synth::getShortMessageLength(Bit32u msg) {
 	return ((msg & 0xE0) == 0xC0) ? 2 : 3;
 }
 
-Bit32u Synth::addMIDIInterfaceDelay(Bit32u len, Bit32u timestamp) {
+Bit64u Synth::addMIDIInterfaceDelay(Bit32u len, Bit64u timestamp) {
 	Bit32u transferTime =  Bit32u(double(len) * MIDI_DATA_TRANSFER_RATE);
-	// Dealing with wrapping
-	if (Bit32s(timestamp - lastReceivedMIDIEventTimestamp) < 0) {
-		timestamp = lastReceivedMIDIEventTimestamp;
-	}
-	timestamp += transferTime;
-	lastReceivedMIDIEventTimestamp = timestamp;
-	return timestamp;
+	// Several threads may enqueue at once, each message occupies the emulated interface in turn
+	Bit64u lastTimestamp = lastReceivedMIDIEventTimestamp.load(std::memory_order_relaxed);
+	Bit64u newTimestamp;
+	do {
+		newTimestamp = timestamp < lastTimestamp ? lastTimestamp : timestamp;
+		newTimestamp += transferTime;
+	} while (!lastReceivedMIDIEventTimestamp.compare_exchange_weak(lastTimestamp, newTimestamp, std::memory_order_relaxed));
+	return newTimestamp;
+}
+
+Bit64u Synth::extendTimestamp(Bit32u timestamp) const {
+	// The 32-bit timestamp is taken as the one nearest to the current sample count, within 2^31 samples either way
+	Bit64u now = renderedSampleCount.load(std::memory_order_relaxed);
+	Bit32s offset = Bit32s(timestamp - Bit32u(now));
+	if (offset < 0 && Bit64u(-Bit64s(offset)) > now) return 0;
+	return now + Bit64s(offset);
+}
+
+Bit64u Synth::getRenderedSampleCount() const {
+	return renderedSampleCount.load(std::memory_order_relaxed);
 }
 
 bool Synth::playMsg(Bit32u msg) {
-	return playMsg(msg, renderedSampleCount);
+	return playMsg64(msg, renderedSampleCount.load(std::memory_order_relaxed));
 }
 
 bool Synth::playMsg(Bit32u msg, Bit32u timestamp) {
+	return playMsg64(msg, extendTimestamp(timestamp));
+}
+
+bool Synth::playMsg64(Bit32u msg, Bit64u timestamp) {
 	if ((msg & 0xF8) == 0xF8) {
 		reportHandler->onMIDISystemRealtime(Bit8u(msg));
 		return true;
@@ -242,10 +296,14 @@ bool Synth::playMsg(Bit32u msg, Bit32u timestamp) {
 }
 
 bool Synth::playSysex(const Bit8u *sysex, Bit32u len) {
-	return playSysex(sysex, len, renderedSampleCount);
+	return playSysex64(sysex, len, renderedSampleCount.load(std::memory_order_relaxed));
 }
 
 bool Synth::playSysex(const Bit8u *sysex, Bit32u len, Bit32u timestamp) {
+	return playSysex64(sysex, len, extendTimestamp(timestamp));
+}
+
+bool Synth::playSysex64(const Bit8u *sysex, Bit32u len, Bit64u timestamp) {
 	if (midiQueue == NULL) return false;
 	if (midiDelayMode == MIDIDelayMode_DELAY_ALL) {
 		timestamp = addMIDIInterfaceDelay(len, timestamp);
@@ -257,6 +315,47 @@ bool Synth::playSysex(const Bit8u *sysex, Bit32u len, Bit32u timestamp) {
 	return false;
 }
 
+Bit32u Synth::playEvents(const Event *events, Bit32u count) {
+	// Events are enqueued in chunks, each with a single reservation in the queue
+	static const Bit32u MAX_EVENTS_PER_CHUNK = 64;
+	Event chunk[MAX_EVENTS_PER_CHUNK];
+	Bit32u played = 0;
+
+	if (midiQueue == NULL) return 0;
+	if (!activated) activated = true;
+	while (played < count) {
+		// System Realtime messages aren't enqueued, as in playMsg()
+		if (events[played].sysexData == NULL && (events[played].shortMessageData & 0xF8) == 0xF8) {
+			reportHandler->onMIDISystemRealtime(Bit8u(events[played].shortMessageData));
+			played++;
+			continue;
+		}
+
+		Bit32u chunkLength = 0;
+		while (chunkLength < MAX_EVENTS_PER_CHUNK && played + chunkLength < count) {
+			Event &event = chunk[chunkLength];
+			event = events[played + chunkLength];
+			if (event.sysexData == NULL) {
+				if ((event.shortMessageData & 0xF8) == 0xF8) break;
+				if (midiDelayMode != MIDIDelayMode_IMMEDIATE) {
+					event.timestamp = addMIDIInterfaceDelay(getShortMessageLength(event.shortMessageData), event.timestamp);
+				}
+			} else if (midiDelayMode == MIDIDelayMode_DELAY_ALL) {
+				event.timestamp = addMIDIInterfaceDelay(event.sysexLength, event.timestamp);
+			}
+			chunkLength++;
+		}
+
+		Bit32u pushed = midiQueue->pushEvents(chunk, chunkLength);
+		while (pushed < chunkLength && reportHandler->onMIDIQueueOverflow()) {
+			pushed += midiQueue->pushEvents(chunk + pushed, chunkLength - pushed);
+		}
+		played += pushed;
+		if (pushed < chunkLength) break;
+	}
+	return played;
+}
+
 void Synth::playMsgNow(Bit32u msg) {
 	if (!opened) return;
 
@@ -278,14 +377,16 @@ void Synth::playMsgNow(Bit32u msg) {
 		return;
 	}*/
 
-	::MidiEvent e;
+	::MidiMessage e;
 	e.ch = chan;
 	e.type = code << 4;
 	e.a = note;
 	e.b = velocity;
+	e.ex_buf = NULL;
+	e.ex_len = 0;
 
 	if (vfb != NULL)
-		vfb01_doMidiEvent( vfb, &e );
+		vfb01_doMidiMessage( vfb, &e );
 	//playMsgOnPart(part, code, note, velocity);
 }
 
@@ -308,14 +409,17 @@ void Synth::playSysexNow(const Bit8u *sysex, Bit32u len) {
 		printDebug("playSysex: Message lacks end-of-sysex (0xf7)");
 		return;
 	}
-	::MidiEvent e;
+	// The body is passed in place, from after the F0 up to and including the F7
+	::MidiMessage e;
 	e.ch = 0;
 	e.type = 0xF0;
-	for (Bit32u i = 1; i < len; i++)
-		e.ex_buf[i - 1] = sysex[i];
+	e.a = 0;
+	e.b = 0;
+	e.ex_buf = sysex + 1;
+	e.ex_len = endPos;
 
 	if (vfb != NULL)
-		vfb01_doMidiEvent(vfb, &e);
+		vfb01_doMidiMessage(vfb, &e);
 }
 
 void Synth::reset() {
@@ -327,83 +431,158 @@ void Synth::reset() {
 	isActive();
 }
 
-MidiEvent::~MidiEvent() {
-	if (sysexData != NULL) {
-		delete[] sysexData;
-	}
-}
-
-void MidiEvent::setShortMessage(Bit32u useShortMessageData, Bit32u useTimestamp) {
-	if (sysexData != NULL) {
-		delete[] sysexData;
-	}
+void MidiEvent::setShortMessage(Bit32u useShortMessageData, Bit64u useTimestamp) {
 	shortMessageData = useShortMessageData;
 	timestamp = useTimestamp;
 	sysexData = NULL;
 	sysexLength = 0;
 }
 
-void MidiEvent::setSysex(const Bit8u *useSysexData, Bit32u useSysexLength, Bit32u useTimestamp) {
-	if (sysexData != NULL) {
-		delete[] sysexData;
-	}
+void MidiEvent::setSysex(const Bit8u *useSysexData, Bit32u useSysexLength, Bit64u useTimestamp) {
 	shortMessageData = 0;
 	timestamp = useTimestamp;
 	sysexLength = useSysexLength;
-	Bit8u *dstSysexData = new Bit8u[sysexLength];
-	sysexData = dstSysexData;
-	memcpy(dstSysexData, useSysexData, sysexLength);
+	sysexData = useSysexData;
 }
 
-MidiEventQueue::MidiEventQueue(Bit32u useRingBufferSize) : ringBuffer(new MidiEvent[useRingBufferSize]), ringBufferMask(useRingBufferSize - 1) {
-	memset(ringBuffer, 0, useRingBufferSize * sizeof(MidiEvent));
+MidiEventQueue::MidiEventQueue(Bit32u useRingBufferSize, Bit32u useSysexStorageSize) :
+	ringBuffer(new Slot[useRingBufferSize]), ringBufferMask(useRingBufferSize - 1),
+	sysexStorage(new Bit8u[useSysexStorageSize]), sysexStorageSize(useSysexStorageSize)
+{
 	reset();
 }
 
 MidiEventQueue::~MidiEventQueue() {
 	delete[] ringBuffer;
+	delete[] sysexStorage;
 }
 
 void MidiEventQueue::reset() {
+	for (Bit32u i = 0; i <= ringBufferMask; i++) {
+		ringBuffer[i].event.setShortMessage(0, 0);
+		ringBuffer[i].sequence.store(i, std::memory_order_relaxed);
+	}
 	startPosition = 0;
-	endPosition = 0;
+	sysexStartPosition.store(0, std::memory_order_relaxed);
+	endPositions.store(0, std::memory_order_release);
 }
 
-bool MidiEventQueue::pushShortMessage(Bit32u shortMessageData, Bit32u timestamp) {
-	Bit32u newEndPosition = (endPosition + 1) & ringBufferMask;
-	// Is ring buffer full?
-	if (startPosition == newEndPosition) return false;
-	ringBuffer[endPosition].setShortMessage(shortMessageData, timestamp);
-	endPosition = newEndPosition;
-	return true;
+// The SysEx block goes right after sysexPosition, the current end of the queued data, or at the storage beginning
+// when the rest of the storage is too short; the skipped tail is reclaimed along with the last SysEx before it.
+Bit32u MidiEventQueue::placeSysex(Bit32u sysexPosition, Bit32u sysexLength) const {
+	return (sysexStorageSize - sysexPosition >= sysexLength) ? sysexPosition : 0;
 }
 
-bool MidiEventQueue::pushSysex(const Bit8u *sysexData, Bit32u sysexLength, Bit32u timestamp) {
-	Bit32u newEndPosition = (endPosition + 1) & ringBufferMask;
-	// Is ring buffer full?
-	if (startPosition == newEndPosition) return false;
-	ringBuffer[endPosition].setSysex(sysexData, sysexLength, timestamp);
-	endPosition = newEndPosition;
-	return true;
+// Moves sysexPosition to the block placeSysex() picks for the data. Returns false if the data doesn't fit now.
+bool MidiEventQueue::allocateSysex(Bit32u &sysexPosition, Bit32u sysexLength) const {
+	// Acquire: the reader is done with the data before this position
+	Bit32u mySysexStartPosition = sysexStartPosition.load(std::memory_order_acquire);
+
+	if (mySysexStartPosition > sysexPosition) {
+		// The free space is between the end and the start; keep the positions distinct, equal means empty
+		return mySysexStartPosition - sysexPosition > sysexLength;
+	}
+	if (sysexStorageSize - sysexPosition >= sysexLength) return true;
+	sysexPosition = 0;
+	return mySysexStartPosition > sysexLength;
+}
+
+Bit32u MidiEventQueue::pushEvents(const Synth::Event *events, Bit32u count) {
+	Bit64u myEndPositions = endPositions.load(std::memory_order_relaxed);
+	for (;;) {
+		const Bit32u position = Bit32u(myEndPositions);
+		Bit32u sysexPosition = Bit32u(myEndPositions >> 32);
+		Bit32u accepted = 0;
+		Bit32s lag = 0;
+
+		// Count the events that fit. The reader frees slots in order, so a free slot means all the previous ones are free.
+		while (accepted < count) {
+			lag = Bit32s(ringBuffer[(position + accepted) & ringBufferMask].sequence.load(std::memory_order_acquire) - (position + accepted));
+			// Is ring buffer full, or did another writer take this slot meanwhile?
+			if (lag != 0) break;
+			if (events[accepted].sysexData != NULL) {
+				// Is there no room for the data?
+				Bit32u blockPosition = sysexPosition;
+				if (!allocateSysex(blockPosition, events[accepted].sysexLength)) break;
+				sysexPosition = blockPosition + events[accepted].sysexLength;
+			}
+			accepted++;
+		}
+		if (lag > 0) {
+			myEndPositions = endPositions.load(std::memory_order_relaxed);
+			continue;
+		}
+		if (accepted == 0) return 0;
+
+		Bit64u newEndPositions = (Bit64u(sysexPosition) << 32) | Bit32u(position + accepted);
+		if (!endPositions.compare_exchange_weak(myEndPositions, newEndPositions, std::memory_order_relaxed)) continue;
+
+		// The slots and the SysEx blocks are ours now. Each event is published with release so that the reader sees its data.
+		sysexPosition = Bit32u(myEndPositions >> 32);
+		for (Bit32u i = 0; i < accepted; i++) {
+			const Synth::Event &event = events[i];
+			Slot &slot = ringBuffer[(position + i) & ringBufferMask];
+			if (event.sysexData != NULL) {
+				sysexPosition = placeSysex(sysexPosition, event.sysexLength);
+				Bit8u *dstSysexData = sysexStorage + sysexPosition;
+				memcpy(dstSysexData, event.sysexData, event.sysexLength);
+				slot.event.setSysex(dstSysexData, event.sysexLength, event.timestamp);
+				sysexPosition += event.sysexLength;
+			} else {
+				slot.event.setShortMessage(event.shortMessageData, event.timestamp);
+			}
+			slot.sequence.store(position + i + 1, std::memory_order_release);
+		}
+		return accepted;
+	}
+}
+
+bool MidiEventQueue::pushShortMessage(Bit32u shortMessageData, Bit64u timestamp) {
+	Synth::Event event = { timestamp, shortMessageData, NULL, 0 };
+	return pushEvents(&event, 1) != 0;
+}
+
+bool MidiEventQueue::pushSysex(const Bit8u *sysexData, Bit32u sysexLength, Bit64u timestamp) {
+	Synth::Event event = { timestamp, 0, sysexData, sysexLength };
+	return pushEvents(&event, 1) != 0;
 }
 
 const MidiEvent *MidiEventQueue::peekMidiEvent() {
-	return isEmpty() ? NULL : &ringBuffer[startPosition];
+	return isEmpty() ? NULL : &ringBuffer[startPosition & ringBufferMask].event;
+}
+
+const MidiEvent *MidiEventQueue::peekMidiEvent(Bit32u offset) const {
+	if (offset > ringBufferMask) return NULL;
+	const Slot &slot = ringBuffer[(startPosition + offset) & ringBufferMask];
+	return slot.sequence.load(std::memory_order_acquire) == startPosition + offset + 1 ? &slot.event : NULL;
+}
+
+bool MidiEventQueue::canHold(Bit32u eventCount, Bit32u sysexLength) const {
+	// From the empty state, SysEx blocks are placed one after another from the storage beginning
+	return eventCount <= ringBufferMask + 1 && sysexLength <= sysexStorageSize;
 }
 
 void MidiEventQueue::dropMidiEvent() {
 	// Is ring buffer empty?
-	if (startPosition != endPosition) {
-		startPosition = (startPosition + 1) & ringBufferMask;
+	if (isEmpty()) return;
+	Slot &slot = ringBuffer[startPosition & ringBufferMask];
+	if (slot.event.sysexData != NULL) {
+		// SysEx data is allocated in queue order, so this frees everything up to the end of this block
+		sysexStartPosition.store(Bit32u(slot.event.sysexData - sysexStorage) + slot.event.sysexLength, std::memory_order_release);
 	}
+	// Hand the slot over to the writer of the next lap
+	slot.sequence.store(startPosition + ringBufferMask + 1, std::memory_order_release);
+	startPosition++;
 }
 
 bool MidiEventQueue::isFull() const {
-	return startPosition == ((endPosition + 1) & ringBufferMask);
+	Bit32u position = Bit32u(endPositions.load(std::memory_order_relaxed));
+	return Bit32s(ringBuffer[position & ringBufferMask].sequence.load(std::memory_order_acquire) - position) < 0;
 }
 
+// An event that is reserved by a writer but not yet published counts as not there
 bool MidiEventQueue::isEmpty() const {
-	return startPosition == endPosition;
+	return ringBuffer[startPosition & ringBufferMask].sequence.load(std::memory_order_acquire) != startPosition + 1;
 }
 
 Bit32u Synth::getStereoOutputSampleRate() const {
@@ -411,39 +590,269 @@ Bit32u Synth::getStereoOutputSampleRate() const {
 }
 
 void Synth::render(Bit16s *stream, Bit32u len) {
-	Bit32u oldLen = len;
+	doRender(stream, len);
+}
 
-	while (len > 0) {
-		// We need to ensure zero-duration notes will play so add minimum 1-sample delay.
-		Bit32u thisLen = 1;
-		const MidiEvent *nextEvent = midiQueue->peekMidiEvent();
-		Bit32s samplesToNextEvent = (nextEvent != NULL) ? Bit32s(nextEvent->timestamp - renderedSampleCount) : MAX_SAMPLES_PER_RUN;
-		if (samplesToNextEvent > 0) {
-			thisLen = len > MAX_SAMPLES_PER_RUN ? MAX_SAMPLES_PER_RUN : len;
-			if (thisLen > Bit32u(samplesToNextEvent)) {
-				thisLen = samplesToNextEvent;
-			}
+void Synth::render(float *stream, Bit32u len) {
+	doRender(stream, len);
+}
+
+static inline void mixSamples(VFB_DATA *vfb, Bit16s *stream, Bit32u len) {
+	pcm8(vfb, stream, len);
+}
+
+static inline void mixSamples(VFB_DATA *vfb, float *stream, Bit32u len) {
+	pcm8_float(vfb, stream, len);
+}
+
+// The last stage of pcm8() and pcm8_float(), for the profiled path of doRender()
+static inline void mixOutput(VFB_DATA *vfb, Bit16s *stream, Bit32u len) {
+	pcm8_mix(vfb, stream, len);
+}
+
+static inline void mixOutput(VFB_DATA *vfb, float *stream, Bit32u len) {
+	pcm8_mix_float(vfb, stream, len);
+}
+
+static inline Bit64u profileClock() {
+	return Bit64u(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Time spent outside render() and skip() is not counted
+void Synth::startProfileSpan() {
+	if (renderProfiling) {
+		renderProfileMark = profileClock();
+	}
+}
+
+// Charges the time since the previous stage ended to this one
+void Synth::endProfileStage(Bit64u RenderProfile::*stage) {
+	if (renderProfiling) {
+		Bit64u now = profileClock();
+		renderProfile.*stage += now - renderProfileMark;
+		renderProfileMark = now;
+	}
+}
+
+Bit32u Synth::nextSegment(Bit64u now, Bit64u maxLen) {
+	// We need to ensure zero-duration notes will play so add minimum 1-sample delay.
+	Bit32u thisLen = 1;
+	const MidiEvent *nextEvent = midiQueue->peekMidiEvent();
+	endProfileStage(&RenderProfile::queue);
+	if (nextEvent == NULL || nextEvent->timestamp > now) {
+		thisLen = Bit32u(maxLen);
+		if (nextEvent != NULL && nextEvent->timestamp - now < thisLen) {
+			thisLen = Bit32u(nextEvent->timestamp - now);
+		}
+	}
+	else {
+		if (nextEvent->sysexData == NULL) {
+			playMsgNow(nextEvent->shortMessageData);
+			endProfileStage(&RenderProfile::events);
+			// If a poly is aborting we don't drop the event from the queue.
+			// Instead, we'll return to it again when the abortion is done.
+			midiQueue->dropMidiEvent();
 		}
 		else {
-			if (nextEvent->sysexData == NULL) {
-				playMsgNow(nextEvent->shortMessageData);
-				// If a poly is aborting we don't drop the event from the queue.
-				// Instead, we'll return to it again when the abortion is done.
-				midiQueue->dropMidiEvent();
-			}
-			else {
-				playSysexNow(nextEvent->sysexData, nextEvent->sysexLength);
-				midiQueue->dropMidiEvent();
-			}
+			playSysexNow(nextEvent->sysexData, nextEvent->sysexLength);
+			endProfileStage(&RenderProfile::events);
+			midiQueue->dropMidiEvent();
+		}
+		endProfileStage(&RenderProfile::queue);
+	}
+	return thisLen;
+}
+
+template <class Sample>
+void Synth::doRender(Sample *stream, Bit32u len) {
+	// The buffer is split at each event timestamp, so that every event takes effect at its exact sample position
+	// regardless of the buffer size. Segments never exceed MAX_SAMPLES_PER_RUN, the size of the pcm8 work buffers.
+	startProfileSpan();
+	while (len > 0) {
+		Bit64u now = renderedSampleCount.load(std::memory_order_relaxed);
+		Bit32u thisLen = nextSegment(now, len > MAX_SAMPLES_PER_RUN ? MAX_SAMPLES_PER_RUN : len);
+		if (renderProfiling) {
+			// pcm8() stage by stage; its own flush is then a no-op
+			ym2151_flush_writes(vfb);
+			endProfileStage(&RenderProfile::writes);
+			pcm8_run_opm(vfb, thisLen);
+			endProfileStage(&RenderProfile::chip);
+			mixOutput(vfb, stream, thisLen);
+			endProfileStage(&RenderProfile::mix);
+		} else {
+			mixSamples(vfb, stream, thisLen);
 		}
-		//pcm8((int8_t*)stream, thisLen);
-		//stream += thisLen*2;
+		stream += thisLen * 2;
+		len -= thisLen;
+		renderedSampleCount.store(now + thisLen, std::memory_order_relaxed);
+	}
+}
+
+void Synth::skip(Bit64u len) {
+	// Same segments as doRender(), except that nothing is rendered, so they may be as long as the gaps between events.
+	startProfileSpan();
+	while (len > 0) {
+		Bit64u now = renderedSampleCount.load(std::memory_order_relaxed);
+		Bit32u thisLen = nextSegment(now, len > MAX_SAMPLES_PER_SKIP ? MAX_SAMPLES_PER_SKIP : len);
+		pcm8_skip(vfb, thisLen);
+		endProfileStage(&RenderProfile::chip);
 		len -= thisLen;
-		renderedSampleCount += thisLen;
+		renderedSampleCount.store(now + thisLen, std::memory_order_relaxed);
 	}
+}
 
-	pcm8((int8_t*)stream, oldLen);
-	stream += oldLen *2;
+bool Synth::startVGMRecording(const char *fileName) {
+	if (!opened) {
+		return false;
+	}
+	return vfb_vgm_open(vfb, fileName) == 0;
+}
+
+bool Synth::stopVGMRecording() {
+	if (!opened) {
+		return false;
+	}
+	return vfb_vgm_close(vfb) == 0;
+}
+
+Bit32u Synth::getElidedRegisterWriteCount() const {
+	if (!opened) {
+		return 0;
+	}
+	return ym2151_get_elided_writes(vfb);
+}
+
+void Synth::getOperatorStateDigest(Bit8u *digest) const {
+	if (!opened) {
+		memset(digest, 0, 32);
+		return;
+	}
+	ym2151_get_operator_digest(vfb->ym2151, digest);
+}
+
+void Synth::setRenderProfilingEnabled(bool enabled) {
+	if (enabled && !renderProfiling) {
+		memset(&renderProfile, 0, sizeof(renderProfile));
+	}
+	renderProfiling = enabled;
+}
+
+void Synth::getRenderProfile(RenderProfile &profile) const {
+	profile = renderProfile;
+}
+
+// Snapshot layout, native byte order:
+// header: magic, version, total size (Bit32u each)
+// clock: renderedSampleCount, lastReceivedMIDIEventTimestamp (Bit64u each)
+// queue: event count (Bit32u), then per event timestamp (Bit64u), short message, SysEx length (Bit32u each) and the SysEx data
+// VFB-01: its snapshot size (Bit32u), then vfb01_save_state() data, which ends with the YM2151
+static const Bit32u STATE_MAGIC = 0x31304246; // "FB01" when stored little-endian
+static const Bit32u STATE_VERSION = 1;
+static const Bit32u STATE_HEADER_SIZE = 3 * 4 + 2 * 8 + 4;
+static const Bit32u STATE_EVENT_SIZE = 8 + 4 + 4;
+
+template <class T>
+static inline void putState(Bit8u *&p, T value) {
+	memcpy(p, &value, sizeof(T));
+	p += sizeof(T);
+}
+
+template <class T>
+static inline T getState(const Bit8u *&p) {
+	T value;
+	memcpy(&value, p, sizeof(T));
+	p += sizeof(T);
+	return value;
+}
+
+Bit32u Synth::saveState(Bit8u *buffer, Bit32u bufferSize) {
+	if (!opened) {
+		return 0;
+	}
+	// Events published by other threads after this count are not in the snapshot
+	Bit32u eventCount = 0;
+	Bit64u size = STATE_HEADER_SIZE + 4;
+	for (;;) {
+		const MidiEvent *event = midiQueue->peekMidiEvent(eventCount);
+		if (event == NULL) break;
+		size += STATE_EVENT_SIZE + event->sysexLength;
+		eventCount++;
+	}
+	Bit32u vfbSize = vfb01_save_state(vfb, NULL, 0);
+	size += vfbSize;
+	if (size > 0xFFFFFFFFu) {
+		return 0;
+	}
+	if (buffer == NULL || bufferSize < size) {
+		return Bit32u(size);
+	}
+
+	Bit8u *p = buffer;
+	putState<Bit32u>(p, STATE_MAGIC);
+	putState<Bit32u>(p, STATE_VERSION);
+	putState<Bit32u>(p, Bit32u(size));
+	putState<Bit64u>(p, renderedSampleCount.load(std::memory_order_relaxed));
+	putState<Bit64u>(p, lastReceivedMIDIEventTimestamp.load(std::memory_order_relaxed));
+	putState<Bit32u>(p, eventCount);
+	for (Bit32u i = 0; i < eventCount; i++) {
+		const MidiEvent *event = midiQueue->peekMidiEvent(i);
+		putState<Bit64u>(p, event->timestamp);
+		putState<Bit32u>(p, event->shortMessageData);
+		putState<Bit32u>(p, event->sysexLength);
+		if (event->sysexData != NULL) {
+			memcpy(p, event->sysexData, event->sysexLength);
+			p += event->sysexLength;
+		}
+	}
+	putState<Bit32u>(p, vfbSize);
+	vfb01_save_state(vfb, p, vfbSize);
+	return Bit32u(size);
+}
+
+bool Synth::loadState(const Bit8u *buffer, Bit32u bufferSize) {
+	if (!opened || buffer == NULL || bufferSize < STATE_HEADER_SIZE + 4) {
+		return false;
+	}
+	const Bit8u *p = buffer;
+	const Bit8u *end = buffer + bufferSize;
+	if (getState<Bit32u>(p) != STATE_MAGIC || getState<Bit32u>(p) != STATE_VERSION || getState<Bit32u>(p) != bufferSize) {
+		return false;
+	}
+	Bit64u useRenderedSampleCount = getState<Bit64u>(p);
+	Bit64u useLastReceivedMIDIEventTimestamp = getState<Bit64u>(p);
+	Bit32u eventCount = getState<Bit32u>(p);
+
+	// Validate the events before anything is changed
+	const Bit8u *events = p;
+	Bit64u sysexLength = 0;
+	for (Bit32u i = 0; i < eventCount; i++) {
+		if (Bit32u(end - p) < STATE_EVENT_SIZE) return false;
+		p += 8 + 4;
+		Bit32u length = getState<Bit32u>(p);
+		if (Bit32u(end - p) < length) return false;
+		p += length;
+		sysexLength += length;
+	}
+	if (Bit32u(end - p) < 4) return false;
+	Bit32u vfbSize = getState<Bit32u>(p);
+	if (Bit32u(end - p) != vfbSize) return false;
+	if (sysexLength > 0xFFFFFFFFu || !midiQueue->canHold(eventCount, Bit32u(sysexLength))) return false;
+	if (vfb01_load_state(vfb, p, vfbSize) != 0) return false;
+
+	midiQueue->reset();
+	p = events;
+	for (Bit32u i = 0; i < eventCount; i++) {
+		Event event;
+		event.timestamp = getState<Bit64u>(p);
+		event.shortMessageData = getState<Bit32u>(p);
+		event.sysexLength = getState<Bit32u>(p);
+		event.sysexData = event.sysexLength > 0 ? p : NULL;
+		p += event.sysexLength;
+		midiQueue->pushEvents(&event, 1);
+	}
+	renderedSampleCount.store(useRenderedSampleCount, std::memory_order_relaxed);
+	lastReceivedMIDIEventTimestamp.store(useLastReceivedMIDIEventTimestamp, std::memory_order_relaxed);
+	return true;
 }
 
 bool Synth::isActive() {
@@ -18,6 +18,7 @@
 #ifndef MT32EMU_SYNTH_H
 #define MT32EMU_SYNTH_H
 
+#include <atomic>
 #include <cstdarg>
 #include <cstddef>
 #include <cstring>
@@ -34,12 +35,6 @@ namespace MT32Emu {
 
 class MidiEventQueue;
 
-static int   verbose = FLAG_FALSE;
-static int   master_volume = 127;
-static char *voice_parameter_file;
-
-static VFB_DATA *vfb = NULL;
-
 // Class for the client to supply callbacks for reporting various errors and information
 class MT32EMU_EXPORT ReportHandler {
 public:
@@ -59,6 +54,9 @@ public:
 	virtual bool onMIDIQueueOverflow() { return false; }
 	// Callback invoked when a System Realtime MIDI message is detected at the input.
 	virtual void onMIDISystemRealtime(Bit8u /* systemRealtime */) {}
+	// Callback for the MIDI messages sent by the emulated unit, such as replies to data dump requests.
+	// Invoked from the rendering thread, or from the thread calling playSysexNow().
+	virtual void onMIDIOutput(const Bit8u * /* data */, Bit32u /* length */) {}
 	// Callbacks for reporting system events
 	virtual void onDeviceReset() {}
 	virtual void onDeviceReconfig() {}
@@ -74,22 +72,54 @@ public:
 class Synth {
 friend class DefaultMidiStreamParser;
 
+public:
+	// A timestamped MIDI event for playEvents(): a SysEx when sysexData is not NULL, otherwise a short message.
+	struct Event {
+		Bit64u timestamp;
+		Bit32u shortMessageData;
+		const Bit8u *sysexData;
+		Bit32u sysexLength;
+	};
+
+	// Time spent in each stage of render() and skip() while profiling is enabled, in nanoseconds.
+	struct RenderProfile {
+		Bit64u queue;  // taking the events from the MIDI queue
+		Bit64u events; // playing them, vfb01_doMidiMessage()
+		Bit64u writes; // the YM2151 register writes they queued, ym2151_flush_writes()
+		Bit64u chip;   // ym2151_update_block() or ym2151_update_one(), ym2151_skip() in skip()
+		Bit64u mix;    // conversion to the output format, pcm8_mix()
+	};
+
 private:
+	// State of the emulated FB-01, owned by this instance
+	VFB_DATA *vfb;
+
 	MidiEventQueue *midiQueue;
-	volatile Bit32u lastReceivedMIDIEventTimestamp;
-	volatile Bit32u renderedSampleCount;
+	std::atomic<Bit64u> lastReceivedMIDIEventTimestamp;
+	std::atomic<Bit64u> renderedSampleCount;
 
 	MIDIDelayMode midiDelayMode;
+	bool blockRendering;
 
 	bool opened;
 	bool activated;
 
+	bool renderProfiling;
+	RenderProfile renderProfile;
+	Bit64u renderProfileMark;
+
 	bool isDefaultReportHandler;
 	ReportHandler *reportHandler;
 
 	// **************************** Implementation methods **************************
 
-	Bit32u addMIDIInterfaceDelay(Bit32u len, Bit32u timestamp);
+	Bit64u addMIDIInterfaceDelay(Bit32u len, Bit64u timestamp);
+	Bit64u extendTimestamp(Bit32u timestamp) const;
+	Bit32u nextSegment(Bit64u now, Bit64u maxLen);
+	void startProfileSpan();
+	void endProfileStage(Bit64u RenderProfile::*stage);
+	template <class Sample>
+	void doRender(Sample *stream, Bit32u len);
 
 	void reset();
 	void dispose();
@@ -133,21 +163,31 @@ public:
 	// Enqueues a MIDI event for subsequent playback.
 	// The MIDI event will be processed not before the specified timestamp.
 	// The timestamp is measured as the global rendered sample count since the synth was created (at the native sample rate 32000 Hz).
+	// A 32-bit timestamp wraps around every 37 hours, it is taken as the nearest one to the current sample count (see getRenderedSampleCount()).
+	// Long running clients should rather use the 64-bit variants which never wrap.
 	// The minimum delay involves emulation of the delay introduced while the event is transferred via MIDI interface
 	// and emulation of the MCU busy-loop while it frees partials for use by a new Poly.
-	// Calls from multiple threads must be synchronised, although, no synchronisation is required with the rendering thread.
+	// These methods may be called from any number of threads at once without synchronisation, also with the rendering thread.
 	// The methods return false if the MIDI event queue is full and the message cannot be enqueued.
 
 	// Enqueues a single short MIDI message to play at specified time. The message must contain a status byte.
 	MT32EMU_EXPORT bool playMsg(Bit32u msg, Bit32u timestamp);
 	// Enqueues a single well formed System Exclusive MIDI message to play at specified time.
 	MT32EMU_EXPORT bool playSysex(const Bit8u *sysex, Bit32u len, Bit32u timestamp);
+	// Same as above but with a 64-bit timestamp.
+	MT32EMU_EXPORT bool playMsg64(Bit32u msg, Bit64u timestamp);
+	MT32EMU_EXPORT bool playSysex64(const Bit8u *sysex, Bit32u len, Bit64u timestamp);
 
 	// Enqueues a single short MIDI message to be processed ASAP. The message must contain a status byte.
 	MT32EMU_EXPORT bool playMsg(Bit32u msg);
 	// Enqueues a single well formed System Exclusive MIDI message to be processed ASAP.
 	MT32EMU_EXPORT bool playSysex(const Bit8u *sysex, Bit32u len);
 
+	// Enqueues an array of events, sorted by timestamp, with far less overhead per event than the methods above.
+	// The events are enqueued in order until the queue is full and ReportHandler::onMIDIQueueOverflow() gives up.
+	// Returns the number of leading events accepted.
+	MT32EMU_EXPORT Bit32u playEvents(const Event *events, Bit32u count);
+
 	// WARNING:
 	// The methods below don't ensure minimum 1-sample delay between sequential MIDI events,
 	// and a sequence of NoteOn and immediately succeeding NoteOff messages is always silent.
@@ -168,6 +208,16 @@ public:
 	// Returns current MIDI delay mode. See MIDIDelayMode for details.
 	MT32EMU_EXPORT MIDIDelayMode getMIDIDelayMode() const;
 
+	// Selects how the YM2151 is rendered: channel by channel over blocks of samples (the default),
+	// or all channels sample by sample (the reference implementation). Both produce identical output.
+	MT32EMU_EXPORT void setBlockRenderingEnabled(bool enabled);
+	MT32EMU_EXPORT bool isBlockRenderingEnabled() const;
+
+	// Selects the vector kernels of the block renderer: 0 - scalar, 1 - SSE2, 2 - AVX2. Requests above what the CPU
+	// supports are lowered to it. All produce identical output, the lower levels are selected to test the fallbacks.
+	// Only has an effect while open, returns the level now in use.
+	MT32EMU_EXPORT Bit32u setChipSIMDLevel(Bit32u level);
+
 	// Returns actual sample rate used in emulation of stereo analog circuitry of hardware units.
 	// See comment for render() below.
 	MT32EMU_EXPORT Bit32u getStereoOutputSampleRate() const;
@@ -178,11 +228,53 @@ public:
 	// getStereoOutputSampleRate() can be used to query actual sample rate of the output signal.
 	// The length is in frames, not bytes (in 16-bit stereo, one frame is 4 bytes). Uses NATIVE byte ordering.
 	MT32EMU_EXPORT void render(Bit16s *stream, Bit32u len);
+	// Same as above but outputs to a float stream, full scale is -1.0..1.0.
+	MT32EMU_EXPORT void render(float *stream, Bit32u len);
+
+	// Advances the synth by len frames without producing output, much faster than render(). Queued MIDI events within
+	// that span are played at their timestamps, while the YM2151 envelopes, LFO and phases are stepped ahead in closed form.
+	// Meant for seeking: the output that follows is close to, but not bit-identical with, rendering the same span.
+	MT32EMU_EXPORT void skip(Bit64u len);
+
+	// Returns the number of samples rendered since the synth was created, the time base of the MIDI event timestamps.
+	MT32EMU_EXPORT Bit64u getRenderedSampleCount() const;
+
+	// Writes a snapshot of the emulation state to buffer: the YM2151, the FB-01 configurations, voices and playing notes,
+	// the queued MIDI events and the sample clock. The snapshot is only written when bufferSize is large enough,
+	// the size needed is returned either way, so a call with a NULL buffer queries it. Returns 0 if the synth isn't open.
+	// Like render(), this must be synchronised with the rendering thread.
+	MT32EMU_EXPORT Bit32u saveState(Bit8u *buffer, Bit32u bufferSize);
+	// Restores a snapshot made by saveState() with this version of the library on a machine with the same byte order,
+	// in this synth or another open one. Settings such as the MIDI delay mode and block rendering are not part of it.
+	// Returns false, leaving everything as it was, if the snapshot is invalid or its events don't fit in the queue.
+	// Must not run concurrently with render() or with any thread enqueueing MIDI events.
+	MT32EMU_EXPORT bool loadState(const Bit8u *buffer, Bit32u bufferSize);
 
 	// Returns true if the synth is active and subsequent calls to render() may result in non-trivial output (i.e. silence).
 	// The synth is considered active when either there are pending MIDI events in the queue, there is at least one active partial,
 	// or the reverb is (somewhat unreliably) detected as being active.
 	MT32EMU_EXPORT bool isActive();
+
+	// Starts recording the YM2151 register writes to a VGM file, each at the sample it takes effect, while rendering.
+	// The file begins with the register state of the chip; notes already sounding are not in it.
+	// A recording in progress is finished first. Returns false if the file cannot be created.
+	// Like render(), this must be synchronised with the rendering thread.
+	MT32EMU_EXPORT bool startVGMRecording(const char *fileName);
+	// Completes the VGM file. Also done by close(). Returns false if writing the file failed.
+	MT32EMU_EXPORT bool stopVGMRecording();
+
+	// Returns the number of YM2151 register writes dropped since open() because they repeated the value already in the register.
+	MT32EMU_EXPORT Bit32u getElidedRegisterWriteCount() const;
+
+	// Fills digest with 32 bytes, one per YM2151 operator: a hash of its phase, envelope and key state.
+	// Regression tools compare these between renders to find where two emulation builds start to differ.
+	MT32EMU_EXPORT void getOperatorStateDigest(Bit8u *digest) const;
+
+	// Starts or stops timing the stages of render() and skip(), clearing the times on a start. The clock is read at every
+	// stage of every segment, which costs some speed and is included in the times, so this is meant for benchmarks.
+	MT32EMU_EXPORT void setRenderProfilingEnabled(bool enabled);
+	// Returns the stage times accumulated since profiling was enabled.
+	MT32EMU_EXPORT void getRenderProfile(RenderProfile &profile) const;
 }; // class Synth
 
 } // namespace MT32Emu
@@ -20,6 +20,8 @@
 
 namespace MT32Emu {
 
+typedef unsigned long long Bit64u;
+typedef   signed long long Bit64s;
 typedef unsigned int       Bit32u;
 typedef   signed int       Bit32s;
 typedef unsigned short int Bit16u;
@@ -71,6 +71,11 @@
  */
 #define MT32EMU_MAX_SAMPLES_PER_RUN 4096
 
+/* The maximum number of samples Synth::skip() advances the YM2151 at once.
+ * Nothing is rendered while skipping, so this only keeps the count within an int.
+ */
+#define MT32EMU_MAX_SAMPLES_PER_SKIP 0x40000000
+
 /* The default size of the internal MIDI event queue.
  * It holds the incoming MIDI events before the rendering engine actually processes them.
  * The main goal is to fairly emulate the real hardware behaviour which obviously
@@ -91,6 +96,12 @@
  */
 #define MT32EMU_SYSEX_BUFFER_SIZE 8192
 
+/* The default size of the storage for the SysEx data held in the MIDI event queue.
+ * A SysEx up to half this size can always be enqueued into an empty queue,
+ * a 48-voice FB-01 bank dump takes a little over 6K.
+ */
+#define MT32EMU_DEFAULT_SYSEX_STORAGE_SIZE 65536
+
 #if defined(__cplusplus) && MT32EMU_API_TYPE != 1
 
 namespace MT32Emu
@@ -104,6 +115,9 @@ const unsigned int DEFAULT_MAX_PARTIALS = MT32EMU_DEFAULT_MAX_PARTIALS;
 const unsigned int MAX_SAMPLES_PER_RUN = MT32EMU_MAX_SAMPLES_PER_RUN;
 #undef MT32EMU_MAX_SAMPLES_PER_RUN
 
+const unsigned int MAX_SAMPLES_PER_SKIP = MT32EMU_MAX_SAMPLES_PER_SKIP;
+#undef MT32EMU_MAX_SAMPLES_PER_SKIP
+
 const unsigned int DEFAULT_MIDI_EVENT_QUEUE_SIZE = MT32EMU_DEFAULT_MIDI_EVENT_QUEUE_SIZE;
 #undef MT32EMU_DEFAULT_MIDI_EVENT_QUEUE_SIZE
 
@@ -112,6 +126,9 @@ const unsigned int MAX_STREAM_BUFFER_SIZE = MT32EMU_MAX_STREAM_BUFFER_SIZE;
 
 const unsigned int SYSEX_BUFFER_SIZE = MT32EMU_SYSEX_BUFFER_SIZE;
 #undef MT32EMU_SYSEX_BUFFER_SIZE
+
+const unsigned int DEFAULT_SYSEX_STORAGE_SIZE = MT32EMU_DEFAULT_SYSEX_STORAGE_SIZE;
+#undef MT32EMU_DEFAULT_SYSEX_STORAGE_SIZE
 }
 
 #endif /* #if defined(__cplusplus) && MT32EMU_API_TYPE != 1 */
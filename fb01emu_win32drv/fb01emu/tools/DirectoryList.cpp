@@ -0,0 +1,63 @@
+/* Copyright (C) 2026 FB-01 Emulator contributors
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include "DirectoryList.h"
+
+namespace MT32Emu {
+
+bool listDirectory(const std::string &path, std::vector<std::string> &fileNames) {
+	fileNames.clear();
+#ifdef _WIN32
+	WIN32_FIND_DATAA findData;
+	HANDLE findHandle = FindFirstFileA((path + "\\*").c_str(), &findData);
+	if (findHandle == INVALID_HANDLE_VALUE) return false;
+	do {
+		if ((findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0) fileNames.push_back(findData.cFileName);
+	} while (FindNextFileA(findHandle, &findData));
+	FindClose(findHandle);
+#else
+	DIR *dir = opendir(path.c_str());
+	if (dir == NULL) return false;
+	while (const struct dirent *entry = readdir(dir)) {
+		struct stat status;
+		if (stat((path + "/" + entry->d_name).c_str(), &status) == 0 && S_ISREG(status.st_mode)) fileNames.push_back(entry->d_name);
+	}
+	closedir(dir);
+#endif
+	std::sort(fileNames.begin(), fileNames.end());
+	return true;
+}
+
+std::string getFileExtension(const std::string &fileName) {
+	size_t dot = fileName.find_last_of('.');
+	if (dot == std::string::npos) return std::string();
+	std::string extension = fileName.substr(dot + 1);
+	for (size_t i = 0; i < extension.size(); i++) {
+		if (extension[i] >= 'A' && extension[i] <= 'Z') extension[i] += 'a' - 'A';
+	}
+	return extension;
+}
+
+} // namespace MT32Emu
@@ -0,0 +1,34 @@
+/* Copyright (C) 2026 FB-01 Emulator contributors
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MT32EMU_DIRECTORY_LIST_H
+#define MT32EMU_DIRECTORY_LIST_H
+
+#include <string>
+#include <vector>
+
+namespace MT32Emu {
+
+// Returns the names of the regular files in the directory (not recursively), sorted so that the order doesn't
+// depend on the file system. Returns false if the path isn't a directory.
+bool listDirectory(const std::string &path, std::vector<std::string> &fileNames);
+
+// Returns the extension of the file name in lower case, without the dot. Empty if there is none.
+std::string getFileExtension(const std::string &fileName);
+
+} // namespace MT32Emu
+
+#endif // #ifndef MT32EMU_DIRECTORY_LIST_H
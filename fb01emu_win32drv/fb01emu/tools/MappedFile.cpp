@@ -0,0 +1,108 @@
+/* Copyright (C) 2026 FB-01 Emulator contributors
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "MappedFile.h"
+
+using namespace MT32Emu;
+
+#ifdef _WIN32
+
+MappedFile::MappedFile() : data(NULL), size(0), fileHandle(INVALID_HANDLE_VALUE), mappingHandle(NULL) {}
+
+bool MappedFile::open(const char *fileName) {
+	close();
+	fileHandle = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileHandle, &fileSize) || Bit64u(fileSize.QuadPart) > Bit64u(size_t(-1))) {
+		close();
+		return false;
+	}
+	if (fileSize.QuadPart == 0) return true;
+	mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mappingHandle == NULL) {
+		close();
+		return false;
+	}
+	data = static_cast<const Bit8u *>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+	if (data == NULL) {
+		close();
+		return false;
+	}
+	size = size_t(fileSize.QuadPart);
+	return true;
+}
+
+void MappedFile::close() {
+	if (data != NULL) UnmapViewOfFile(data);
+	if (mappingHandle != NULL) CloseHandle(mappingHandle);
+	if (fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+	data = NULL;
+	size = 0;
+	mappingHandle = NULL;
+	fileHandle = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+MappedFile::MappedFile() : data(NULL), size(0) {}
+
+bool MappedFile::open(const char *fileName) {
+	close();
+	int fd = ::open(fileName, O_RDONLY);
+	if (fd < 0) return false;
+	struct stat status;
+	if (fstat(fd, &status) != 0 || !S_ISREG(status.st_mode) || Bit64u(status.st_size) > Bit64u(size_t(-1))) {
+		::close(fd);
+		return false;
+	}
+	if (status.st_size > 0) {
+		void *mapping = mmap(NULL, size_t(status.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapping == MAP_FAILED) {
+			::close(fd);
+			return false;
+		}
+		// Read ahead aggressively, the file is played from start to end
+		madvise(mapping, size_t(status.st_size), MADV_SEQUENTIAL);
+		data = static_cast<const Bit8u *>(mapping);
+		size = size_t(status.st_size);
+	}
+	// The mapping stays valid without the descriptor
+	::close(fd);
+	return true;
+}
+
+void MappedFile::close() {
+	if (data != NULL) munmap(const_cast<Bit8u *>(data), size);
+	data = NULL;
+	size = 0;
+}
+
+#endif
+
+MappedFile::~MappedFile() {
+	close();
+}
@@ -0,0 +1,54 @@
+/* Copyright (C) 2026 FB-01 Emulator contributors
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef MT32EMU_MAPPED_FILE_H
+#define MT32EMU_MAPPED_FILE_H
+
+#include <cstddef>
+
+#include "mt32emu.h"
+
+namespace MT32Emu {
+
+// A whole file mapped read-only into memory, so that it is read by the page cache on demand rather than copied.
+class MappedFile {
+public:
+	MappedFile();
+	~MappedFile();
+
+	// Returns false if the file cannot be opened or mapped. An empty file is opened with no data.
+	bool open(const char *fileName);
+	void close();
+
+	const Bit8u *getData() const { return data; }
+	size_t getSize() const { return size; }
+
+private:
+	const Bit8u *data;
+	size_t size;
+#ifdef _WIN32
+	void *fileHandle;
+	void *mappingHandle;
+#endif
+
+	MappedFile(const MappedFile &);
+	MappedFile &operator=(const MappedFile &);
+};
+
+} // namespace MT32Emu
+
+#endif // #ifndef MT32EMU_MAPPED_FILE_H
@@ -0,0 +1,238 @@
+/* Copyright (C) 2026 FB-01 Emulator contributors
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "SmfSequence.h"
+
+extern "C"
+{
+#include "smf.h"
+}
+
+using namespace MT32Emu;
+
+namespace {
+
+// An event of a single track before the tracks are merged, time is still in ticks
+struct TrackEvent {
+	Bit32u tick;
+	Bit32u track;
+	Bit32u tempo;          // New tempo in microseconds per quarter note, 0 unless a Set Tempo meta event
+	Bit32u shortMessageData;
+	size_t sysexOffset;    // Into sysexStorage, only when sysexLength != 0
+	Bit32u sysexLength;
+};
+
+static bool compareTrackEvents(const TrackEvent &a, const TrackEvent &b) {
+	// The sort is stable, so that the events of a track at the same tick stay in order
+	if (a.tick != b.tick) return a.tick < b.tick;
+	return a.track < b.track;
+}
+
+static Bit32u readBigEndian(const Bit8u *data, Bit32u size) {
+	Bit32u value = 0;
+	for (Bit32u i = 0; i < size; i++) {
+		value = (value << 8) | data[i];
+	}
+	return value;
+}
+
+} // namespace
+
+SmfSequence::SmfSequence() : length(0), error(NULL) {}
+
+bool SmfSequence::fail(const char *message) {
+	events.clear();
+	sysexStorage.clear();
+	length = 0;
+	error = message;
+	return false;
+}
+
+bool SmfSequence::load(const char *fileName, Bit32u sampleRate) {
+	FILE *file = fopen(fileName, "rb");
+	if (file == NULL) return fail("cannot open file");
+	std::vector<Bit8u> data;
+	Bit8u buffer[65536];
+	size_t readSize;
+	while ((readSize = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+		data.insert(data.end(), buffer, buffer + readSize);
+	}
+	bool readError = ferror(file) != 0;
+	fclose(file);
+	if (readError) return fail("cannot read file");
+	return parse(data.empty() ? NULL : &data[0], data.size(), sampleRate);
+}
+
+bool SmfSequence::parse(const Bit8u *data, size_t size, Bit32u sampleRate) {
+	events.clear();
+	sysexStorage.clear();
+	length = 0;
+	error = NULL;
+
+	if (size < SMF_MTHD_HEADER_SIZE || memcmp(data, SMF_HEADER_STRING, 4) != 0) return fail("not a Standard MIDI File");
+	Bit32u headerLength = readBigEndian(data + 4, 4);
+	Bit32u format = readBigEndian(data + 8, 2);
+	Bit32u trackCount = readBigEndian(data + 10, 2);
+	Bit32u division = readBigEndian(data + 12, 2);
+	if (headerLength < 6 || size - 8 < headerLength) return fail("truncated header");
+	if (format > 1) return fail("only SMF format 0 and 1 are supported");
+	if (division == 0) return fail("invalid time division");
+
+	std::vector<TrackEvent> trackEvents;
+	size_t position = 8 + headerLength;
+	Bit32u track = 0;
+	while (track < trackCount && size - position >= 8) {
+		Bit32u chunkLength = readBigEndian(data + position + 4, 4);
+		bool isTrack = memcmp(data + position, SMF_TRACK_STRING, 4) == 0;
+		position += 8;
+		if (size - position < chunkLength) return fail("truncated track");
+		const Bit8u *trackData = data + position;
+		position += chunkLength;
+		// Unknown chunks are skipped, as the specification requires
+		if (!isTrack) continue;
+
+		Bit32u trackPosition = 0;
+		Bit32u tick = 0;
+		Bit32u runningStatus = 0;
+		while (trackPosition < chunkLength) {
+			Bit32u delta = 0;
+			Bit8u byte;
+			do {
+				if (trackPosition >= chunkLength) return fail("truncated delta time");
+				byte = trackData[trackPosition++];
+				delta = (delta << 7) | (byte & 0x7F);
+			} while (byte & 0x80);
+			tick += delta;
+			if (trackPosition >= chunkLength) return fail("truncated event");
+
+			TrackEvent event = { tick, track, 0, 0, 0, 0 };
+			Bit32u status = trackData[trackPosition];
+			if (status == MIDI_SYSEX || status == 0xF7 || status == MIDI_META) {
+				trackPosition++;
+				Bit32u type = 0;
+				if (status == MIDI_META) {
+					if (trackPosition >= chunkLength) return fail("truncated meta event");
+					type = trackData[trackPosition++];
+				}
+				Bit32u dataLength = 0;
+				do {
+					if (trackPosition >= chunkLength) return fail("truncated event length");
+					byte = trackData[trackPosition++];
+					dataLength = (dataLength << 7) | (byte & 0x7F);
+				} while (byte & 0x80);
+				if (chunkLength - trackPosition < dataLength) return fail("truncated event data");
+				const Bit8u *eventData = trackData + trackPosition;
+				trackPosition += dataLength;
+				// Only SysEx and meta events cancel the running status
+				runningStatus = 0;
+
+				if (status == MIDI_META) {
+					if (type == META_EOT) {
+						trackEvents.push_back(event);
+						break;
+					}
+					if (type != META_TEMPO || dataLength < 3) continue;
+					event.tempo = readBigEndian(eventData, 3);
+					if (event.tempo == 0) continue;
+				} else if (status == MIDI_SYSEX) {
+					// The F0 status is stored in the file apart from the rest of the message
+					event.sysexOffset = sysexStorage.size();
+					event.sysexLength = dataLength + 1;
+					sysexStorage.push_back(MIDI_SYSEX);
+					sysexStorage.insert(sysexStorage.end(), eventData, eventData + dataLength);
+				} else {
+					// An escaped sequence is sent as is, only complete SysEx messages are accepted by the synth
+					if (dataLength < 2 || eventData[0] != MIDI_SYSEX) continue;
+					event.sysexOffset = sysexStorage.size();
+					event.sysexLength = dataLength;
+					sysexStorage.insert(sysexStorage.end(), eventData, eventData + dataLength);
+				}
+				trackEvents.push_back(event);
+				continue;
+			}
+
+			if (status & 0x80) {
+				trackPosition++;
+				runningStatus = status;
+			} else if (runningStatus == 0) {
+				return fail("data byte without running status");
+			} else {
+				status = runningStatus;
+			}
+			Bit32u dataLength = Synth::getShortMessageLength(status) - 1;
+			if (chunkLength - trackPosition < dataLength) return fail("truncated channel message");
+			event.shortMessageData = status;
+			for (Bit32u i = 0; i < dataLength; i++) {
+				event.shortMessageData |= Bit32u(trackData[trackPosition++]) << (8 * (i + 1));
+			}
+			trackEvents.push_back(event);
+		}
+		track++;
+	}
+
+	std::stable_sort(trackEvents.begin(), trackEvents.end(), compareTrackEvents);
+
+	// The tick length is tracked in floating point from the last tempo change, rounding only the event timestamps,
+	// so that no error accumulates over the file.
+	double samplesPerTick;
+	if (division & 0x8000) {
+		// SMPTE time division: the high byte is the negated frame rate, -29 stands for 29.97 fps
+		Bit32u framesPerSecond = 0x100 - (division >> 8);
+		Bit32u ticksPerFrame = division & 0xFF;
+		if (ticksPerFrame == 0) return fail("invalid time division");
+		double frameRate = framesPerSecond == 29 ? 30000.0 / 1001.0 : double(framesPerSecond);
+		samplesPerTick = sampleRate / (frameRate * ticksPerFrame);
+		division = 0;
+	} else {
+		// Default tempo is 120 BPM
+		samplesPerTick = 500000.0 * sampleRate / (1000000.0 * division);
+	}
+	Bit32u segmentTick = 0;
+	double segmentTime = 0.0;
+
+	events.reserve(trackEvents.size());
+	std::vector<size_t> sysexOffsets;
+	for (size_t i = 0; i < trackEvents.size(); i++) {
+		const TrackEvent &trackEvent = trackEvents[i];
+		double time = segmentTime + (trackEvent.tick - segmentTick) * samplesPerTick;
+		Bit64u timestamp = Bit64u(time + 0.5);
+		length = timestamp;
+		if (trackEvent.tempo != 0) {
+			// Tempo has no effect with SMPTE time division
+			if (division != 0) {
+				segmentTick = trackEvent.tick;
+				segmentTime = time;
+				samplesPerTick = double(trackEvent.tempo) * sampleRate / (1000000.0 * division);
+			}
+			continue;
+		}
+		if (trackEvent.shortMessageData == 0 && trackEvent.sysexLength == 0) continue;
+		Synth::Event event = { timestamp, trackEvent.shortMessageData, NULL, trackEvent.sysexLength };
+		events.push_back(event);
+		sysexOffsets.push_back(trackEvent.sysexOffset);
+	}
+	// The storage doesn't grow any more, so the SysEx data can be referenced now
+	for (size_t i = 0; i < events.size(); i++) {
+		if (events[i].sysexLength != 0) {
+			events[i].sysexData = &sysexStorage[sysexOffsets[i]];
+		}
+	}
+	return true;
+}
@@ -0,0 +1,55 @@
+/* Copyright (C) 2026 FB-01 Emulator contributors
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MT32EMU_SMF_SEQUENCE_H
+#define MT32EMU_SMF_SEQUENCE_H
+
+#include <vector>
+
+#include "mt32emu.h"
+
+namespace MT32Emu {
+
+// A Standard MIDI File (format 0 or 1) flattened into a single timestamp-sorted list of events.
+// Ticks are converted to the sample clock of the synth following the tempo map, so the events
+// can be passed straight to Synth::playEvents().
+class SmfSequence {
+public:
+	SmfSequence();
+
+	// Loads the file, timestamps are in samples at the specified sample rate.
+	// Returns false and sets the error message if the file cannot be read or isn't a valid SMF.
+	bool load(const char *fileName, Bit32u sampleRate);
+	// Same as above but parses an SMF image held in memory.
+	bool parse(const Bit8u *data, size_t size, Bit32u sampleRate);
+
+	const std::vector<Synth::Event> &getEvents() const { return events; }
+	// Timestamp of the last event, including meta events such as End of Track.
+	Bit64u getLength() const { return length; }
+	const char *getError() const { return error; }
+
+private:
+	std::vector<Synth::Event> events;
+	std::vector<Bit8u> sysexStorage;
+	Bit64u length;
+	const char *error;
+
+	bool fail(const char *message);
+};
+
+} // namespace MT32Emu
+
+#endif // #ifndef MT32EMU_SMF_SEQUENCE_H
@@ -0,0 +1,102 @@
+/* Copyright (C) 2026 FB-01 Emulator contributors
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+
+#include "WaveFile.h"
+
+using namespace MT32Emu;
+
+static const Bit32u WAVE_HEADER_SIZE = 44;
+static const Bit32u WAVE_FORMAT_PCM = 1;
+static const Bit32u WAVE_FORMAT_IEEE_FLOAT = 3;
+
+static void putLittleEndian(Bit8u *dst, Bit32u value, Bit32u size) {
+	for (Bit32u i = 0; i < size; i++) {
+		dst[i] = Bit8u(value >> (8 * i));
+	}
+}
+
+WaveFile::WaveFile() : file(NULL), format(Format_WAVE_S16), sampleRate(0), frameCount(0), failed(false) {}
+
+WaveFile::~WaveFile() {
+	close();
+}
+
+bool WaveFile::open(const char *fileName, Format useFormat, Bit32u useSampleRate) {
+	close();
+	file = fopen(fileName, "wb");
+	if (file == NULL) return false;
+	format = useFormat;
+	sampleRate = useSampleRate;
+	frameCount = 0;
+	failed = false;
+	// The header is written upfront with zero sizes, so that an interrupted render still leaves a recognisable file
+	if (!writeHeader()) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool WaveFile::writeHeader() {
+	if (format == Format_RAW_S16 || format == Format_RAW_FLOAT) return true;
+
+	Bit32u bytesPerFrame = isFloat() ? 8 : 4;
+	// RIFF sizes are 32-bit, longer files are left with the maximum sizes which most readers handle as "until EOF"
+	Bit64u dataSize = frameCount * bytesPerFrame;
+	if (dataSize > 0xFFFFFFFFu - WAVE_HEADER_SIZE) dataSize = 0xFFFFFFFFu - WAVE_HEADER_SIZE;
+
+	Bit8u header[WAVE_HEADER_SIZE];
+	memcpy(header, "RIFF", 4);
+	putLittleEndian(header + 4, Bit32u(dataSize) + WAVE_HEADER_SIZE - 8, 4);
+	memcpy(header + 8, "WAVEfmt ", 8);
+	putLittleEndian(header + 16, 16, 4);
+	putLittleEndian(header + 20, isFloat() ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM, 2);
+	putLittleEndian(header + 22, 2, 2);
+	putLittleEndian(header + 24, sampleRate, 4);
+	putLittleEndian(header + 28, sampleRate * bytesPerFrame, 4);
+	putLittleEndian(header + 32, bytesPerFrame, 2);
+	putLittleEndian(header + 34, isFloat() ? 32 : 16, 2);
+	memcpy(header + 36, "data", 4);
+	putLittleEndian(header + 40, Bit32u(dataSize), 4);
+	return fwrite(header, 1, WAVE_HEADER_SIZE, file) == WAVE_HEADER_SIZE;
+}
+
+// The samples are written in the native byte order, WAVE files are only correct on little-endian hosts
+bool WaveFile::write(const Bit16s *frames, Bit32u useFrameCount) {
+	if (file == NULL || isFloat()) return false;
+	if (fwrite(frames, 4, useFrameCount, file) != useFrameCount) failed = true;
+	frameCount += useFrameCount;
+	return !failed;
+}
+
+bool WaveFile::write(const float *frames, Bit32u useFrameCount) {
+	if (file == NULL || !isFloat()) return false;
+	if (fwrite(frames, 8, useFrameCount, file) != useFrameCount) failed = true;
+	frameCount += useFrameCount;
+	return !failed;
+}
+
+bool WaveFile::close() {
+	if (file == NULL) return !failed;
+	if (!failed && format != Format_RAW_S16 && format != Format_RAW_FLOAT) {
+		if (fseek(file, 0, SEEK_SET) != 0 || !writeHeader()) failed = true;
+	}
+	if (fclose(file) != 0) failed = true;
+	file = NULL;
+	return !failed;
+}
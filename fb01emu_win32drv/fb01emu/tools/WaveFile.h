@@ -0,0 +1,61 @@
+/* Copyright (C) 2026 FB-01 Emulator contributors
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MT32EMU_WAVE_FILE_H
+#define MT32EMU_WAVE_FILE_H
+
+#include <cstdio>
+
+#include "mt32emu.h"
+
+namespace MT32Emu {
+
+// Writes stereo frames as rendered by Synth::render() to a RIFF WAVE file, or to a headerless raw file.
+// The sizes in the RIFF header are filled in by close().
+class WaveFile {
+public:
+	enum Format {
+		Format_WAVE_S16,
+		Format_WAVE_FLOAT,
+		Format_RAW_S16,
+		Format_RAW_FLOAT
+	};
+
+	WaveFile();
+	~WaveFile();
+
+	bool open(const char *fileName, Format format, Bit32u sampleRate);
+	bool write(const Bit16s *frames, Bit32u frameCount);
+	bool write(const float *frames, Bit32u frameCount);
+	// Returns false if any write has failed.
+	bool close();
+
+	bool isFloat() const { return format == Format_WAVE_FLOAT || format == Format_RAW_FLOAT; }
+	Bit64u getFrameCount() const { return frameCount; }
+
+private:
+	FILE *file;
+	Format format;
+	Bit32u sampleRate;
+	Bit64u frameCount;
+	bool failed;
+
+	bool writeHeader();
+};
+
+} // namespace MT32Emu
+
+#endif // #ifndef MT32EMU_WAVE_FILE_H
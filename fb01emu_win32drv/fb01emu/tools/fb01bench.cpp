@@ -0,0 +1,405 @@
+/* Copyright (C) 2026 FB-01 Emulator contributors
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Rendering throughput benchmark. Each scenario is a fixed, generated stream of MIDI events which is
+// rendered twice through Synth::render(): once for the overall throughput, and once with its profiler
+// enabled, which times each stage of the pipeline on its own.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "mt32emu.h"
+
+using namespace MT32Emu;
+
+typedef std::chrono::steady_clock Clock;
+
+// Frames rendered per call to Synth::render(), events are fed this far ahead of the render position
+static const Bit32u RENDER_CHUNK_FRAMES = 4096;
+
+static const Bit32u SCENARIO_SEED = 0x46423031;
+
+struct Options {
+	double seconds;
+	Bit32u repeats;
+	bool blockRendering;
+	bool sampleRendering;
+	const char *scenarioName;
+};
+
+struct Scenario {
+	const char *name;
+	const char *description;
+	void (*generate)(std::vector<Synth::Event> &events, Bit64u length, Bit32u sampleRate);
+};
+
+// Time spent in each stage of the render loop, in seconds
+struct StageCosts {
+	double events;
+	double writes;
+	double chip;
+	double mix;
+	double queue;
+};
+
+// A voice bank load (C7), see makeVoiceBankSysex()
+static std::vector<Bit8u> voiceBankSysex;
+
+// Deterministic, so that every run renders the same events
+class Random {
+	Bit32u state;
+
+public:
+	explicit Random(Bit32u seed) : state(seed) {}
+
+	Bit32u next(Bit32u range) {
+		state = state * 1664525 + 1013904223;
+		return Bit32u((Bit64u(state >> 8) * range) >> 24);
+	}
+};
+
+static void addShortMessage(std::vector<Synth::Event> &events, Bit64u timestamp, Bit8u status, Bit8u data1, Bit8u data2) {
+	Synth::Event event;
+	event.timestamp = timestamp;
+	event.shortMessageData = status | (data1 << 8) | (data2 << 16);
+	event.sysexData = NULL;
+	event.sysexLength = 0;
+	events.push_back(event);
+}
+
+static void addSysex(std::vector<Synth::Event> &events, Bit64u timestamp, const std::vector<Bit8u> &sysex) {
+	Synth::Event event;
+	event.timestamp = timestamp;
+	event.shortMessageData = 0;
+	event.sysexData = &sysex[0];
+	event.sysexLength = Bit32u(sysex.size());
+	events.push_back(event);
+}
+
+// With the default configuration, instruments 1 to 8 play a single note each on MIDI channels 1 to 8
+static void addChords(std::vector<Synth::Event> &events, Bit64u length, Bit64u interval) {
+	for (Bit64u timestamp = 0; timestamp < length; timestamp += interval) {
+		for (Bit8u channel = 0; channel < 8; channel++) {
+			Bit8u note = Bit8u(41 + channel * 5);
+			if (timestamp > 0) addShortMessage(events, timestamp, 0x80 | channel, note, 64);
+			addShortMessage(events, timestamp, 0x90 | channel, note, 100);
+		}
+	}
+}
+
+static void generateIdle(std::vector<Synth::Event> &, Bit64u, Bit32u) {}
+
+static void generateSustained(std::vector<Synth::Event> &events, Bit64u length, Bit32u sampleRate) {
+	addChords(events, length, 2 * Bit64u(sampleRate));
+}
+
+static void generateNoteChurn(std::vector<Synth::Event> &events, Bit64u length, Bit32u) {
+	Random random(SCENARIO_SEED);
+	Bit8u playing[8] = {0};
+	for (Bit64u timestamp = 0; timestamp < length; timestamp += 64) {
+		Bit8u channel = Bit8u(random.next(8));
+		if (playing[channel] != 0) addShortMessage(events, timestamp, 0x80 | channel, playing[channel], 64);
+		playing[channel] = Bit8u(36 + random.next(60));
+		addShortMessage(events, timestamp, 0x90 | channel, playing[channel], Bit8u(40 + random.next(88)));
+	}
+}
+
+static void generateControllers(std::vector<Synth::Event> &events, Bit64u length, Bit32u sampleRate) {
+	addChords(events, length, 2 * Bit64u(sampleRate));
+	Random random(SCENARIO_SEED);
+	Bit32u step = 0;
+	for (Bit64u timestamp = 16; timestamp < length; timestamp += 16, step++) {
+		Bit8u channel = Bit8u(step & 7);
+		switch ((step >> 3) & 3) {
+		case 0:
+		case 1: {
+			Bit32u bend = 8192 + Bit32u(random.next(4096)) - 2048;
+			addShortMessage(events, timestamp, 0xE0 | channel, Bit8u(bend & 0x7F), Bit8u(bend >> 7));
+			break;
+		}
+		case 2:
+			addShortMessage(events, timestamp, 0xB0 | channel, 1, Bit8u(random.next(128)));
+			break;
+		default:
+			addShortMessage(events, timestamp, 0xB0 | channel, 7, Bit8u(64 + random.next(64)));
+			break;
+		}
+	}
+	std::stable_sort(events.begin(), events.end(), [](const Synth::Event &a, const Synth::Event &b) {
+		return a.timestamp < b.timestamp;
+	});
+}
+
+static void generateVoiceLoads(std::vector<Synth::Event> &events, Bit64u length, Bit32u sampleRate) {
+	for (Bit64u timestamp = 0; timestamp < length; timestamp += sampleRate / 4) {
+		addSysex(events, timestamp, voiceBankSysex);
+		// Pick the reloaded voices up
+		for (Bit8u channel = 0; channel < 8; channel++) {
+			addShortMessage(events, timestamp, 0xC0 | channel, channel, 0);
+		}
+	}
+	addChords(events, length, sampleRate / 2);
+	std::stable_sort(events.begin(), events.end(), [](const Synth::Event &a, const Synth::Event &b) {
+		return a.timestamp < b.timestamp;
+	});
+}
+
+static const Scenario SCENARIOS[] = {
+	{"idle", "no events", generateIdle},
+	{"sustain", "8 sustained notes, retriggered every 2 s", generateSustained},
+	{"churn", "a note off and on every 64 samples", generateNoteChurn},
+	{"control", "8 notes with pitch bend, modulation and volume every 16 samples", generateControllers},
+	{"sysex", "8 notes and a 6363 byte voice bank load every 1/4 s", generateVoiceLoads}
+};
+
+static const Bit32u SCENARIO_COUNT = sizeof(SCENARIOS) / sizeof(SCENARIOS[0]);
+
+// Packet type A: a two byte length, each data byte split in two nibbles, low first, and a checksum
+static void addPacketTypeA(std::vector<Bit8u> &sysex, const Bit8u *data, Bit32u length) {
+	sysex.push_back(Bit8u((length * 2) >> 7));
+	sysex.push_back(Bit8u((length * 2) & 0x7F));
+	Bit8u checksum = 0;
+	for (Bit32u i = 0; i < length; i++) {
+		Bit8u low = data[i] & 0x0F;
+		Bit8u high = data[i] >> 4;
+		sysex.push_back(low);
+		sysex.push_back(high);
+		checksum += low + high;
+	}
+	sysex.push_back(Bit8u(-checksum) & 0x7F);
+}
+
+// Builds a voice bank load (C7) into the first RAM bank, the one played by the default configuration.
+// The 48 voices are random but sound: all four operators enabled, fast attack, moderate decay.
+static void makeVoiceBankSysex() {
+	VFB_VOICE_BANK bank;
+	memset(&bank, 0, sizeof(bank));
+	memcpy(bank.name, "bench", 5);
+	Random random(SCENARIO_SEED);
+	for (Bit32u i = 0; i < VFB_NUM_VOICES; i++) {
+		VFB_VOICE_DATA &voice = bank.voice_data[i];
+		snprintf((char *)voice.name, sizeof(voice.name), "voice%u", i % 100);
+		voice.operator_enable = 0x78;
+		voice.feedback_level_algorithm = Bit8u((random.next(8) << 3) | random.next(8));
+		for (Bit32u op = 0; op < 4; op++) {
+			VFB_OPERATOR_BLOCK &block = voice.operator_block[op];
+			block.total_level = Bit8u(random.next(40));
+			block.params[2] = Bit8u(1 + random.next(4));
+			block.params[3] = Bit8u(24 + random.next(8));
+			block.params[4] = Bit8u(0x80 | (4 + random.next(12)));
+			block.params[5] = Bit8u(random.next(4));
+			block.params[6] = Bit8u((random.next(8) << 4) | 7);
+		}
+	}
+
+	static const Bit8u header[] = {0xF0, 0x43, 0x75, 0x00, 0x00, 0x00, 0x00};
+	voiceBankSysex.assign(header, header + sizeof(header));
+	addPacketTypeA(voiceBankSysex, (const Bit8u *)&bank, Bit32u(sizeof(bank.name) + sizeof(bank.reserved)));
+	for (Bit32u i = 0; i < VFB_NUM_VOICES; i++) {
+		addPacketTypeA(voiceBankSysex, (const Bit8u *)&bank.voice_data[i], Bit32u(sizeof(bank.voice_data[i])));
+	}
+	voiceBankSysex.push_back(0xF7);
+}
+
+static double secondsSince(Clock::time_point &start) {
+	Clock::time_point now = Clock::now();
+	double seconds = std::chrono::duration<double>(now - start).count();
+	start = now;
+	return seconds;
+}
+
+// Renders the events through the public API, in the same way as smf2wav. Returns the time taken.
+// With costs, the stages of Synth::render() are timed by its profiler, which slows it down somewhat,
+// and the queue also includes the time spent in Synth::playEvents().
+static double renderSynth(const std::vector<Synth::Event> &events, Bit64u length, bool blockRendering, StageCosts *costs) {
+	Synth synth;
+	if (!synth.open()) return 0.0;
+	synth.setMIDIDelayMode(MIDIDelayMode_IMMEDIATE);
+	synth.setBlockRenderingEnabled(blockRendering);
+	synth.setRenderProfilingEnabled(costs != NULL);
+	std::vector<Bit16s> buffer(RENDER_CHUNK_FRAMES * 2);
+
+	Clock::time_point start = Clock::now();
+	double pushSeconds = 0.0;
+	size_t nextEvent = 0;
+	for (Bit64u now = 0; now < length;) {
+		Bit64u horizon = now + RENDER_CHUNK_FRAMES;
+		Clock::time_point pushStart = Clock::now();
+		while (nextEvent < events.size() && events[nextEvent].timestamp < horizon) {
+			size_t end = nextEvent;
+			while (end < events.size() && events[end].timestamp < horizon) end++;
+			Bit32u played = synth.playEvents(&events[nextEvent], Bit32u(end - nextEvent));
+			nextEvent += played;
+			// The queue is full, render what's there and come back
+			if (nextEvent < end) {
+				horizon = events[nextEvent].timestamp;
+				break;
+			}
+		}
+		if (costs != NULL) pushSeconds += secondsSince(pushStart);
+		Bit32u frameCount = Bit32u(std::min<Bit64u>(std::max<Bit64u>(horizon, now + 1), length) - now);
+		synth.render(&buffer[0], frameCount);
+		now += frameCount;
+	}
+	double seconds = secondsSince(start);
+	if (costs != NULL) {
+		Synth::RenderProfile profile;
+		synth.getRenderProfile(profile);
+		costs->events = profile.events * 1e-9;
+		costs->writes = profile.writes * 1e-9;
+		costs->chip = profile.chip * 1e-9;
+		costs->mix = profile.mix * 1e-9;
+		costs->queue = profile.queue * 1e-9 + pushSeconds;
+	}
+	synth.close();
+	return seconds;
+}
+
+static void printUsage() {
+	fprintf(stderr,
+		"Usage: fb01bench [options] [scenario]\n"
+		"Options:\n"
+		"  -t seconds  audio rendered per scenario (default 30)\n"
+		"  -n repeats  runs per measurement, the fastest is reported (default 3)\n"
+		"  -s          only render the YM2151 sample by sample (ym2151_update_one)\n"
+		"  -b          only render the YM2151 in blocks (ym2151_update_block)\n"
+		"Scenarios:\n");
+	for (Bit32u i = 0; i < SCENARIO_COUNT; i++) {
+		fprintf(stderr, "  %-10s  %s\n", SCENARIOS[i].name, SCENARIOS[i].description);
+	}
+}
+
+static bool parseOptions(int argc, char *argv[], Options &options) {
+	options.seconds = 30.0;
+	options.repeats = 3;
+	options.blockRendering = true;
+	options.sampleRendering = true;
+	options.scenarioName = NULL;
+
+	int i = 1;
+	for (; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+		const char *option = argv[i];
+		if (strcmp(option, "-s") == 0) {
+			options.blockRendering = false;
+			options.sampleRendering = true;
+		} else if (strcmp(option, "-b") == 0) {
+			options.blockRendering = true;
+			options.sampleRendering = false;
+		} else if (strcmp(option, "-t") == 0 && i + 1 < argc) {
+			options.seconds = atof(argv[++i]);
+			if (options.seconds <= 0.0) return false;
+		} else if (strcmp(option, "-n") == 0 && i + 1 < argc) {
+			int repeats = atoi(argv[++i]);
+			if (repeats < 1) return false;
+			options.repeats = Bit32u(repeats);
+		} else {
+			return false;
+		}
+	}
+	if (i < argc) options.scenarioName = argv[i++];
+	return i == argc;
+}
+
+// Fastest of the repeats, stage by stage
+static void keepFastest(StageCosts &best, const StageCosts &costs, bool first) {
+	if (first) {
+		best = costs;
+		return;
+	}
+	best.events = std::min(best.events, costs.events);
+	best.writes = std::min(best.writes, costs.writes);
+	best.chip = std::min(best.chip, costs.chip);
+	best.mix = std::min(best.mix, costs.mix);
+	best.queue = std::min(best.queue, costs.queue);
+}
+
+static void benchmark(const Scenario &scenario, const Options &options, bool blockRendering, Bit32u sampleRate) {
+	Bit64u length = Bit64u(options.seconds * sampleRate);
+	std::vector<Synth::Event> events;
+	scenario.generate(events, length, sampleRate);
+
+	double seconds = 0.0;
+	StageCosts costs;
+	for (Bit32u i = 0; i < options.repeats; i++) {
+		double runSeconds = renderSynth(events, length, blockRendering, NULL);
+		if (i == 0 || runSeconds < seconds) seconds = runSeconds;
+		StageCosts runCosts;
+		renderSynth(events, length, blockRendering, &runCosts);
+		keepFastest(costs, runCosts, i == 0);
+	}
+
+	double nsPerSample = 1e9 / double(length);
+	double nsPerEvent = events.empty() ? 0.0 : 1e9 / double(events.size());
+	printf("%-8s %-6s %8u %9.2f %8.1f | %7.1f %7.1f %7.1f %7.1f %7.1f | %10.0f %9.0f\n",
+		scenario.name, blockRendering ? "block" : "one", Bit32u(events.size()),
+		seconds > 0.0 ? length / seconds / 1e6 : 0.0, seconds > 0.0 ? options.seconds / seconds : 0.0,
+		costs.events * nsPerSample, costs.writes * nsPerSample, costs.chip * nsPerSample, costs.mix * nsPerSample,
+		costs.queue * nsPerSample,
+		costs.events * nsPerEvent, costs.queue * nsPerEvent);
+	fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+	Options options;
+	if (!parseOptions(argc, argv, options)) {
+		printUsage();
+		return 1;
+	}
+	const Scenario *selected = NULL;
+	if (options.scenarioName != NULL) {
+		for (Bit32u i = 0; i < SCENARIO_COUNT; i++) {
+			if (strcmp(SCENARIOS[i].name, options.scenarioName) == 0) selected = &SCENARIOS[i];
+		}
+		if (selected == NULL) {
+			fprintf(stderr, "fb01bench: Unknown scenario %s\n", options.scenarioName);
+			printUsage();
+			return 1;
+		}
+	}
+	makeVoiceBankSysex();
+
+	Bit32u sampleRate;
+	{
+		Synth synth;
+		if (!synth.open()) {
+			fprintf(stderr, "fb01bench: Failed to open the synth\n");
+			return 1;
+		}
+		sampleRate = synth.getStereoOutputSampleRate();
+		synth.close();
+	}
+
+	printf("%.0f s of audio at %u Hz per scenario, fastest of %u runs\n", options.seconds, sampleRate, options.repeats);
+	printf("Synth::render() throughput, and the cost of each stage in ns per output sample:\n");
+	printf("  events  vfb01_doMidiMessage()     writes  ym2151_flush_writes()\n");
+	printf("  chip    ym2151_update_block() or ym2151_update_one()\n");
+	printf("  mix     pcm8_mix()                queue   Synth::playEvents(), MidiEventQueue peek and drop\n");
+	printf("The events and the queue are also given in ns per event (events/evt, queue/evt).\n");
+	printf("The stages come from Synth::setRenderProfilingEnabled() and include the overhead of its timers.\n\n");
+	printf("%-8s %-6s %8s %9s %8s | %7s %7s %7s %7s %7s | %10s %9s\n",
+		"scenario", "chip", "events", "Msmp/s", "realtime", "events", "writes", "chip", "mix", "queue",
+		"events/evt", "queue/evt");
+	for (Bit32u i = 0; i < SCENARIO_COUNT; i++) {
+		if (selected != NULL && selected != &SCENARIOS[i]) continue;
+		if (options.blockRendering) benchmark(SCENARIOS[i], options, true, sampleRate);
+		if (options.sampleRendering) benchmark(SCENARIOS[i], options, false, sampleRate);
+	}
+	return 0;
+}
@@ -0,0 +1,727 @@
+/* Copyright (C) 2026 FB-01 Emulator contributors
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Golden output regression test. Renders a corpus of Standard MIDI Files (through Synth, covering the whole
+// emulation) and YM2151 register write scripts (through the chip alone), and compares the output block by block
+// with the reference hashes checked in with the corpus. Changes meant to keep the output bit-exact, such as
+// vectorising the chip, are proven this way instead of by listening.
+//
+// For each block of BLOCK_FRAMES frames, the reference holds a hash of the 16-bit stereo output and a one byte
+// digest of the state of each of the 32 YM2151 operators. The first block with a different digest names the
+// channel and operator which went wrong first, which is usually earlier than the first audible difference.
+//
+// Each item is rendered by ym2151_update_block() and ym2151_update_one() side by side, and any difference between
+// the two is reported down to the sample. The same is done against the raw output of another build with -c.
+// This is repeated with each level of vector kernels the CPU supports, all of which must match the reference, so
+// that a broken fallback shows up on any host rather than only on older CPUs.
+//
+// With -s, each MIDI item is also saved halfway with Synth::saveState() and continued in a new synth restored with
+// loadState(), so that the output and operator digests prove the snapshot complete. Before that, the new synth has
+// to refuse the same snapshot cut short by a byte and with another version number.
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "mt32emu.h"
+#include "DirectoryList.h"
+#include "SmfSequence.h"
+#include "WaveFile.h"
+
+extern "C"
+{
+#include "ym2151.h"
+}
+
+using namespace MT32Emu;
+
+static const Bit32u BLOCK_FRAMES = 4096;
+static const Bit32u OPERATOR_COUNT = 32;
+// Rendered after the end of a MIDI sequence, so that the releases are covered
+static const double TAIL_SECONDS = 1.0;
+// The clock of the YM2151 in the FB-01, see setup_ym2151()
+static const int CHIP_CLOCK = 4000000;
+static const char REFERENCE_FILE_NAME[] = "reference.txt";
+
+static const char *const SLOT_NAMES[] = {"M1", "M2", "C1", "C2"};
+// See ym2151_set_simd_level()
+static const Bit32u SIMD_LEVEL_COUNT = 3;
+static const char *const SIMD_LEVEL_NAMES[] = {"scalar", "SSE2", "AVX2"};
+
+struct Options {
+	bool update;
+	bool verbose;
+	bool snapshot;
+	const char *writeDirectory;
+	const char *compareDirectory;
+	const char *corpusDirectory;
+};
+
+struct BlockDigest {
+	Bit64u outputHash;
+	Bit8u operators[OPERATOR_COUNT];
+};
+
+typedef std::vector<BlockDigest> ItemDigests;
+
+// Appends a line to the report of an item
+static void report(std::string &log, const char *format, ...) {
+	char line[256];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(line, sizeof(line), format, args);
+	va_end(args);
+	log += "  ";
+	log += line;
+	log += "\n";
+}
+
+// FNV-1a over the samples as little-endian 16-bit values, so that the hashes don't depend on the host
+static Bit64u hashSamples(Bit64u hash, const Bit16s *samples, Bit32u count) {
+	for (Bit32u i = 0; i < count; i++) {
+		Bit16u sample = Bit16u(samples[i]);
+		hash = (hash ^ (sample & 0xFF)) * 0x100000001B3ull;
+		hash = (hash ^ (sample >> 8)) * 0x100000001B3ull;
+	}
+	return hash;
+}
+
+static std::string describeOperator(Bit32u op) {
+	char description[32];
+	snprintf(description, sizeof(description), "channel %u %s", op / 4 + 1, SLOT_NAMES[op % 4]);
+	return description;
+}
+
+// Names the first operator which differs, and how many others do too
+static std::string describeOperatorDifference(const Bit8u *digest, const Bit8u *otherDigest) {
+	std::string description;
+	Bit32u others = 0;
+	for (Bit32u op = 0; op < OPERATOR_COUNT; op++) {
+		if (digest[op] == otherDigest[op]) continue;
+		if (description.empty()) {
+			description = describeOperator(op);
+		} else {
+			others++;
+		}
+	}
+	if (others > 0) {
+		char count[32];
+		snprintf(count, sizeof(count), " (and %u more)", others);
+		description += count;
+	}
+	return description;
+}
+
+// Renders a corpus item with one of the YM2151 renderers, block by block
+class ItemRenderer {
+public:
+	virtual ~ItemRenderer() {}
+	// Renders up to frameCount frames of 16-bit stereo, returns the number rendered. Less at the end of the item.
+	virtual Bit32u render(Bit16s *buffer, Bit32u frameCount) = 0;
+	virtual void getOperatorDigest(Bit8u *digest) = 0;
+};
+
+// Plays a Standard MIDI File through Synth, feeding the events just ahead of the render position as smf2wav does
+class MidiItemRenderer : public ItemRenderer {
+public:
+	MidiItemRenderer(const SmfSequence &useSequence) : synth(new Synth), sequence(useSequence), nextEvent(0),
+		endTimestamp(0), blockRendering(true), simdLevel(0), snapshotTimestamp(0) {}
+
+	~MidiItemRenderer() {
+		delete synth;
+	}
+
+	// With snapshot, the rendering moves to a new synth restored from a snapshot at the block boundary nearest halfway
+	bool open(bool useBlockRendering, Bit32u useSIMDLevel, bool snapshot) {
+		blockRendering = useBlockRendering;
+		simdLevel = useSIMDLevel;
+		if (!openSynth(*synth)) return false;
+		endTimestamp = sequence.getLength() + Bit64u(TAIL_SECONDS * synth->getStereoOutputSampleRate());
+		if (snapshot) snapshotTimestamp = endTimestamp / 2 / BLOCK_FRAMES * BLOCK_FRAMES;
+		return true;
+	}
+
+	Bit32u render(Bit16s *buffer, Bit32u frameCount) {
+		const std::vector<Synth::Event> &events = sequence.getEvents();
+		Bit32u rendered = 0;
+		while (rendered < frameCount) {
+			Bit64u now = synth->getRenderedSampleCount();
+			if (now >= endTimestamp) break;
+			Bit32u thisLen = frameCount - rendered;
+			if (endTimestamp - now < thisLen) thisLen = Bit32u(endTimestamp - now);
+
+			size_t dueEvents = nextEvent;
+			while (dueEvents < events.size() && events[dueEvents].timestamp < now + thisLen) dueEvents++;
+			while (nextEvent < dueEvents) {
+				Bit32u played = synth->playEvents(&events[nextEvent], Bit32u(dueEvents - nextEvent));
+				nextEvent += played;
+				if (played == 0) break;
+			}
+			// When the queue is full, stop at the first event not enqueued, so that it isn't delayed
+			if (nextEvent < dueEvents) {
+				Bit64u timestamp = events[nextEvent].timestamp;
+				thisLen = timestamp > now ? Bit32u(timestamp - now) : 1;
+			}
+			// After the events are queued, so that the snapshot carries them
+			if (now == snapshotTimestamp && snapshotTimestamp != 0) {
+				restoreFromSnapshot();
+				snapshotTimestamp = 0;
+			}
+			synth->render(buffer + 2 * rendered, thisLen);
+			rendered += thisLen;
+		}
+		return rendered;
+	}
+
+	void getOperatorDigest(Bit8u *digest) {
+		synth->getOperatorStateDigest(digest);
+	}
+
+	// Empty unless the snapshot failed a check
+	const std::string &getSnapshotError() const {
+		return snapshotError;
+	}
+
+private:
+	Synth *synth;
+	const SmfSequence &sequence;
+	size_t nextEvent;
+	Bit64u endTimestamp;
+	bool blockRendering;
+	Bit32u simdLevel;
+	Bit64u snapshotTimestamp;
+	std::string snapshotError;
+
+	bool openSynth(Synth &newSynth) {
+		if (!newSynth.open()) return false;
+		newSynth.setBlockRenderingEnabled(blockRendering);
+		newSynth.setChipSIMDLevel(simdLevel);
+		return true;
+	}
+
+	// Continues in a new synth loaded from a snapshot of this one. The damaged copies must be refused.
+	void restoreFromSnapshot() {
+		std::vector<Bit8u> state(synth->saveState(NULL, 0));
+		if (state.empty() || synth->saveState(&state[0], Bit32u(state.size())) != state.size()) {
+			snapshotError = "saveState() failed";
+			return;
+		}
+		Synth *restored = new Synth;
+		if (!openSynth(*restored)) {
+			snapshotError = "cannot open the synth to restore the snapshot in";
+		} else if (restored->loadState(&state[0], Bit32u(state.size() - 1))) {
+			snapshotError = "loadState() accepted a truncated snapshot";
+		} else {
+			// The version follows the magic number in the header, see Synth::saveState()
+			std::vector<Bit8u> otherVersion(state);
+			Bit32u version;
+			memcpy(&version, &otherVersion[4], sizeof(version));
+			version++;
+			memcpy(&otherVersion[4], &version, sizeof(version));
+			if (restored->loadState(&otherVersion[0], Bit32u(otherVersion.size()))) {
+				snapshotError = "loadState() accepted a snapshot of another version";
+			} else if (!restored->loadState(&state[0], Bit32u(state.size()))) {
+				snapshotError = "loadState() refused the snapshot";
+			} else {
+				delete synth;
+				synth = restored;
+				return;
+			}
+		}
+		delete restored;
+	}
+};
+
+// A script of register writes and pauses for the YM2151 alone, one command per line:
+//   w <register> <value>   writes a register, both in hex
+//   r <frames>             renders this many frames, in decimal
+// Empty lines and lines starting with # are ignored.
+class RegisterScript {
+public:
+	struct Command {
+		// Zero for a register write
+		Bit32u frames;
+		Bit8u reg;
+		Bit8u value;
+	};
+
+	bool load(const char *fileName, std::string &error) {
+		FILE *file = fopen(fileName, "r");
+		if (file == NULL) {
+			error = "Cannot open the file";
+			return false;
+		}
+		commands.clear();
+		char line[256];
+		Bit32u lineNumber = 0;
+		bool failed = false;
+		while (!failed && fgets(line, sizeof(line), file) != NULL) {
+			lineNumber++;
+			const char *text = line;
+			while (*text == ' ' || *text == '\t') text++;
+			if (*text == '#' || *text == '\r' || *text == '\n' || *text == '\0') continue;
+			Command command;
+			unsigned int reg, value, frames;
+			if (sscanf(text, "w %x %x", &reg, &value) == 2 && reg <= 0xFF && value <= 0xFF) {
+				command.frames = 0;
+				command.reg = Bit8u(reg);
+				command.value = Bit8u(value);
+			} else if (sscanf(text, "r %u", &frames) == 1 && frames > 0) {
+				command.frames = frames;
+				command.reg = 0;
+				command.value = 0;
+			} else {
+				char message[64];
+				snprintf(message, sizeof(message), "Syntax error in line %u", lineNumber);
+				error = message;
+				failed = true;
+				break;
+			}
+			commands.push_back(command);
+		}
+		fclose(file);
+		return !failed;
+	}
+
+	const std::vector<Command> &getCommands() const { return commands; }
+
+private:
+	std::vector<Command> commands;
+};
+
+class RegisterItemRenderer : public ItemRenderer {
+public:
+	RegisterItemRenderer(const RegisterScript &useScript) :
+		script(useScript), chip(NULL), blockRendering(true), nextCommand(0), pendingFrames(0) {}
+
+	~RegisterItemRenderer() {
+		if (chip != NULL) ym2151_shutdown(chip);
+	}
+
+	bool open(bool useBlockRendering, Bit32u sampleRate, Bit32u simdLevel) {
+		chip = ym2151_init(NULL, CHIP_CLOCK, int(sampleRate));
+		if (chip == NULL) return false;
+		ym2151_reset_chip(chip);
+		ym2151_set_simd_level(chip, int(simdLevel));
+		blockRendering = useBlockRendering;
+		return true;
+	}
+
+	Bit32u render(Bit16s *buffer, Bit32u frameCount) {
+		const std::vector<RegisterScript::Command> &commands = script.getCommands();
+		Bit32u rendered = 0;
+		while (rendered < frameCount) {
+			while (pendingFrames == 0 && nextCommand < commands.size()) {
+				const RegisterScript::Command &command = commands[nextCommand++];
+				if (command.frames == 0) {
+					ym2151_write_reg(chip, command.reg, command.value);
+				} else {
+					pendingFrames = command.frames;
+				}
+			}
+			if (pendingFrames == 0) break;
+			Bit32u thisLen = frameCount - rendered;
+			if (pendingFrames < thisLen) thisLen = pendingFrames;
+			SAMP left[BLOCK_FRAMES];
+			SAMP right[BLOCK_FRAMES];
+			SAMP *channels[] = {left, right};
+			if (thisLen > BLOCK_FRAMES) thisLen = BLOCK_FRAMES;
+			if (blockRendering) {
+				ym2151_update_block(chip, channels, int(thisLen));
+			} else {
+				ym2151_update_one(chip, channels, int(thisLen));
+			}
+			for (Bit32u i = 0; i < thisLen; i++) {
+				buffer[2 * (rendered + i)] = left[i];
+				buffer[2 * (rendered + i) + 1] = right[i];
+			}
+			rendered += thisLen;
+			pendingFrames -= thisLen;
+		}
+		return rendered;
+	}
+
+	void getOperatorDigest(Bit8u *digest) {
+		ym2151_get_operator_digest(chip, digest);
+	}
+
+private:
+	const RegisterScript &script;
+	void *chip;
+	bool blockRendering;
+	size_t nextCommand;
+	Bit32u pendingFrames;
+};
+
+// Reads the raw output of another build, written with -w
+class BaselineReader {
+public:
+	BaselineReader() : file(NULL) {}
+	~BaselineReader() {
+		if (file != NULL) fclose(file);
+	}
+
+	bool open(const std::string &fileName) {
+		file = fopen(fileName.c_str(), "rb");
+		return file != NULL;
+	}
+
+	// Returns the number of frames read. The samples are in the native byte order, as written by WaveFile.
+	Bit32u read(Bit16s *buffer, Bit32u frameCount) {
+		if (file == NULL) return 0;
+		return Bit32u(fread(buffer, 4, frameCount, file));
+	}
+
+private:
+	FILE *file;
+};
+
+// Returns the index of the first differing sample, or count if there is none
+static Bit32u findDifference(const Bit16s *samples, const Bit16s *otherSamples, Bit32u count) {
+	for (Bit32u i = 0; i < count; i++) {
+		if (samples[i] != otherSamples[i]) return i;
+	}
+	return count;
+}
+
+static void reportSampleDifference(std::string &log, const char *what, Bit64u firstFrame, const Bit16s *samples,
+	const Bit16s *otherSamples, Bit32u index) {
+	report(log, "%s from frame %llu (%s): %d instead of %d", what, (unsigned long long)(firstFrame + index / 2),
+		index & 1 ? "right" : "left", otherSamples[index], samples[index]);
+}
+
+static bool readReference(const std::string &fileName, std::map<std::string, ItemDigests> &reference) {
+	FILE *file = fopen(fileName.c_str(), "r");
+	if (file == NULL) return false;
+	char line[256];
+	while (fgets(line, sizeof(line), file) != NULL) {
+		if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') continue;
+		char name[128];
+		unsigned int block;
+		unsigned long long outputHash;
+		char operators[2 * OPERATOR_COUNT + 1];
+		if (sscanf(line, "%127s %u %llx %64s", name, &block, &outputHash, operators) != 4) continue;
+		ItemDigests &digests = reference[name];
+		if (block != digests.size() || strlen(operators) != 2 * OPERATOR_COUNT) continue;
+		BlockDigest digest;
+		digest.outputHash = outputHash;
+		for (Bit32u op = 0; op < OPERATOR_COUNT; op++) {
+			unsigned int value;
+			sscanf(operators + 2 * op, "%2x", &value);
+			digest.operators[op] = Bit8u(value);
+		}
+		digests.push_back(digest);
+	}
+	fclose(file);
+	return true;
+}
+
+static bool writeReference(const std::string &fileName, const std::map<std::string, ItemDigests> &reference) {
+	FILE *file = fopen(fileName.c_str(), "w");
+	if (file == NULL) return false;
+	fprintf(file, "# fb01golden reference, rewritten by fb01golden -u. For each block of %u frames:\n", BLOCK_FRAMES);
+	fprintf(file, "# item, block, FNV-1a hash of the 16-bit stereo output, digest of each YM2151 operator\n");
+	for (std::map<std::string, ItemDigests>::const_iterator it = reference.begin(); it != reference.end(); ++it) {
+		for (size_t block = 0; block < it->second.size(); block++) {
+			const BlockDigest &digest = it->second[block];
+			fprintf(file, "%s %u %016llx ", it->first.c_str(), Bit32u(block), (unsigned long long)digest.outputHash);
+			for (Bit32u op = 0; op < OPERATOR_COUNT; op++) {
+				fprintf(file, "%02x", digest.operators[op]);
+			}
+			fprintf(file, "\n");
+		}
+	}
+	return fclose(file) == 0;
+}
+
+// Renders the item with both chip renderers, returns false if they differ from each other or from the baseline
+static bool renderItem(const std::string &name, ItemRenderer &renderer, ItemRenderer &referenceRenderer,
+	const Options &options, ItemDigests &digests, std::string &log) {
+	bool succeeded = true;
+	WaveFile output;
+	if (options.writeDirectory != NULL) {
+		std::string fileName = std::string(options.writeDirectory) + "/" + name + ".raw";
+		if (!output.open(fileName.c_str(), WaveFile::Format_RAW_S16, 0)) {
+			report(log, "cannot write %s", fileName.c_str());
+			succeeded = false;
+		}
+	}
+	BaselineReader baseline;
+	bool compareBaseline = false;
+	if (options.compareDirectory != NULL) {
+		std::string fileName = std::string(options.compareDirectory) + "/" + name + ".raw";
+		compareBaseline = baseline.open(fileName);
+		if (!compareBaseline) {
+			report(log, "cannot read %s", fileName.c_str());
+			succeeded = false;
+		}
+	}
+
+	Bit16s buffer[2 * BLOCK_FRAMES];
+	Bit16s otherBuffer[2 * BLOCK_FRAMES];
+	Bit8u otherOperators[OPERATOR_COUNT];
+	bool renderersDiffer = false;
+	bool operatorsDiffer = false;
+	digests.clear();
+	for (;;) {
+		Bit64u firstFrame = Bit64u(digests.size()) * BLOCK_FRAMES;
+		Bit32u frameCount = renderer.render(buffer, BLOCK_FRAMES);
+		Bit32u otherFrameCount = referenceRenderer.render(otherBuffer, BLOCK_FRAMES);
+		if (frameCount == 0) break;
+
+		BlockDigest digest;
+		digest.outputHash = hashSamples(0xCBF29CE484222325ull, buffer, 2 * frameCount);
+		renderer.getOperatorDigest(digest.operators);
+		referenceRenderer.getOperatorDigest(otherOperators);
+		digests.push_back(digest);
+		if (output.write(buffer, frameCount) == false && options.writeDirectory != NULL) succeeded = false;
+
+		if (!renderersDiffer) {
+			Bit32u index = findDifference(buffer, otherBuffer, 2 * frameCount);
+			if (index < 2 * frameCount || otherFrameCount != frameCount) {
+				reportSampleDifference(log, "ym2151_update_one() differs from ym2151_update_block()", firstFrame, buffer, otherBuffer,
+					index < 2 * frameCount ? index : 2 * otherFrameCount);
+				renderersDiffer = true;
+				succeeded = false;
+			}
+		}
+		if (!operatorsDiffer && memcmp(digest.operators, otherOperators, OPERATOR_COUNT) != 0) {
+			report(log, "ym2151_update_one() operator state differs from block %u: %s", Bit32u(digests.size() - 1),
+				describeOperatorDifference(digest.operators, otherOperators).c_str());
+			operatorsDiffer = true;
+			succeeded = false;
+		}
+		if (compareBaseline) {
+			Bit32u baselineFrameCount = baseline.read(otherBuffer, frameCount);
+			Bit32u index = findDifference(otherBuffer, buffer, 2 * baselineFrameCount);
+			if (index < 2 * baselineFrameCount) {
+				reportSampleDifference(log, "output differs from the baseline", firstFrame, otherBuffer, buffer, index);
+				compareBaseline = false;
+				succeeded = false;
+			} else if (baselineFrameCount < frameCount) {
+				report(log, "the baseline ends at frame %llu", (unsigned long long)(firstFrame + baselineFrameCount));
+				compareBaseline = false;
+				succeeded = false;
+			}
+		}
+	}
+	if (!output.close() && options.writeDirectory != NULL) succeeded = false;
+	return succeeded;
+}
+
+// Returns false if the rendered digests don't match the reference
+static bool compareItem(const ItemDigests &digests, const ItemDigests &reference, std::string &log) {
+	bool succeeded = true;
+	size_t blockCount = digests.size() < reference.size() ? digests.size() : reference.size();
+	for (size_t block = 0; block < blockCount; block++) {
+		if (digests[block].outputHash != reference[block].outputHash) {
+			report(log, "output differs from the reference from block %u (frames %llu-%llu)", Bit32u(block),
+				(unsigned long long)block * BLOCK_FRAMES, (unsigned long long)(block + 1) * BLOCK_FRAMES - 1);
+			succeeded = false;
+			break;
+		}
+	}
+	for (size_t block = 0; block < blockCount; block++) {
+		if (memcmp(digests[block].operators, reference[block].operators, OPERATOR_COUNT) != 0) {
+			report(log, "operator state differs from the reference from block %u: %s", Bit32u(block),
+				describeOperatorDifference(digests[block].operators, reference[block].operators).c_str());
+			succeeded = false;
+			break;
+		}
+	}
+	if (digests.size() != reference.size()) {
+		report(log, "%u blocks rendered, %u in the reference", Bit32u(digests.size()), Bit32u(reference.size()));
+		succeeded = false;
+	}
+	return succeeded;
+}
+
+// Loads a corpus item and renders it with the given vector kernels, see renderItem()
+static bool renderCorpusItem(const std::string &name, const std::string &fileName, Bit32u sampleRate, Bit32u simdLevel,
+	const Options &options, ItemDigests &digests, std::string &log) {
+	if (getFileExtension(name) == "regs") {
+		RegisterScript script;
+		std::string error;
+		if (!script.load(fileName.c_str(), error)) {
+			report(log, "%s", error.c_str());
+			return false;
+		}
+		RegisterItemRenderer renderer(script);
+		RegisterItemRenderer referenceRenderer(script);
+		return renderer.open(true, sampleRate, simdLevel) && referenceRenderer.open(false, sampleRate, simdLevel)
+			&& renderItem(name, renderer, referenceRenderer, options, digests, log);
+	}
+	SmfSequence sequence;
+	if (!sequence.load(fileName.c_str(), sampleRate)) {
+		report(log, "%s", sequence.getError());
+		return false;
+	}
+	MidiItemRenderer renderer(sequence);
+	MidiItemRenderer referenceRenderer(sequence);
+	if (!renderer.open(true, simdLevel, options.snapshot) || !referenceRenderer.open(false, simdLevel, options.snapshot)) {
+		return false;
+	}
+	bool succeeded = renderItem(name, renderer, referenceRenderer, options, digests, log);
+	const std::string &error = renderer.getSnapshotError().empty() ? referenceRenderer.getSnapshotError() : renderer.getSnapshotError();
+	if (!error.empty()) {
+		report(log, "snapshot halfway: %s", error.c_str());
+		succeeded = false;
+	}
+	return succeeded;
+}
+
+static void printUsage() {
+	fprintf(stderr,
+		"Usage: fb01golden [options] corpus_directory\n"
+		"Renders each .mid and .regs file of the corpus and compares the output with the corpus reference.txt.\n"
+		"Options:\n"
+		"  -u      rewrite reference.txt with the output of this build instead\n"
+		"  -w dir  also write the output of each item to dir, as raw 16-bit stereo\n"
+		"  -c dir  also compare the output sample by sample with that written by -w from another build\n"
+		"  -s      also continue each MIDI item halfway in a new synth restored from a snapshot\n"
+		"  -v      list every item, not only those that fail\n");
+}
+
+static bool parseOptions(int argc, char *argv[], Options &options) {
+	options.update = false;
+	options.verbose = false;
+	options.snapshot = false;
+	options.writeDirectory = NULL;
+	options.compareDirectory = NULL;
+
+	int i = 1;
+	for (; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+		const char *option = argv[i];
+		if (strcmp(option, "-u") == 0) {
+			options.update = true;
+		} else if (strcmp(option, "-v") == 0) {
+			options.verbose = true;
+		} else if (strcmp(option, "-s") == 0) {
+			options.snapshot = true;
+		} else if (strcmp(option, "-w") == 0 && i + 1 < argc) {
+			options.writeDirectory = argv[++i];
+		} else if (strcmp(option, "-c") == 0 && i + 1 < argc) {
+			options.compareDirectory = argv[++i];
+		} else {
+			return false;
+		}
+	}
+	if (i + 1 != argc) return false;
+	options.corpusDirectory = argv[i];
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	Options options;
+	if (!parseOptions(argc, argv, options)) {
+		printUsage();
+		return 1;
+	}
+	std::string corpusDirectory = options.corpusDirectory;
+	std::string referenceFileName = corpusDirectory + "/" + REFERENCE_FILE_NAME;
+
+	std::vector<std::string> fileNames;
+	if (!listDirectory(corpusDirectory, fileNames)) {
+		fprintf(stderr, "fb01golden: Cannot read the directory %s\n", corpusDirectory.c_str());
+		return 1;
+	}
+	std::map<std::string, ItemDigests> reference;
+	if (!options.update && !readReference(referenceFileName, reference)) {
+		fprintf(stderr, "fb01golden: Cannot read %s, create it with -u\n", referenceFileName.c_str());
+		return 1;
+	}
+
+	Bit32u sampleRate;
+	Bit32u topSIMDLevel;
+	{
+		Synth synth;
+		if (!synth.open()) {
+			fprintf(stderr, "fb01golden: Failed to open the synth\n");
+			return 1;
+		}
+		sampleRate = synth.getStereoOutputSampleRate();
+		topSIMDLevel = synth.setChipSIMDLevel(SIMD_LEVEL_COUNT - 1);
+	}
+	// The output of the lower levels is only compared, -w and -c apply to the top level
+	Options fallbackOptions = options;
+	fallbackOptions.writeDirectory = NULL;
+	fallbackOptions.compareDirectory = NULL;
+
+	std::map<std::string, ItemDigests> rendered;
+	Bit32u itemCount = 0;
+	Bit32u failedCount = 0;
+	for (size_t i = 0; i < fileNames.size(); i++) {
+		const std::string &name = fileNames[i];
+		std::string extension = getFileExtension(name);
+		if (extension != "mid" && extension != "midi" && extension != "regs") continue;
+		std::string fileName = corpusDirectory + "/" + name;
+		itemCount++;
+		std::string log;
+
+		ItemDigests &digests = rendered[name];
+		bool succeeded = renderCorpusItem(name, fileName, sampleRate, topSIMDLevel, options, digests, log);
+		// With -u, the lower levels are held to the output of the top level, which becomes the reference
+		const ItemDigests *expected = &digests;
+		if (!options.update) {
+			std::map<std::string, ItemDigests>::const_iterator it = reference.find(name);
+			if (it == reference.end()) {
+				report(log, "not in the reference, add it with -u");
+				expected = NULL;
+				succeeded = false;
+			} else {
+				expected = &it->second;
+				if (!compareItem(digests, it->second, log)) succeeded = false;
+			}
+		}
+		for (Bit32u level = topSIMDLevel; level-- > 0;) {
+			ItemDigests levelDigests;
+			std::string levelLog;
+			bool levelSucceeded = renderCorpusItem(name, fileName, sampleRate, level, fallbackOptions, levelDigests, levelLog);
+			if (expected != NULL && !compareItem(levelDigests, *expected, levelLog)) levelSucceeded = false;
+			if (!levelSucceeded) {
+				report(log, "with the %s kernels:", SIMD_LEVEL_NAMES[level]);
+				log += levelLog;
+				succeeded = false;
+			}
+		}
+		if (!succeeded) failedCount++;
+		if (!succeeded || options.verbose) {
+			printf("%s: %s\n%s", name.c_str(), succeeded ? "ok" : "FAILED", log.c_str());
+			fflush(stdout);
+		}
+	}
+	for (std::map<std::string, ItemDigests>::const_iterator it = reference.begin(); it != reference.end(); ++it) {
+		if (rendered.find(it->first) == rendered.end()) {
+			printf("%s: FAILED\n  in the reference but missing from the corpus\n", it->first.c_str());
+			failedCount++;
+		}
+	}
+
+	if (options.update) {
+		if (!writeReference(referenceFileName, rendered)) {
+			fprintf(stderr, "fb01golden: Cannot write %s\n", referenceFileName.c_str());
+			return 1;
+		}
+		printf("%u items written to %s\n", itemCount, referenceFileName.c_str());
+	} else {
+		printf("%u items, %u failed, with the %s kernels and those below\n", itemCount, failedCount, SIMD_LEVEL_NAMES[topSIMDLevel]);
+	}
+	return failedCount == 0 ? 0 : 1;
+}
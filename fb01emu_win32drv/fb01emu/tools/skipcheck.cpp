@@ -0,0 +1,225 @@
+/* Copyright (C) 2026 FB-01 Emulator contributors
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks ym2151_skip() against rendering the same span with ym2151_update_one(). The chip source is compiled
+// into this tool rather than linked, so that the internal state left by both can be compared field by field.
+//
+// Two chips get the same random register writes, then one renders a span while the other skips it. Afterwards
+// the envelope counter, LFO, noise generator and every operator's envelope must match, and so must the phases
+// of the sounding operators without phase modulation; a key on clears the phase of the others. Skipping doesn't compute the operator outputs, so the feedback and
+// MEM values are copied over from the rendering chip, along with the phases that took phase modulation; from
+// there on both chips must render bit-identical output. The closed form jump of the noise register is also
+// checked on its own against shifting the register one step at a time.
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "ym2151.cpp"
+
+static const int CLOCK = 4000000;
+static const int SAMPLE_RATE = 44100;
+static const unsigned int SPAN_COUNT = 1000;
+// Rendered by both chips after each skip
+static const int AFTER_SKIP_FRAMES = 1024;
+static const int RENDER_CHUNK_FRAMES = 65536;
+// Length of the sequence of the noise register, 2^17 - 1
+static const UINT64 NOISE_PERIOD = 0x1ffff;
+
+// Deterministic, so that every run checks the same spans
+class Random {
+	UINT32 state;
+
+public:
+	explicit Random(UINT32 seed) : state(seed) {}
+
+	UINT32 next(UINT32 range) {
+		state = state * 1664525u + 1013904223u;
+		return UINT32((UINT64(state >> 8) * range) >> 24);
+	}
+};
+
+// The noise generator of advance_lfo(), one shift at a time
+static UINT32 shiftNoise(UINT32 rng, UINT64 shifts) {
+	while (shifts-- > 0) {
+		UINT32 j = ((rng ^ (rng >> 3)) & 1) ^ 1;
+		rng = (j << 16) | (rng >> 1);
+	}
+	return rng;
+}
+
+static unsigned int checkNoiseJump(Random &random) {
+	// All ones is the lock-up state of the XNOR register, zero is where the chip starts
+	static const UINT32 SEEDS[] = {0, 0x1ffff, 1, 0x10000, 0x0ffff};
+	unsigned int failures = 0;
+	for (unsigned int i = 0; i < 2000; i++) {
+		UINT32 rng = i < sizeof(SEEDS) / sizeof(SEEDS[0]) ? SEEDS[i] : random.next(0x20000);
+		UINT64 shifts = (i & 1) ? random.next(300000) : i % 64;
+		if (lfsr_jump(rng, shifts) != shiftNoise(rng, shifts)) {
+			if (failures++ < 5) printf("skipcheck: noise jump of %05x by %llu shifts differs\n", rng, (unsigned long long)shifts);
+		}
+	}
+	// Counts beyond any render: the sequence repeats every NOISE_PERIOD shifts
+	for (unsigned int i = 0; i < 100; i++) {
+		UINT32 rng = random.next(0x20000);
+		UINT64 remainder = random.next(1000);
+		UINT64 shifts = NOISE_PERIOD * (1 + random.next(1u << 24)) * (1 + random.next(1u << 16)) + remainder;
+		if (lfsr_jump(rng, shifts) != shiftNoise(rng, remainder)) {
+			if (failures++ < 5) printf("skipcheck: noise jump of %05x by %llu shifts differs\n", rng, (unsigned long long)shifts);
+		}
+	}
+	return failures;
+}
+
+static void writeRandomRegisters(YM2151 *rendered, YM2151 *skipped, Random &random) {
+	UINT32 count = random.next(24);
+	for (UINT32 i = 0; i < count; i++) {
+		UINT32 channel = random.next(8);
+		int reg, value;
+		switch (random.next(8)) {
+		case 0: // RL, feedback, connection
+			reg = 0x20 + channel;
+			value = 0xc0 | random.next(0x40);
+			break;
+		case 1: // key code
+			reg = 0x28 + channel;
+			value = random.next(0x80);
+			break;
+		case 2: // key on and off
+			reg = 0x08;
+			value = channel | (random.next(16) << 3);
+			break;
+		case 3: // operator parameters, 0x40 to 0xff
+			reg = 0x40 + 0x20 * random.next(6) + random.next(32);
+			value = random.next(256);
+			break;
+		case 4: // noise enable and frequency
+			reg = 0x0f;
+			value = random.next(256) & 0x9f;
+			break;
+		case 5: // LFO frequency
+			reg = 0x18;
+			value = random.next(256);
+			break;
+		case 6: // AMD, PMD, waveform
+			reg = random.next(2) ? 0x19 : 0x1b;
+			value = random.next(256);
+			break;
+		default: // PMS, AMS
+			reg = 0x38 + channel;
+			value = random.next(256);
+			break;
+		}
+		ym2151_write_reg(rendered, reg, value);
+		ym2151_write_reg(skipped, reg, value);
+	}
+}
+
+static void render(YM2151 *chip, std::vector<SAMP> &left, std::vector<SAMP> &right, int length) {
+	for (int done = 0; done < length; done += RENDER_CHUNK_FRAMES) {
+		int chunk = length - done < RENDER_CHUNK_FRAMES ? length - done : RENDER_CHUNK_FRAMES;
+		SAMP *buffers[] = {&left[0], &right[0]};
+		ym2151_update_one(chip, buffers, chunk);
+	}
+}
+
+static bool phaseModulated(const YM2151 *chip, unsigned int channel) {
+	return chip->oper[channel * 4].pms != 0 && chip->pmd != 0;
+}
+
+// The state that ym2151_skip() computes, see its description
+static bool compareState(const YM2151 *rendered, const YM2151 *skipped) {
+	bool same = rendered->eg_cnt == skipped->eg_cnt && rendered->eg_timer == skipped->eg_timer
+		&& rendered->lfo_phase == skipped->lfo_phase && rendered->lfo_timer == skipped->lfo_timer
+		&& rendered->lfo_counter == skipped->lfo_counter && rendered->lfa == skipped->lfa && rendered->lfp == skipped->lfp
+		&& rendered->noise_rng == skipped->noise_rng && rendered->noise_p == skipped->noise_p;
+	for (unsigned int i = 0; i < 32; i++) {
+		const YM2151Operator &a = rendered->oper[i];
+		const YM2151Operator &b = skipped->oper[i];
+		if (a.volume != b.volume || a.state != b.state) same = false;
+		if (a.state != EG_OFF && !phaseModulated(rendered, i / 4) && a.phase != b.phase) same = false;
+	}
+	return same;
+}
+
+// Copies what ym2151_skip() leaves alone
+static void copyUncomputed(const YM2151 *rendered, YM2151 *skipped) {
+	for (unsigned int i = 0; i < 32; i++) {
+		const YM2151Operator &a = rendered->oper[i];
+		YM2151Operator &b = skipped->oper[i];
+		b.fb_out_prev = a.fb_out_prev;
+		b.fb_out_curr = a.fb_out_curr;
+		b.mem_value = a.mem_value;
+		if (phaseModulated(rendered, i / 4)) b.phase = a.phase;
+	}
+	skipped->active_channels = rendered->active_channels;
+}
+
+static unsigned int checkSpans(Random &random) {
+	YM2151 *rendered = (YM2151 *)ym2151_init(NULL, CLOCK, SAMPLE_RATE);
+	YM2151 *skipped = (YM2151 *)ym2151_init(NULL, CLOCK, SAMPLE_RATE);
+	if (rendered == NULL || skipped == NULL) {
+		printf("skipcheck: Failed to create the chips\n");
+		return 1;
+	}
+	ym2151_reset_chip(rendered);
+	ym2151_reset_chip(skipped);
+	std::vector<SAMP> left(RENDER_CHUNK_FRAMES), right(RENDER_CHUNK_FRAMES);
+	std::vector<SAMP> otherLeft(RENDER_CHUNK_FRAMES), otherRight(RENDER_CHUNK_FRAMES);
+	std::vector<UINT8> state(ym2151_save_state(rendered, NULL, 0));
+
+	unsigned int stateFailures = 0, outputFailures = 0;
+	for (unsigned int span = 0; span < SPAN_COUNT; span++) {
+		writeRandomRegisters(rendered, skipped, random);
+		// Mostly short spans as between MIDI events, sometimes long ones across many LFO and envelope periods
+		int length = 1 + int(random.next(16) == 0 ? random.next(1000000) : random.next(3000));
+		render(rendered, left, right, length);
+		ym2151_skip(skipped, length);
+
+		if (!compareState(rendered, skipped)) {
+			if (stateFailures++ < 5) printf("skipcheck: span %u of %d frames, the state after the skip differs\n", span, length);
+		} else {
+			copyUncomputed(rendered, skipped);
+			render(rendered, left, right, AFTER_SKIP_FRAMES);
+			render(skipped, otherLeft, otherRight, AFTER_SKIP_FRAMES);
+			for (int i = 0; i < AFTER_SKIP_FRAMES; i++) {
+				if (left[i] != otherLeft[i] || right[i] != otherRight[i]) {
+					if (outputFailures++ < 5) printf("skipcheck: span %u of %d frames, the output after the skip differs at frame %d\n", span, length, i);
+					break;
+				}
+			}
+		}
+
+		// Start the next span from the same state, so that a difference is reported where it arises
+		ym2151_save_state(rendered, &state[0], UINT32(state.size()));
+		if (ym2151_load_state(skipped, &state[0], UINT32(state.size())) != 0) {
+			printf("skipcheck: Failed to copy the chip state\n");
+			return stateFailures + outputFailures + 1;
+		}
+	}
+	ym2151_shutdown(rendered);
+	ym2151_shutdown(skipped);
+	return stateFailures + outputFailures;
+}
+
+int main() {
+	Random random(0x534b4950);
+	unsigned int noiseFailures = checkNoiseJump(random);
+	unsigned int spanFailures = checkSpans(random);
+	printf("skipcheck: noise jump %s, %u spans %s\n", noiseFailures == 0 ? "ok" : "FAILED", SPAN_COUNT,
+		spanFailures == 0 ? "ok" : "FAILED");
+	return noiseFailures == 0 && spanFailures == 0 ? 0 : 1;
+}
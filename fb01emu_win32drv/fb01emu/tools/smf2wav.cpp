@@ -0,0 +1,420 @@
+/* Copyright (C) 2026 FB-01 Emulator contributors
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Offline renderer: plays Standard MIDI Files through the emulated FB-01 as fast as possible
+// and writes the output to WAVE or raw PCM files. In batch mode, the files are rendered in parallel,
+// each by its own Synth instance.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mt32emu.h"
+#include "DirectoryList.h"
+#include "SmfSequence.h"
+#include "WaveFile.h"
+
+using namespace MT32Emu;
+
+// Frames rendered per call to Synth::render()
+static const Bit32u RENDER_CHUNK_FRAMES = 4096;
+// Frames skipped per call to Synth::skip(), it needs no buffer
+static const Bit32u SKIP_CHUNK_FRAMES = 0x10000000;
+
+struct Options {
+	WaveFile::Format format;
+	MIDIDelayMode midiDelayMode;
+	bool blockRendering;
+	double startSeconds;
+	double tailSeconds;
+	bool quiet;
+	bool writeVGM;
+	// Batch mode is enabled by an output directory
+	const char *outputDirectory;
+	const char *listFileName;
+	Bit32u threadCount;
+};
+
+struct RenderJob {
+	std::string inputFileName;
+	std::string outputFileName;
+	std::string vgmFileName;
+	// Results
+	bool succeeded;
+	Bit32u eventCount;
+	double audioSeconds;
+	double seconds;
+};
+
+static void printUsage() {
+	fprintf(stderr,
+		"Usage: smf2wav [options] input.mid output.wav\n"
+		"       smf2wav [options] -o directory [-j threads] [-l list] input.mid|directory...\n"
+		"Options:\n"
+		"  -r          write headerless raw PCM instead of a WAVE file\n"
+		"  -f          write 32-bit float samples instead of 16-bit integer\n"
+		"  -k seconds  start the output this far into the sequence, fast forwarding to it\n"
+		"  -t seconds  render this long past the end of the sequence (default 2)\n"
+		"  -d mode     MIDI interface delay: 0 none, 1 short messages only (default), 2 all\n"
+		"  -s          render the YM2151 sample by sample (reference implementation)\n"
+		"  -g          also record the YM2151 register writes to a VGM file, named after the output\n"
+		"  -q          don't print the statistics\n"
+		"Batch mode:\n"
+		"  -o dir      render every input to dir, named after the input with the extension replaced\n"
+		"              (inputs with the same name get a -2, -3... suffix)\n"
+		"  -j threads  number of files rendered at once (default: number of CPUs)\n"
+		"  -l list     also render the files named in list, one per line\n"
+		"  Directories are searched (not recursively) for .mid and .midi files.\n");
+}
+
+static bool parseOptions(int argc, char *argv[], Options &options, int &firstFile) {
+	bool raw = false;
+	bool floatSamples = false;
+	options.midiDelayMode = MIDIDelayMode_DELAY_SHORT_MESSAGES_ONLY;
+	options.blockRendering = true;
+	options.startSeconds = 0.0;
+	options.tailSeconds = 2.0;
+	options.quiet = false;
+	options.writeVGM = false;
+	options.outputDirectory = NULL;
+	options.listFileName = NULL;
+	options.threadCount = 0;
+
+	int i = 1;
+	for (; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+		const char *option = argv[i];
+		if (strcmp(option, "-r") == 0) {
+			raw = true;
+		} else if (strcmp(option, "-f") == 0) {
+			floatSamples = true;
+		} else if (strcmp(option, "-s") == 0) {
+			options.blockRendering = false;
+		} else if (strcmp(option, "-q") == 0) {
+			options.quiet = true;
+		} else if (strcmp(option, "-g") == 0) {
+			options.writeVGM = true;
+		} else if (strcmp(option, "-k") == 0 && i + 1 < argc) {
+			options.startSeconds = atof(argv[++i]);
+			if (options.startSeconds < 0.0) return false;
+		} else if (strcmp(option, "-t") == 0 && i + 1 < argc) {
+			options.tailSeconds = atof(argv[++i]);
+			if (options.tailSeconds < 0.0) return false;
+		} else if (strcmp(option, "-d") == 0 && i + 1 < argc) {
+			int mode = atoi(argv[++i]);
+			if (mode < MIDIDelayMode_IMMEDIATE || mode > MIDIDelayMode_DELAY_ALL) return false;
+			options.midiDelayMode = MIDIDelayMode(mode);
+		} else if (strcmp(option, "-o") == 0 && i + 1 < argc) {
+			options.outputDirectory = argv[++i];
+		} else if (strcmp(option, "-l") == 0 && i + 1 < argc) {
+			options.listFileName = argv[++i];
+		} else if (strcmp(option, "-j") == 0 && i + 1 < argc) {
+			int threadCount = atoi(argv[++i]);
+			if (threadCount < 1) return false;
+			options.threadCount = Bit32u(threadCount);
+		} else {
+			return false;
+		}
+	}
+	if (raw) {
+		options.format = floatSamples ? WaveFile::Format_RAW_FLOAT : WaveFile::Format_RAW_S16;
+	} else {
+		options.format = floatSamples ? WaveFile::Format_WAVE_FLOAT : WaveFile::Format_WAVE_S16;
+	}
+	firstFile = i;
+	return true;
+}
+
+// Enqueues the events due in the frameCount frames from now, returns the number of frames to process next.
+// When the queue is full, that stops at the first event not enqueued, so that it isn't delayed.
+static Bit32u enqueueEvents(Synth &synth, const std::vector<Synth::Event> &events, size_t &nextEvent, Bit64u now, Bit32u frameCount) {
+	size_t dueEvents = nextEvent;
+	while (dueEvents < events.size() && events[dueEvents].timestamp < now + frameCount) dueEvents++;
+	while (nextEvent < dueEvents) {
+		Bit32u count = dueEvents - nextEvent > 0xFFFFFFFFu ? 0xFFFFFFFFu : Bit32u(dueEvents - nextEvent);
+		Bit32u played = synth.playEvents(&events[nextEvent], count);
+		nextEvent += played;
+		if (played < count) break;
+	}
+	if (nextEvent < dueEvents) {
+		Bit64u timestamp = events[nextEvent].timestamp;
+		frameCount = timestamp > now ? Bit32u(timestamp - now) : 1;
+	}
+	return frameCount;
+}
+
+// Fast forwards the synth through the sequence up to startTimestamp with Synth::skip().
+static void skipSequence(Synth &synth, const std::vector<Synth::Event> &events, size_t &nextEvent, Bit64u startTimestamp) {
+	for (;;) {
+		Bit64u now = synth.getRenderedSampleCount();
+		if (now >= startTimestamp) break;
+		Bit64u framesLeft = startTimestamp - now;
+		Bit32u frameCount = framesLeft < SKIP_CHUNK_FRAMES ? Bit32u(framesLeft) : SKIP_CHUNK_FRAMES;
+		synth.skip(enqueueEvents(synth, events, nextEvent, now, frameCount));
+	}
+}
+
+// Feeds the sequence to the synth just ahead of the render position and writes everything rendered to the output.
+// Returns false if the output cannot be written.
+static bool renderSequence(Synth &synth, const std::vector<Synth::Event> &events, size_t &nextEvent, Bit64u endTimestamp, WaveFile &output) {
+	Bit16s bufferS16[2 * RENDER_CHUNK_FRAMES];
+	float bufferFloat[2 * RENDER_CHUNK_FRAMES];
+
+	for (;;) {
+		Bit64u now = synth.getRenderedSampleCount();
+		if (now >= endTimestamp) break;
+		Bit64u framesLeft = endTimestamp - now;
+		Bit32u frameCount = framesLeft < RENDER_CHUNK_FRAMES ? Bit32u(framesLeft) : RENDER_CHUNK_FRAMES;
+		frameCount = enqueueEvents(synth, events, nextEvent, now, frameCount);
+
+		if (output.isFloat()) {
+			synth.render(bufferFloat, frameCount);
+			if (!output.write(bufferFloat, frameCount)) return false;
+		} else {
+			synth.render(bufferS16, frameCount);
+			if (!output.write(bufferS16, frameCount)) return false;
+		}
+	}
+	return true;
+}
+
+// Renders a single file with its own Synth, so that any number of files can be rendered at once.
+// Errors are reported to stderr, output is serialised by the mutex.
+static void renderFile(RenderJob &job, const Options &options, std::mutex &outputMutex) {
+	job.succeeded = false;
+	job.eventCount = 0;
+	job.audioSeconds = 0.0;
+	job.seconds = 0.0;
+	const char *error = NULL;
+	const char *errorFileName = job.inputFileName.c_str();
+
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	Synth synth;
+	SmfSequence sequence;
+	WaveFile output;
+	if (!synth.open()) {
+		error = "failed to initialise the synth";
+	} else {
+		synth.setMIDIDelayMode(options.midiDelayMode);
+		synth.setBlockRenderingEnabled(options.blockRendering);
+		Bit32u sampleRate = synth.getStereoOutputSampleRate();
+		if (!sequence.load(job.inputFileName.c_str(), sampleRate)) {
+			error = sequence.getError();
+		} else if (!output.open(job.outputFileName.c_str(), options.format, sampleRate)) {
+			error = "cannot create file";
+			errorFileName = job.outputFileName.c_str();
+		} else {
+			Bit64u endTimestamp = sequence.getLength() + Bit64u(options.tailSeconds * sampleRate);
+			Bit64u startTimestamp = Bit64u(options.startSeconds * sampleRate);
+			if (startTimestamp > endTimestamp) startTimestamp = endTimestamp;
+			size_t nextEvent = 0;
+			skipSequence(synth, sequence.getEvents(), nextEvent, startTimestamp);
+			// The VGM file starts with the output, from the state the synth was fast forwarded to
+			if (options.writeVGM && !synth.startVGMRecording(job.vgmFileName.c_str())) {
+				output.close();
+				error = "cannot create file";
+				errorFileName = job.vgmFileName.c_str();
+			} else {
+				bool rendered = renderSequence(synth, sequence.getEvents(), nextEvent, endTimestamp, output);
+				bool vgmWritten = !options.writeVGM || synth.stopVGMRecording();
+				if (!output.close() || !rendered) {
+					error = "write error";
+					errorFileName = job.outputFileName.c_str();
+				} else if (!vgmWritten) {
+					error = "write error";
+					errorFileName = job.vgmFileName.c_str();
+				}
+			}
+		}
+	}
+	std::chrono::duration<double> renderTime = std::chrono::steady_clock::now() - startTime;
+
+	std::lock_guard<std::mutex> lock(outputMutex);
+	if (error != NULL) {
+		fprintf(stderr, "smf2wav: %s: %s\n", errorFileName, error);
+		return;
+	}
+	job.succeeded = true;
+	job.eventCount = Bit32u(sequence.getEvents().size());
+	job.audioSeconds = double(output.getFrameCount()) / synth.getStereoOutputSampleRate();
+	job.seconds = renderTime.count();
+	if (!options.quiet) {
+		printf("%s: %u events, %.1f s of audio rendered in %.3f s", job.inputFileName.c_str(), job.eventCount, job.audioSeconds, job.seconds);
+		if (job.seconds > 0.0) printf(", %.1fx realtime", job.audioSeconds / job.seconds);
+		printf("\n");
+		fflush(stdout);
+	}
+}
+
+static bool hasMidiExtension(const std::string &fileName) {
+	std::string extension = getFileExtension(fileName);
+	return extension == "mid" || extension == "midi";
+}
+
+// Appends the MIDI files of the directory to the list, returns false if the path isn't a directory
+static bool listMidiFiles(const std::string &path, std::vector<std::string> &fileNames) {
+	std::vector<std::string> entries;
+	if (!listDirectory(path, entries)) return false;
+	for (size_t i = 0; i < entries.size(); i++) {
+		if (hasMidiExtension(entries[i])) fileNames.push_back(path + "/" + entries[i]);
+	}
+	return true;
+}
+
+// Inputs with the same name, such as a/x.mid and b/x.mid or x.mid and x.midi, would overwrite each other's output.
+// The later ones get a -2, -3... suffix instead. usedNames holds the names taken so far, in lower case, as the file
+// system may ignore the case.
+static std::string makeOutputFileName(const std::string &inputFileName, const Options &options, std::set<std::string> &usedNames) {
+	size_t nameStart = inputFileName.find_last_of("/\\");
+	std::string name = inputFileName.substr(nameStart == std::string::npos ? 0 : nameStart + 1);
+	size_t dot = name.find_last_of('.');
+	if (dot != std::string::npos) name.erase(dot);
+	std::string uniqueName = name;
+	for (Bit32u suffix = 2;; suffix++) {
+		std::string key = uniqueName;
+		for (size_t i = 0; i < key.size(); i++) {
+			if (key[i] >= 'A' && key[i] <= 'Z') key[i] += 'a' - 'A';
+		}
+		if (usedNames.insert(key).second) break;
+		uniqueName = name + "-" + std::to_string(suffix);
+	}
+	bool raw = options.format == WaveFile::Format_RAW_S16 || options.format == WaveFile::Format_RAW_FLOAT;
+	std::string outputFileName = std::string(options.outputDirectory) + "/" + uniqueName + (raw ? ".raw" : ".wav");
+	if (uniqueName != name) {
+		fprintf(stderr, "smf2wav: %s: output renamed to %s, the name is taken by another input\n", inputFileName.c_str(),
+			outputFileName.c_str());
+	}
+	return outputFileName;
+}
+
+// The VGM file goes next to the output, with the extension replaced
+static std::string makeVGMFileName(const std::string &outputFileName) {
+	size_t nameStart = outputFileName.find_last_of("/\\");
+	size_t dot = outputFileName.find_last_of('.');
+	if (dot == std::string::npos || (nameStart != std::string::npos && dot < nameStart)) dot = outputFileName.size();
+	return outputFileName.substr(0, dot) + ".vgm";
+}
+
+static int renderBatch(int fileCount, char *fileArgs[], const Options &options) {
+	std::vector<std::string> inputFileNames;
+	for (int i = 0; i < fileCount; i++) {
+		if (!listMidiFiles(fileArgs[i], inputFileNames)) inputFileNames.push_back(fileArgs[i]);
+	}
+	if (options.listFileName != NULL) {
+		FILE *listFile = fopen(options.listFileName, "r");
+		if (listFile == NULL) {
+			fprintf(stderr, "smf2wav: %s: cannot open file\n", options.listFileName);
+			return 1;
+		}
+		char line[4096];
+		while (fgets(line, sizeof(line), listFile) != NULL) {
+			size_t length = strcspn(line, "\r\n");
+			if (length > 0) inputFileNames.push_back(std::string(line, length));
+		}
+		fclose(listFile);
+	}
+	if (inputFileNames.empty()) {
+		fprintf(stderr, "smf2wav: no input files\n");
+		return 1;
+	}
+
+	std::vector<RenderJob> jobs(inputFileNames.size());
+	std::set<std::string> usedNames;
+	for (size_t i = 0; i < jobs.size(); i++) {
+		jobs[i].inputFileName = inputFileNames[i];
+		jobs[i].outputFileName = makeOutputFileName(inputFileNames[i], options, usedNames);
+		jobs[i].vgmFileName = makeVGMFileName(jobs[i].outputFileName);
+	}
+
+	Bit32u threadCount = options.threadCount;
+	if (threadCount == 0) threadCount = std::thread::hardware_concurrency();
+	if (threadCount == 0) threadCount = 1;
+	if (threadCount > jobs.size()) threadCount = Bit32u(jobs.size());
+
+	// Each worker takes the next file not yet taken until none are left, so long files don't hold up the rest
+	std::atomic<size_t> nextJob(0);
+	std::mutex outputMutex;
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	std::vector<std::thread> workers;
+	for (Bit32u i = 0; i < threadCount; i++) {
+		workers.push_back(std::thread([&]() {
+			for (size_t job; (job = nextJob++) < jobs.size();) {
+				renderFile(jobs[job], options, outputMutex);
+			}
+		}));
+	}
+	for (size_t i = 0; i < workers.size(); i++) {
+		workers[i].join();
+	}
+	std::chrono::duration<double> wallTime = std::chrono::steady_clock::now() - startTime;
+
+	Bit32u failedCount = 0;
+	Bit64u eventCount = 0;
+	double audioSeconds = 0.0;
+	double cpuSeconds = 0.0;
+	for (size_t i = 0; i < jobs.size(); i++) {
+		if (!jobs[i].succeeded) {
+			failedCount++;
+			continue;
+		}
+		eventCount += jobs[i].eventCount;
+		audioSeconds += jobs[i].audioSeconds;
+		cpuSeconds += jobs[i].seconds;
+	}
+	if (!options.quiet) {
+		double seconds = wallTime.count();
+		printf("%u files rendered, %u failed, %u threads\n", Bit32u(jobs.size()) - failedCount, failedCount, threadCount);
+		printf("%llu events, %.1f s of audio rendered in %.3f s", (unsigned long long)eventCount, audioSeconds, seconds);
+		if (seconds > 0.0) printf(", %.1fx realtime", audioSeconds / seconds);
+		if (cpuSeconds > 0.0) printf(" (%.1fx per thread)", audioSeconds / cpuSeconds);
+		printf("\n");
+	}
+	return failedCount == 0 ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+	Options options;
+	int firstFile;
+	if (!parseOptions(argc, argv, options, firstFile)) {
+		printUsage();
+		return 1;
+	}
+	if (options.outputDirectory != NULL) {
+		if (argc == firstFile && options.listFileName == NULL) {
+			printUsage();
+			return 1;
+		}
+		return renderBatch(argc - firstFile, argv + firstFile, options);
+	}
+	if (argc - firstFile != 2) {
+		printUsage();
+		return 1;
+	}
+	RenderJob job;
+	job.inputFileName = argv[firstFile];
+	job.outputFileName = argv[firstFile + 1];
+	job.vgmFileName = makeVGMFileName(job.outputFileName);
+	std::mutex outputMutex;
+	renderFile(job, options, outputMutex);
+	return job.succeeded ? 0 : 1;
+}
@@ -0,0 +1,47 @@
+# Records a MIDI file as VGM with smf2wav -g, from the start and from part way through with -k, and replays both
+# recordings with vgm2wav against the smf2wav output. The full recording must replay bit for bit. The one started
+# part way lacks the internal counters of the chip, so it is held to a signal to noise ratio instead, which still
+# catches register state missing from its preamble. Last, a replay longer than the WAVE file it is compared with must
+# fail on the length rather than read past the end of the file.
+#
+# cmake -DSMF2WAV=... -DVGM2WAV=... -DINPUT=file.mid -DSKIP_SECONDS=n -DMIN_SNR=dB -DWORK_DIRECTORY=dir -P replay.cmake
+
+file(MAKE_DIRECTORY ${WORK_DIRECTORY})
+
+function(check_replay name)
+	set(wave ${WORK_DIRECTORY}/${name}.wav)
+	set(vgm ${WORK_DIRECTORY}/${name}.vgm)
+	execute_process(COMMAND ${SMF2WAV} -q -g ${ARGN} ${INPUT} ${wave} RESULT_VARIABLE result)
+	if(NOT result EQUAL 0)
+		message(FATAL_ERROR "smf2wav failed to record ${name}")
+	endif()
+	if(name STREQUAL "full")
+		set(compare -c ${wave})
+	else()
+		set(compare -c ${wave} -d ${MIN_SNR})
+	endif()
+	execute_process(COMMAND ${VGM2WAV} ${compare} ${vgm} RESULT_VARIABLE result)
+	if(NOT result EQUAL 0)
+		message(FATAL_ERROR "The replay of ${name}.vgm doesn't match the smf2wav output")
+	endif()
+endfunction()
+
+# Register scripts as in the fb01golden corpus, the short one renders the reference for the long one
+function(check_short_reference)
+	set(short ${WORK_DIRECTORY}/short)
+	set(long ${WORK_DIRECTORY}/long)
+	file(WRITE ${short}.regs "w 08 00\nr 10\n")
+	file(WRITE ${long}.regs "w 08 00\nr 400000\n")
+	execute_process(COMMAND ${VGM2WAV} ${short}.regs ${short}.wav RESULT_VARIABLE result OUTPUT_QUIET)
+	if(NOT result EQUAL 0)
+		message(FATAL_ERROR "vgm2wav failed to render short.regs")
+	endif()
+	execute_process(COMMAND ${VGM2WAV} -c ${short}.wav ${long}.regs RESULT_VARIABLE result OUTPUT_VARIABLE output)
+	if(NOT result EQUAL 1 OR NOT output MATCHES "10 frames, 400000 rendered")
+		message(FATAL_ERROR "The replay of long.regs against a shorter reference gave ${result}:\n${output}")
+	endif()
+endfunction()
+
+check_replay(full)
+check_replay(skipped -k ${SKIP_SECONDS})
+check_short_reference()
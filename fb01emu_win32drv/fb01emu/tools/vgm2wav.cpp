@@ -0,0 +1,524 @@
+/* Copyright (C) 2026 FB-01 Emulator contributors
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// Plays a VGM file, or a register script as used by the fb01golden corpus, on the YM2151 emulation alone:
+// the register writes go straight to ym2151_write_reg() and the waits between them are rendered in blocks as
+// long as the waits allow. No MIDI parsing and no VFB-01 logic is involved, which makes this both a fast
+// re-render of performances recorded with smf2wav -g and a benchmark of the chip core on real material.
+//
+// The input is memory mapped and parsed as it is played.
+//
+// With -c, the output is compared with a WAVE file, usually the smf2wav output the VGM file was recorded with.
+// A full recording replays bit for bit. A recording started part way with -k doesn't carry the internal state of
+// the chip, such as the envelope and LFO counters, so it is held to a minimum signal to noise ratio with -d.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "mt32emu.h"
+#include "DirectoryList.h"
+#include "MappedFile.h"
+#include "WaveFile.h"
+
+extern "C"
+{
+#include "ym2151.h"
+}
+
+using namespace MT32Emu;
+
+typedef std::chrono::steady_clock Clock;
+
+// The time base of VGM waits, and the rate everything is rendered at
+static const Bit32u VGM_SAMPLE_RATE = 44100;
+// Frames rendered per call to the chip at most
+static const Bit32u RENDER_BLOCK_FRAMES = 16384;
+// The clock of the YM2151 in the FB-01, used for register scripts which don't specify one
+static const Bit32u FB01_CHIP_CLOCK = 4000000;
+
+static const size_t VGM_MIN_HEADER_SIZE = 0x40;
+static const Bit32u VGM_MIN_VERSION_YM2151_CLOCK = 0x110;
+static const Bit32u VGM_MIN_VERSION_DATA_OFFSET = 0x150;
+// Bit 31 of a clock selects a second chip, bit 30 variants of some chips
+static const Bit32u VGM_CLOCK_MASK = 0x3FFFFFFF;
+
+struct Options {
+	bool blockRendering;
+	bool raw;
+	const char *compareFileName;
+	// Minimum signal to noise ratio of the comparison in dB, any difference fails when negative
+	double minSNR;
+	Bit32u repeats;
+	const char *inputFileName;
+	const char *outputFileName;
+};
+
+// A register write, or a wait when frames isn't zero
+struct Command {
+	Bit32u frames;
+	Bit8u reg;
+	Bit8u value;
+};
+
+class CommandReader {
+public:
+	virtual ~CommandReader() {}
+	// Returns false at the end of the input or on an error, see getError()
+	virtual bool next(Command &command) = 0;
+	virtual Bit32u getChipClock() const = 0;
+	// NULL unless the input was malformed
+	const char *getError() const { return error; }
+
+protected:
+	const char *error;
+
+	CommandReader() : error(NULL) {}
+};
+
+static Bit32u getLittleEndian16(const Bit8u *src) {
+	return Bit32u(src[0]) | (Bit32u(src[1]) << 8);
+}
+
+static Bit32u getLittleEndian32(const Bit8u *src) {
+	return Bit32u(src[0]) | (Bit32u(src[1]) << 8) | (Bit32u(src[2]) << 16) | (Bit32u(src[3]) << 24);
+}
+
+// VGM 1.51 and earlier and later versions as far as the YM2151 is concerned. The commands of other chips and the
+// second YM2151 are skipped, data blocks too. The loop is not played.
+class VgmReader : public CommandReader {
+public:
+	VgmReader(const Bit8u *useData, size_t useSize) : data(useData), position(0), end(0), chipClock(0) {
+		if (useSize >= 2 && data[0] == 0x1F && data[1] == 0x8B) {
+			error = "Compressed VGM files are not supported, unpack with gzip -d";
+			return;
+		}
+		if (useSize < VGM_MIN_HEADER_SIZE || memcmp(data, "Vgm ", 4) != 0) {
+			error = "Not a VGM file";
+			return;
+		}
+		Bit32u version = getLittleEndian32(data + 0x08);
+		// The end of the data, relative to its field
+		Bit64u eofOffset = Bit64u(getLittleEndian32(data + 0x04)) + 0x04;
+		end = eofOffset < useSize ? size_t(eofOffset) : useSize;
+		// Before 1.10, the YM2413 clock was shared by the YM2151 and the YM2612
+		chipClock = getLittleEndian32(data + (version < VGM_MIN_VERSION_YM2151_CLOCK ? 0x10 : 0x30)) & VGM_CLOCK_MASK;
+		Bit32u dataOffset = version < VGM_MIN_VERSION_DATA_OFFSET ? 0 : getLittleEndian32(data + 0x34);
+		position = dataOffset == 0 ? VGM_MIN_HEADER_SIZE : size_t(dataOffset) + 0x34;
+		if (chipClock == 0) {
+			error = "The VGM file has no YM2151";
+		} else if (position > end) {
+			error = "The VGM header is corrupt";
+		}
+	}
+
+	bool next(Command &command) {
+		while (error == NULL && position < end) {
+			Bit8u code = data[position];
+			size_t length = getCommandLength(code);
+			if (length == 0) {
+				error = "Unknown VGM command";
+				return false;
+			}
+			if (code == 0x67) {
+				// Data block: 0x67 0x66 type size32
+				if (end - position < 7) break;
+				length = 7 + (getLittleEndian32(data + position + 3) & 0x7FFFFFFF);
+			}
+			if (end - position < length) break;
+			const Bit8u *operands = data + position + 1;
+			position += length;
+			command.frames = 0;
+			switch (code) {
+			case 0x54:
+				command.reg = operands[0];
+				command.value = operands[1];
+				return true;
+			case 0x61:
+				command.frames = Bit32u(operands[0]) | (Bit32u(operands[1]) << 8);
+				break;
+			case 0x62:
+				command.frames = 735;
+				break;
+			case 0x63:
+				command.frames = 882;
+				break;
+			case 0x66:
+				position = end;
+				return false;
+			default:
+				// 0x7n waits n + 1 frames, 0x8n writes the YM2612 DAC and waits n frames
+				if (code >= 0x70 && code <= 0x7F) command.frames = code - 0x6F;
+				if (code >= 0x80 && code <= 0x8F) command.frames = code - 0x80;
+				break;
+			}
+			if (command.frames > 0) return true;
+		}
+		if (error == NULL && position < end) error = "The VGM file is truncated";
+		return false;
+	}
+
+	Bit32u getChipClock() const { return chipClock; }
+
+private:
+	const Bit8u *data;
+	size_t position;
+	size_t end;
+	Bit32u chipClock;
+
+	// Including the command byte, zero if unknown. The data block (0x67) is handled by the caller.
+	static size_t getCommandLength(Bit8u code) {
+		if (code >= 0x30 && code <= 0x3F) return 2;
+		if (code >= 0x40 && code <= 0x4E) return 3;
+		if (code == 0x4F || code == 0x50) return 2;
+		if (code >= 0x51 && code <= 0x5F) return 3;
+		if (code >= 0x70 && code <= 0x8F) return 1;
+		if (code >= 0xA0 && code <= 0xBF) return 3;
+		if (code >= 0xC0 && code <= 0xDF) return 4;
+		if (code >= 0xE0) return 5;
+		switch (code) {
+		case 0x61: return 3;
+		case 0x62: case 0x63: case 0x66: return 1;
+		case 0x67: return 7;
+		case 0x68: return 12;
+		case 0x90: case 0x91: case 0x95: return 5;
+		case 0x92: return 6;
+		case 0x93: return 11;
+		case 0x94: return 2;
+		default: return 0;
+		}
+	}
+};
+
+// The register scripts of the fb01golden corpus, one command per line:
+//   w <register> <value>   writes a register, both in hex
+//   r <frames>             renders this many frames, in decimal
+// Empty lines and lines starting with # are ignored.
+class RegisterScriptReader : public CommandReader {
+public:
+	RegisterScriptReader(const Bit8u *useData, size_t useSize) : data(useData), size(useSize), position(0), lineNumber(0) {}
+
+	bool next(Command &command) {
+		while (error == NULL && position < size) {
+			// The mapping isn't terminated, so each line is copied out
+			char line[256];
+			size_t length = 0;
+			while (position < size && data[position] != '\n') {
+				if (length < sizeof(line) - 1) line[length++] = char(data[position]);
+				position++;
+			}
+			position++;
+			line[length] = '\0';
+			lineNumber++;
+
+			const char *text = line;
+			while (*text == ' ' || *text == '\t') text++;
+			if (*text == '#' || *text == '\r' || *text == '\0') continue;
+			unsigned int reg, value, frames;
+			if (sscanf(text, "w %x %x", &reg, &value) == 2 && reg <= 0xFF && value <= 0xFF) {
+				command.frames = 0;
+				command.reg = Bit8u(reg);
+				command.value = Bit8u(value);
+				return true;
+			}
+			if (sscanf(text, "r %u", &frames) == 1 && frames > 0) {
+				command.frames = frames;
+				command.reg = 0;
+				command.value = 0;
+				return true;
+			}
+			snprintf(message, sizeof(message), "Syntax error in line %u", lineNumber);
+			error = message;
+		}
+		return false;
+	}
+
+	Bit32u getChipClock() const { return FB01_CHIP_CLOCK; }
+
+private:
+	const Bit8u *data;
+	size_t size;
+	size_t position;
+	Bit32u lineNumber;
+	char message[64];
+};
+
+// Compares the output with a 16-bit stereo WAVE file, block by block as it is rendered
+class WaveComparison {
+public:
+	WaveComparison() : samples(NULL), frameCount(0), position(0), signalEnergy(0.0), errorEnergy(0.0), firstDifference(0), differs(false) {}
+
+	// Returns an error message, or NULL if the file is a 16-bit stereo WAVE file
+	const char *open(const char *fileName) {
+		if (!file.open(fileName)) return "cannot open file";
+		const Bit8u *data = file.getData();
+		size_t size = file.getSize();
+		if (size < 12 || memcmp(data, "RIFF", 4) != 0 || memcmp(data + 8, "WAVE", 4) != 0) return "not a WAVE file";
+		bool formatFound = false;
+		for (size_t chunk = 12; size - chunk >= 8;) {
+			Bit64u chunkSize = getLittleEndian32(data + chunk + 4);
+			const Bit8u *chunkData = data + chunk + 8;
+			size_t available = size - chunk - 8;
+			if (memcmp(data + chunk, "fmt ", 4) == 0 && chunkSize >= 16 && available >= 16) {
+				if (getLittleEndian16(chunkData) != 1 || getLittleEndian16(chunkData + 2) != 2
+					|| getLittleEndian16(chunkData + 14) != 16) return "not 16-bit stereo PCM";
+				formatFound = true;
+			} else if (memcmp(data + chunk, "data", 4) == 0 && formatFound) {
+				// smf2wav leaves the maximum size in files longer than RIFF allows
+				samples = chunkData;
+				frameCount = (chunkSize < available ? chunkSize : available) / 4;
+				return NULL;
+			}
+			if (chunkSize + (chunkSize & 1) >= available) break;
+			chunk += 8 + size_t(chunkSize + (chunkSize & 1));
+		}
+		return "no 16-bit stereo PCM data";
+	}
+
+	void compare(const Bit16s *frames, Bit32u count) {
+		// Beyond the end of the reference the frames are only counted, report() tells of the length
+		Bit64u left = position < frameCount ? frameCount - position : 0;
+		Bit32u compared = left < count ? Bit32u(left) : count;
+		const Bit8u *reference = compared > 0 ? samples + 4 * position : NULL;
+		for (Bit32u i = 0; i < 2 * compared; i++) {
+			double expected = Bit16s(getLittleEndian16(reference + 2 * i));
+			double error = frames[i] - expected;
+			signalEnergy += expected * expected;
+			errorEnergy += error * error;
+			if (error != 0.0 && !differs) {
+				firstDifference = position + i / 2;
+				differs = true;
+			}
+		}
+		position += count;
+	}
+
+	// Reports the result, returns false if it falls short of minSNR or the length differs
+	bool report(const char *fileName, double minSNR) const {
+		if (position != frameCount) {
+			printf("%s: %llu frames, %llu rendered\n", fileName, (unsigned long long)frameCount, (unsigned long long)position);
+			return false;
+		}
+		if (!differs) {
+			printf("%s: identical\n", fileName);
+			return true;
+		}
+		double snr = errorEnergy > 0.0 && signalEnergy > 0.0 ? 10.0 * log10(signalEnergy / errorEnergy) : 0.0;
+		printf("%s: differs from frame %llu, %.1f dB signal to noise\n", fileName, (unsigned long long)firstDifference, snr);
+		return minSNR >= 0.0 && snr >= minSNR;
+	}
+
+private:
+	MappedFile file;
+	const Bit8u *samples;
+	Bit64u frameCount;
+	Bit64u position;
+	double signalEnergy;
+	double errorEnergy;
+	Bit64u firstDifference;
+	bool differs;
+};
+
+struct PlayStats {
+	Bit64u writeCount;
+	Bit64u frameCount;
+	double seconds;
+};
+
+// Renders frameCount frames of the chip to the output and the comparison, if any
+static bool renderFrames(void *chip, bool blockRendering, Bit64u frameCount, WaveFile *output, WaveComparison *comparison) {
+	SAMP left[RENDER_BLOCK_FRAMES];
+	SAMP right[RENDER_BLOCK_FRAMES];
+	SAMP *channels[] = {left, right};
+	Bit16s frames[2 * RENDER_BLOCK_FRAMES];
+	while (frameCount > 0) {
+		Bit32u thisLen = frameCount < RENDER_BLOCK_FRAMES ? Bit32u(frameCount) : RENDER_BLOCK_FRAMES;
+		if (blockRendering) {
+			ym2151_update_block(chip, channels, int(thisLen));
+		} else {
+			ym2151_update_one(chip, channels, int(thisLen));
+		}
+		if (output != NULL || comparison != NULL) {
+			for (Bit32u i = 0; i < thisLen; i++) {
+				frames[2 * i] = left[i];
+				frames[2 * i + 1] = right[i];
+			}
+			if (output != NULL && !output->write(frames, thisLen)) return false;
+			if (comparison != NULL) comparison->compare(frames, thisLen);
+		}
+		frameCount -= thisLen;
+	}
+	return true;
+}
+
+// Plays the input once on a new chip. Consecutive waits are rendered as one span. Returns false on an error,
+// which is described by error.
+static bool play(CommandReader &reader, bool blockRendering, WaveFile *output, WaveComparison *comparison, PlayStats &stats,
+	const char *&error) {
+	stats.writeCount = 0;
+	stats.frameCount = 0;
+	stats.seconds = 0.0;
+	error = reader.getError();
+	if (error != NULL) return false;
+	void *chip = ym2151_init(NULL, int(reader.getChipClock()), int(VGM_SAMPLE_RATE));
+	if (chip == NULL) {
+		error = "Failed to initialise the YM2151";
+		return false;
+	}
+	ym2151_reset_chip(chip);
+
+	Clock::time_point startTime = Clock::now();
+	Bit64u pendingFrames = 0;
+	bool written = true;
+	Command command;
+	while (written && reader.next(command)) {
+		if (command.frames > 0) {
+			pendingFrames += command.frames;
+			continue;
+		}
+		written = renderFrames(chip, blockRendering, pendingFrames, output, comparison);
+		stats.frameCount += pendingFrames;
+		pendingFrames = 0;
+		ym2151_write_reg(chip, command.reg, command.value);
+		stats.writeCount++;
+	}
+	if (written) {
+		written = renderFrames(chip, blockRendering, pendingFrames, output, comparison);
+		stats.frameCount += pendingFrames;
+	}
+	std::chrono::duration<double> playTime = Clock::now() - startTime;
+	stats.seconds = playTime.count();
+	ym2151_shutdown(chip);
+
+	if (!written) {
+		error = "Write error";
+		return false;
+	}
+	error = reader.getError();
+	return error == NULL;
+}
+
+static void printUsage() {
+	fprintf(stderr,
+		"Usage: vgm2wav [options] input.vgm|input.regs [output.wav]\n"
+		"Plays the YM2151 part of a VGM file, or a register script, on the chip emulation and reports the throughput.\n"
+		"Options:\n"
+		"  -r          write headerless raw PCM instead of a WAVE file\n"
+		"  -s          render the YM2151 sample by sample (ym2151_update_one)\n"
+		"  -n repeats  play the input this many times and report the fastest, the output is written by the first\n"
+		"  -c file     compare the output with a 16-bit stereo WAVE file, fail if it differs\n"
+		"  -d dB       with -c, only fail below this signal to noise ratio\n");
+}
+
+static bool parseOptions(int argc, char *argv[], Options &options) {
+	options.blockRendering = true;
+	options.raw = false;
+	options.compareFileName = NULL;
+	options.minSNR = -1.0;
+	options.repeats = 1;
+	options.inputFileName = NULL;
+	options.outputFileName = NULL;
+
+	int i = 1;
+	for (; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+		const char *option = argv[i];
+		if (strcmp(option, "-r") == 0) {
+			options.raw = true;
+		} else if (strcmp(option, "-s") == 0) {
+			options.blockRendering = false;
+		} else if (strcmp(option, "-n") == 0 && i + 1 < argc) {
+			int repeats = atoi(argv[++i]);
+			if (repeats < 1) return false;
+			options.repeats = Bit32u(repeats);
+		} else if (strcmp(option, "-c") == 0 && i + 1 < argc) {
+			options.compareFileName = argv[++i];
+		} else if (strcmp(option, "-d") == 0 && i + 1 < argc) {
+			options.minSNR = atof(argv[++i]);
+			if (options.minSNR < 0.0) return false;
+		} else {
+			return false;
+		}
+	}
+	if (argc - i < 1 || argc - i > 2) return false;
+	options.inputFileName = argv[i];
+	if (argc - i == 2) options.outputFileName = argv[i + 1];
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	Options options;
+	if (!parseOptions(argc, argv, options)) {
+		printUsage();
+		return 1;
+	}
+	MappedFile input;
+	if (!input.open(options.inputFileName)) {
+		fprintf(stderr, "vgm2wav: %s: cannot open file\n", options.inputFileName);
+		return 1;
+	}
+	WaveFile output;
+	if (options.outputFileName != NULL) {
+		WaveFile::Format format = options.raw ? WaveFile::Format_RAW_S16 : WaveFile::Format_WAVE_S16;
+		if (!output.open(options.outputFileName, format, VGM_SAMPLE_RATE)) {
+			fprintf(stderr, "vgm2wav: %s: cannot create file\n", options.outputFileName);
+			return 1;
+		}
+	}
+	WaveComparison comparison;
+	if (options.compareFileName != NULL) {
+		const char *error = comparison.open(options.compareFileName);
+		if (error != NULL) {
+			fprintf(stderr, "vgm2wav: %s: %s\n", options.compareFileName, error);
+			return 1;
+		}
+	}
+	bool registerScript = getFileExtension(options.inputFileName) == "regs";
+
+	PlayStats fastest;
+	for (Bit32u run = 0; run < options.repeats; run++) {
+		VgmReader vgmReader(input.getData(), input.getSize());
+		RegisterScriptReader scriptReader(input.getData(), input.getSize());
+		CommandReader &reader = registerScript ? static_cast<CommandReader &>(scriptReader) : vgmReader;
+		WaveFile *runOutput = run == 0 && options.outputFileName != NULL ? &output : NULL;
+		WaveComparison *runComparison = run == 0 && options.compareFileName != NULL ? &comparison : NULL;
+		PlayStats stats;
+		const char *error;
+		bool played = play(reader, options.blockRendering, runOutput, runComparison, stats, error);
+		if (runOutput != NULL && !output.close()) {
+			played = false;
+			error = "Write error";
+		}
+		if (!played) {
+			fprintf(stderr, "vgm2wav: %s: %s\n", runOutput != NULL && reader.getError() == NULL ? options.outputFileName : options.inputFileName, error);
+			return 1;
+		}
+		if (run == 0 || stats.seconds < fastest.seconds) fastest = stats;
+	}
+
+	double audioSeconds = double(fastest.frameCount) / VGM_SAMPLE_RATE;
+	printf("%s: %llu register writes, %.1f s of audio rendered in %.3f s", options.inputFileName,
+		(unsigned long long)fastest.writeCount, audioSeconds, fastest.seconds);
+	if (fastest.seconds > 0.0) {
+		printf(", %.1fx realtime, %.1f Msmp/s", audioSeconds / fastest.seconds, fastest.frameCount / fastest.seconds * 1e-6);
+	}
+	printf(" (%s)\n", options.blockRendering ? "ym2151_update_block" : "ym2151_update_one");
+	if (options.compareFileName != NULL && !comparison.report(options.compareFileName, options.minSNR)) return 1;
+	return 0;
+}
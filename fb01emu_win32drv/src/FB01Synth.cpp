@@ -291,6 +291,10 @@ protected:
 		std::cout << "FB01: LCD-Message: " << message << "\n";
 	}
 
+	virtual void onMIDIOutput(const Bit8u *data, Bit32u length) {
+		SendMidiData(const_cast<Bit8u *>(data), length);
+	}
+
 #ifndef ENABLE_DEBUG_OUTPUT
 	void printDebug(const char *fmt, va_list list) {}
 #endif
@@ -521,7 +525,7 @@ int FB01Synth::Reset() {
 	return wResult;
 }
 
-Bit32u FB01Synth::getMIDIEventTimestamp() {
+Bit64u FB01Synth::getMIDIEventTimestamp() {
 	// Taking a snapshot to avoid interference with the rendering thread
 	UINT64 renderedFramesCountSnapshot = renderedFramesCount;
 	Bit32u renderPosition = Bit32u(renderedFramesCountSnapshot % bufferSize);
@@ -535,17 +539,17 @@ Bit32u FB01Synth::getMIDIEventTimestamp() {
 	UINT64 playedFramesCount = renderedFramesCountSnapshot - bufferedFramesCount;
 	// Estimated MIDI event timestamp in audio output samples
 	UINT64 timestamp = playedFramesCount + midiLatency;
-	return Bit32u(timestamp * sampleRateRatio);
+	return Bit64u(timestamp * sampleRateRatio);
 }
 
 void FB01Synth::PlayMIDI(DWORD msg) {
 	// TODO
-	synth->playMsg(msg, getMIDIEventTimestamp());
+	synth->playMsg64(msg, getMIDIEventTimestamp());
 }
 
 void FB01Synth::PlaySysex(const Bit8u *bufpos, DWORD len) {
 	// TODO
-	synth->playSysex(bufpos, len, getMIDIEventTimestamp());
+	synth->playSysex64(bufpos, len, getMIDIEventTimestamp());
 }
 
 void FB01Synth::Close() {
@@ -54,7 +54,7 @@ public:
 	virtual int Reset();
 	virtual void RenderAvailableSpace();
 	virtual void Render(Bit16s *bufpos, DWORD totalFrames);
-	virtual Bit32u getMIDIEventTimestamp();
+	virtual Bit64u getMIDIEventTimestamp();
 	virtual void PlayMIDI(DWORD msg);
 	virtual void PlaySysex(const Bit8u *bufpos, DWORD len);
 };
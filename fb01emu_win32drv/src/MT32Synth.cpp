@@ -600,7 +600,7 @@ int MT32Synth::Reset() {
 	return wResult;
 }
 
-Bit32u MT32Synth::getMIDIEventTimestamp() {
+Bit64u MT32Synth::getMIDIEventTimestamp() {
 	// Taking a snapshot to avoid interference with the rendering thread
 	UINT64 renderedFramesCountSnapshot = renderedFramesCount;
 	Bit32u renderPosition = Bit32u(renderedFramesCountSnapshot % bufferSize);
@@ -614,15 +614,16 @@ Bit32u MT32Synth::getMIDIEventTimestamp() {
 	UINT64 playedFramesCount = renderedFramesCountSnapshot - bufferedFramesCount;
 	// Estimated MIDI event timestamp in audio output samples
 	UINT64 timestamp = playedFramesCount + midiLatency;
-	return Bit32u(timestamp * sampleRateRatio);
+	return Bit64u(timestamp * sampleRateRatio);
 }
 
+// mt32emu takes 32-bit timestamps, which wrap along with its own sample counter
 void MT32Synth::PlayMIDI(DWORD msg) {
-	synth->playMsg(msg, getMIDIEventTimestamp());
+	synth->playMsg(msg, Bit32u(getMIDIEventTimestamp()));
 }
 
 void MT32Synth::PlaySysex(const Bit8u *bufpos, DWORD len) {
-	synth->playSysex(bufpos, len, getMIDIEventTimestamp());
+	synth->playSysex(bufpos, len, Bit32u(getMIDIEventTimestamp()));
 }
 
 void MT32Synth::FreeROMImages() {
@@ -28,7 +28,7 @@ public:
 	virtual int Reset() = 0;
 	virtual void RenderAvailableSpace() = 0;
 	virtual void Render(Bit16s *bufpos, DWORD totalFrames) = 0;
-	virtual Bit32u getMIDIEventTimestamp() = 0;
+	virtual Bit64u getMIDIEventTimestamp() = 0;
 	virtual void PlayMIDI(DWORD msg) = 0;
 	virtual void PlaySysex(const Bit8u *bufpos, DWORD len) = 0;
 };